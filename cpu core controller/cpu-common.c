@@ -0,0 +1,25 @@
+#include "cpu-common.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+
+char cpu_path_root[MAX_PATH] = "";
+
+void cpu_set_path_root(const char *root)
+{
+    snprintf(cpu_path_root, sizeof(cpu_path_root), "%s", root ? root : "");
+}
+
+int cpu_path(char *buf, size_t size, const char *fmt, ...)
+{
+    int n = snprintf(buf, size, "%s", cpu_path_root);
+    if (n < 0 || (size_t)n >= size)
+        return n;
+
+    va_list ap;
+    va_start(ap, fmt);
+    int m = vsnprintf(buf + n, size - (size_t)n, fmt, ap);
+    va_end(ap);
+
+    return m < 0 ? m : n + m;
+}
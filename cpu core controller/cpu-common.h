@@ -0,0 +1,17 @@
+#ifndef CPU_COMMON_H
+#define CPU_COMMON_H
+
+#include <stddef.h>
+
+#define MAX_CORES 1024
+#define MAX_PATH 256
+
+// Prefix every /sys and /proc path is resolved under: empty on a live system,
+// a fake tree when the benchmark runs the code against synthetic cores
+extern char cpu_path_root[MAX_PATH];
+void cpu_set_path_root(const char *root);
+
+// snprintf() of a /sys or /proc path, with cpu_path_root prepended
+int cpu_path(char *buf, size_t size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#endif // CPU_COMMON_H
@@ -8,23 +8,56 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <math.h>
+#include "cpu-common.h"
+#include "telemetry.h"
+#include "cpu-worker.h"
+#include "governor.h"
+#include "power-profile.h"
+#include "topology.h"
+#include "history.h"
+#include "cpu-profile.h"
 
-#define MAX_CORES 128
-#define MAX_PATH 256
 #define REFRESH_INTERVAL 1000 // Refresh UI every 1 second
+#define HEADLESS_BINARY "cpu-hotplug-governord"
+#define DEFAULT_HISTORY_SECONDS 3600 // One hour of samples at the default refresh rate
+#define MAX_CHART_COLUMNS 4096
+#define CHART_MARGIN 10       // Left and right padding of the plot area
+#define CHART_TITLE_HEIGHT 30 // Plot area starts below the title
+#define CHART_AXIS_HEIGHT 20  // and ends above the time axis
 
 typedef struct
 {
     int id;
     bool online;
+    bool pending; // A hotplug request is queued on the worker thread
     GtkWidget *toggle;
     GtkWidget *status_label;
     GtkWidget *load_label;
     GtkWidget *freq_label;
     GtkWidget *temp_label;
     GtkWidget *recommendation_icon;
+    const char *icon; // Icon name currently shown by recommendation_icon
 } CoreInfo;
 
+enum
+{
+    CHART_USAGE,
+    CHART_POWER,
+    CHART_TEMP,
+    CHART_COUNT
+};
+
+typedef struct
+{
+    GtkWidget *widget;
+    cairo_surface_t *layer; // Static parts of the chart, rebuilt only on resize
+    int width;
+    int height;
+} ChartCache;
+
 typedef struct
 {
     CoreInfo cores[MAX_CORES];
@@ -35,11 +68,16 @@ typedef struct
     GtkWidget *save_profile_button;
     GtkWidget *apply_recommendations_button;
     GtkWidget *auto_toggle;
-    GtkWidget *cpu_usage_chart;
-    GtkWidget *power_usage_chart;
-    GtkWidget *temperature_chart;
+    ChartCache charts[CHART_COUNT];
+    Telemetry telemetry;
+    CpuWorker worker;
+    Governor governor;
+    CpuTopology topology;
+    History history;
+    double freq_peak; // Highest frequency seen, the top of the frequency chart (MHz)
+    int applied_freq_cap; // Frequency cap last sent to the worker (% of hardware range)
+    atomic_bool ui_update_queued;
     gboolean auto_mode;
-    int refresh_timeout_id;
     pthread_mutex_t mutex;
 } AppState;
 
@@ -49,11 +87,7 @@ AppState app;
 static void toggle_core(GtkWidget *widget, gpointer data);
 static gboolean update_ui(gpointer data);
 static void load_core_info();
-static bool read_core_online_status(int core_id);
-static bool set_core_online_status(int core_id, bool online);
-static double get_core_load(int core_id);
-static double get_core_frequency(int core_id);
-static double get_core_temperature(int core_id);
+static void request_core_state(int core_id, bool online);
 static void apply_recommendations();
 static void toggle_auto_mode(GtkWidget *widget, gpointer data);
 static void save_profile(GtkWidget *widget, gpointer data);
@@ -62,137 +96,84 @@ static void change_power_profile(GtkWidget *widget, gpointer data);
 static void draw_chart(GtkWidget *widget, cairo_t *cr, gpointer data);
 static void activate_recommended_cores();
 
-// Get the number of CPU cores on the system
-static int get_num_cores()
-{
-    FILE *fp = popen("grep -c processor /proc/cpuinfo", "r");
-    if (!fp)
-        return 1;
-
-    char buffer[32];
-    fgets(buffer, sizeof(buffer), fp);
-    pclose(fp);
-
-    return atoi(buffer);
-}
-
-// Check if a file exists
-static bool file_exists(const char *filename)
+// Update a label only when its text actually changes, sparing GTK a relayout
+static void set_label_text(GtkWidget *label, const char *text)
 {
-    struct stat buffer;
-    return (stat(filename, &buffer) == 0);
+    if (strcmp(gtk_label_get_text(GTK_LABEL(label)), text) != 0)
+        gtk_label_set_text(GTK_LABEL(label), text);
 }
 
-// Read the online status of a CPU core
-static bool read_core_online_status(int core_id)
+// Same for the recommendation icon, which is tracked by name
+static void set_recommendation_icon(int core_id, const char *icon)
 {
-    if (core_id == 0)
-        return true; // Core 0 is always online
-
-    char path[MAX_PATH];
-    snprintf(path, MAX_PATH, "/sys/devices/system/cpu/cpu%d/online", core_id);
-
-    if (!file_exists(path))
-        return false;
-
-    FILE *fp = fopen(path, "r");
-    if (!fp)
-        return false;
-
-    char status;
-    fscanf(fp, "%c", &status);
-    fclose(fp);
-
-    return status == '1';
+    if (!app.cores[core_id].icon || strcmp(app.cores[core_id].icon, icon) != 0)
+    {
+        gtk_image_set_from_icon_name(GTK_IMAGE(app.cores[core_id].recommendation_icon),
+                                     icon, GTK_ICON_SIZE_SMALL_TOOLBAR);
+        app.cores[core_id].icon = icon;
+    }
 }
 
-// Set the online status of a CPU core
-static bool set_core_online_status(int core_id, bool online)
+// Show per-core stats, or grey them out for an offline core
+static void set_core_stats_visible(int core_id, bool online)
 {
-    if (core_id == 0)
-        return true; // Can't toggle core 0
-
-    char path[MAX_PATH];
-    snprintf(path, MAX_PATH, "/sys/devices/system/cpu/cpu%d/online", core_id);
-
-    if (!file_exists(path))
-        return false;
-
-    FILE *fp = fopen(path, "w");
-    if (!fp)
+    if (!online)
     {
-        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app.window),
-                                                   GTK_DIALOG_DESTROY_WITH_PARENT,
-                                                   GTK_MESSAGE_ERROR,
-                                                   GTK_BUTTONS_CLOSE,
-                                                   "Failed to toggle CPU%d. Do you have root privileges?", core_id);
-        gtk_dialog_run(GTK_DIALOG(dialog));
-        gtk_widget_destroy(dialog);
-        return false;
+        set_label_text(app.cores[core_id].load_label, "N/A");
+        set_label_text(app.cores[core_id].freq_label, "N/A");
+        set_label_text(app.cores[core_id].temp_label, "N/A");
     }
 
-    fprintf(fp, "%d", online ? 1 : 0);
-    fclose(fp);
-
-    return true;
+    gtk_widget_set_sensitive(app.cores[core_id].load_label, online);
+    gtk_widget_set_sensitive(app.cores[core_id].freq_label, online);
+    gtk_widget_set_sensitive(app.cores[core_id].temp_label, online);
 }
 
-// Get CPU load for a specific core
-static double get_core_load(int core_id)
+// Move a core's switch without re-entering toggle_core
+static void set_core_switch(int core_id, bool online)
 {
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "grep 'cpu%d ' /proc/stat | awk '{usage=($2+$4)*100/($2+$4+$5)} END {print usage}'", core_id);
-
-    FILE *fp = popen(cmd, "r");
-    if (!fp)
-        return 0.0;
-
-    char buffer[32];
-    fgets(buffer, sizeof(buffer), fp);
-    pclose(fp);
-
-    return atof(buffer);
+    g_signal_handlers_block_by_func(app.cores[core_id].toggle, G_CALLBACK(toggle_core), GINT_TO_POINTER(core_id));
+    gtk_switch_set_active(GTK_SWITCH(app.cores[core_id].toggle), online);
+    g_signal_handlers_unblock_by_func(app.cores[core_id].toggle, G_CALLBACK(toggle_core), GINT_TO_POINTER(core_id));
 }
 
-// Get CPU frequency for a specific core
-static double get_core_frequency(int core_id)
+// Show a core as switching until the worker reports the result
+static void show_core_pending(int core_id, bool online)
 {
-    char path[MAX_PATH];
-    snprintf(path, MAX_PATH, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", core_id);
-
-    if (!file_exists(path))
-        return 0.0;
-
-    FILE *fp = fopen(path, "r");
-    if (!fp)
-        return 0.0;
+    app.cores[core_id].pending = true;
+    set_core_switch(core_id, online);
+    gtk_label_set_text(GTK_LABEL(app.cores[core_id].status_label),
+                       online ? "Onlining..." : "Offlining...");
+}
 
-    long freq;
-    fscanf(fp, "%ld", &freq);
-    fclose(fp);
+// Queue a core state change on the worker thread; the result arrives in handle_hotplug_results
+static void request_core_state(int core_id, bool online)
+{
+    if (core_id == 0)
+        return; // Can't toggle core 0
 
-    return freq / 1000.0; // Convert to MHz
+    cpu_worker_request_hotplug(&app.worker, core_id, online);
+    show_core_pending(core_id, online);
 }
 
-// Get CPU temperature for a specific core (if available)
-static double get_core_temperature(int core_id)
+// Queue a target mask (-1 leave, 0 offline, 1 online) as one transaction:
+// the worker writes the cores that differ in parallel and rolls all of them
+// back if any one fails
+static void request_core_states(const int *target)
 {
-    // This is a simplified implementation; real-world would need to check various temperature sources
-    char path[MAX_PATH];
-    snprintf(path, MAX_PATH, "/sys/class/thermal/thermal_zone0/temp");
-
-    if (!file_exists(path))
-        return 0.0;
+    int batch[MAX_CORES];
 
-    FILE *fp = fopen(path, "r");
-    if (!fp)
-        return 0.0;
+    for (int i = 0; i < app.num_cores; i++)
+    {
+        batch[i] = -1;
+        if (i == 0 || target[i] < 0 || app.cores[i].online == (target[i] == 1))
+            continue;
 
-    long temp;
-    fscanf(fp, "%ld", &temp);
-    fclose(fp);
+        batch[i] = target[i];
+        show_core_pending(i, target[i] == 1);
+    }
 
-    return temp / 1000.0; // Convert to °C
+    cpu_worker_request_transaction(&app.worker, batch);
 }
 
 // Toggle a CPU core on/off
@@ -201,108 +182,116 @@ static void toggle_core(GtkWidget *widget, gpointer data)
     int core_id = GPOINTER_TO_INT(data);
     bool new_status = gtk_switch_get_active(GTK_SWITCH(widget));
 
-    if (set_core_online_status(core_id, new_status))
+    request_core_state(core_id, new_status);
+}
+
+// Apply finished hotplug writes reported by the worker thread
+static gboolean handle_hotplug_results(gpointer data)
+{
+    HotplugResult results[MAX_CORES];
+    int count = cpu_worker_take_results(&app.worker, results, MAX_CORES);
+    const HotplugResult *failure = NULL;
+    int rolled_back = 0;
+
+    for (int i = 0; i < count; i++)
     {
-        app.cores[core_id].online = new_status;
-        gtk_label_set_text(GTK_LABEL(app.cores[core_id].status_label),
-                           new_status ? "Online" : "Offline");
+        int core_id = results[i].core_id;
+        app.cores[core_id].pending = false;
 
-        if (new_status)
+        if (results[i].error == 0 && !results[i].rolled_back)
         {
-            gtk_widget_set_sensitive(app.cores[core_id].load_label, TRUE);
-            gtk_widget_set_sensitive(app.cores[core_id].freq_label, TRUE);
-            gtk_widget_set_sensitive(app.cores[core_id].temp_label, TRUE);
+            app.cores[core_id].online = results[i].online;
+            gtk_label_set_text(GTK_LABEL(app.cores[core_id].status_label),
+                               results[i].online ? "Online" : "Offline");
+            set_core_stats_visible(core_id, results[i].online);
+
+            // Update statusbar
+            char message[64];
+            snprintf(message, sizeof(message), "CPU%d turned %s (%.1f ms)", core_id,
+                     results[i].online ? "online" : "offline", results[i].latency_ms);
+            gtk_statusbar_push(GTK_STATUSBAR(app.status_bar), 0, message);
         }
         else
         {
-            gtk_label_set_text(GTK_LABEL(app.cores[core_id].load_label), "N/A");
-            gtk_label_set_text(GTK_LABEL(app.cores[core_id].freq_label), "N/A");
-            gtk_label_set_text(GTK_LABEL(app.cores[core_id].temp_label), "N/A");
-            gtk_widget_set_sensitive(app.cores[core_id].load_label, FALSE);
-            gtk_widget_set_sensitive(app.cores[core_id].freq_label, FALSE);
-            gtk_widget_set_sensitive(app.cores[core_id].temp_label, FALSE);
+            // Failed, never attempted, or undone with the rest of its batch: the core kept its old state
+            if (results[i].rolled_back)
+                rolled_back++;
+            else if (results[i].error != ECANCELED && !failure)
+                failure = &results[i];
+
+            app.cores[core_id].online = !results[i].online;
+            set_core_switch(core_id, app.cores[core_id].online);
+            gtk_label_set_text(GTK_LABEL(app.cores[core_id].status_label),
+                               app.cores[core_id].online ? "Online" : "Offline");
         }
-
-        // Update statusbar
-        char message[64];
-        snprintf(message, sizeof(message), "CPU%d turned %s", core_id, new_status ? "online" : "offline");
-        gtk_statusbar_push(GTK_STATUSBAR(app.status_bar), 0, message);
     }
-    else
+
+    if (failure)
     {
-        // Revert toggle switch if operation failed
-        gtk_switch_set_active(GTK_SWITCH(widget), app.cores[core_id].online);
+        char rollback_note[64] = "";
+        if (rolled_back > 0)
+            snprintf(rollback_note, sizeof(rollback_note), " %d other change%s rolled back.",
+                     rolled_back, rolled_back == 1 ? " was" : "s were");
+
+        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app.window),
+                                                   GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                   GTK_MESSAGE_ERROR,
+                                                   GTK_BUTTONS_CLOSE,
+                                                   "Failed to toggle CPU%d: %s%s%s", failure->core_id,
+                                                   strerror(failure->error),
+                                                   failure->error == EACCES ? ". Do you have root privileges?" : "",
+                                                   rollback_note);
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
     }
+
+    return G_SOURCE_REMOVE;
 }
 
 // Load CPU core information
 static void load_core_info()
 {
-    app.num_cores = get_num_cores();
-    if (app.num_cores > MAX_CORES)
-        app.num_cores = MAX_CORES;
+    app.num_cores = telemetry_count_cores();
 
     for (int i = 0; i < app.num_cores; i++)
     {
         app.cores[i].id = i;
-        app.cores[i].online = read_core_online_status(i);
+        app.cores[i].online = telemetry_read_online(i);
     }
 }
 
-// Determine if a core should be active based on system load
-static bool should_be_active(int core_id)
+// Fold the latest snapshot into the governor; a snapshot is only ever evaluated once
+static const TelemetrySnapshot *evaluate_governor()
 {
-    static double total_load = 0.0;
-    static int active_cores = 0;
-
-    // Simple heuristic: If overall load > 70% of active cores, suggest activating more
-    // If load < 30% of active cores, suggest deactivating some
-
-    // Count active cores and get total load
-    total_load = 0.0;
-    active_cores = 0;
+    const TelemetrySnapshot *snap = telemetry_current(&app.telemetry);
 
-    for (int i = 0; i < app.num_cores; i++)
-    {
-        if (app.cores[i].online)
-        {
-            active_cores++;
-            total_load += get_core_load(i);
-        }
-    }
-
-    // Always keep core 0 online
-    if (core_id == 0)
-        return true;
+    // Cores only expose their topology while online; pick it up as they appear
+    if (topology_learn(&app.topology, snap->online))
+        governor_set_order(&app.governor, app.topology.order);
 
-    // If this core is already online
-    if (app.cores[core_id].online)
-    {
-        // Keep it online if load is high
-        return (total_load / active_cores) > 30.0;
-    }
-    else
-    {
-        // Turn it on if load is high
-        return active_cores > 0 && (total_load / active_cores) > 70.0;
-    }
+    governor_update(&app.governor, snap);
+    return snap;
 }
 
 // Apply automatic core recommendations
 static void apply_recommendations()
 {
+    evaluate_governor();
+
     for (int i = 1; i < app.num_cores; i++)
     { // Skip core 0
-        bool should_be_on = should_be_active(i);
+        bool should_be_on = app.governor.recommend[i];
 
         if (app.cores[i].online != should_be_on)
-        {
-            if (set_core_online_status(i, should_be_on))
-            {
-                app.cores[i].online = should_be_on;
-                gtk_switch_set_active(GTK_SWITCH(app.cores[i].toggle), should_be_on);
-            }
-        }
+            request_core_state(i, should_be_on);
+    }
+
+    if (app.governor.freq_cap_pct != app.applied_freq_cap)
+    {
+        CpufreqSettings settings;
+        cpufreq_settings_max_pct(&settings, app.governor.freq_cap_pct);
+        cpu_worker_request_cpufreq(&app.worker, &settings);
+        app.applied_freq_cap = app.governor.freq_cap_pct;
     }
 
     // Update status bar
@@ -344,7 +333,7 @@ static void save_profile(GtkWidget *widget, gpointer data)
     chooser = GTK_FILE_CHOOSER(dialog);
 
     gtk_file_chooser_set_do_overwrite_confirmation(chooser, TRUE);
-    gtk_file_chooser_set_current_name(chooser, "cpu_profile.conf");
+    gtk_file_chooser_set_current_name(chooser, "cpu_profile.prof");
 
     res = gtk_dialog_run(GTK_DIALOG(dialog));
     if (res == GTK_RESPONSE_ACCEPT)
@@ -352,19 +341,36 @@ static void save_profile(GtkWidget *widget, gpointer data)
         char *filename;
         filename = gtk_file_chooser_get_filename(chooser);
 
-        FILE *fp = fopen(filename, "w");
-        if (fp)
-        {
-            for (int i = 0; i < app.num_cores; i++)
-            {
-                fprintf(fp, "%d:%d\n", i, app.cores[i].online ? 1 : 0);
-            }
-            fclose(fp);
+        CpuProfile profile;
+        memset(&profile, 0, sizeof(profile));
+        profile.num_cores = app.num_cores;
+        for (int i = 0; i < app.num_cores; i++)
+            profile.online[i] = app.cores[i].online;
 
-            char message[256];
-            snprintf(message, sizeof(message), "Profile saved to %s", filename);
-            gtk_statusbar_push(GTK_STATUSBAR(app.status_bar), 0, message);
+        // Frequency settings of the selected power profile, with the cap currently in force
+        char *power_profile = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(app.power_profile_combo));
+        int profile_id = power_profile ? power_profile_from_name(power_profile) : -1;
+        if (profile_id >= 0)
+        {
+            power_profile_cpufreq(profile_id, &profile.cpufreq);
+            profile.cpufreq.max_pct = app.applied_freq_cap;
+            profile.has_cpufreq = true;
         }
+        g_free(power_profile);
+
+        profile.has_topology = true;
+        profile.topology = cpu_profile_fingerprint();
+        profile.has_governor = true;
+        profile.governor = app.governor.cfg;
+        profile.auto_mode = app.auto_mode;
+
+        int error = cpu_profile_save(filename, &profile);
+        char message[256];
+        if (error)
+            snprintf(message, sizeof(message), "Failed to save %s: %s", filename, strerror(error));
+        else
+            snprintf(message, sizeof(message), "Profile saved to %s", filename);
+        gtk_statusbar_push(GTK_STATUSBAR(app.status_bar), 0, message);
 
         g_free(filename);
     }
@@ -372,6 +378,54 @@ static void save_profile(GtkWidget *widget, gpointer data)
     gtk_widget_destroy(dialog);
 }
 
+// Ask before applying a profile saved for a different machine
+static bool confirm_profile_mismatch(const CpuProfile *profile)
+{
+    int mismatch = cpu_profile_check(profile, app.num_cores);
+    if (!mismatch)
+        return true;
+
+    GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app.window),
+                                               GTK_DIALOG_DESTROY_WITH_PARENT,
+                                               GTK_MESSAGE_WARNING,
+                                               GTK_BUTTONS_YES_NO,
+                                               "%s Apply it anyway?",
+                                               (mismatch & CPU_PROFILE_CORES_DIFFER)
+                                                   ? "This profile was saved for a different number of cores."
+                                                   : "This profile was saved on a machine with a different CPU layout.");
+    gint res = gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
+
+    return res == GTK_RESPONSE_YES;
+}
+
+// Apply every part a profile carries: the online mask as one transaction,
+// then frequency settings, governor thresholds and auto mode
+static void apply_cpu_profile(const CpuProfile *profile)
+{
+    int target[MAX_CORES];
+
+    for (int i = 0; i < app.num_cores; i++)
+        target[i] = i > 0 && i < profile->num_cores ? profile->online[i] : -1;
+    request_core_states(target);
+
+    if (profile->has_cpufreq)
+    {
+        cpu_worker_request_cpufreq(&app.worker, &profile->cpufreq);
+        if (profile->cpufreq.max_pct >= 0)
+        {
+            governor_set_freq_cap(&app.governor, profile->cpufreq.max_pct);
+            app.applied_freq_cap = profile->cpufreq.max_pct;
+        }
+    }
+
+    if (profile->has_governor)
+    {
+        app.governor.cfg = profile->governor;
+        gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app.auto_toggle), profile->auto_mode);
+    }
+}
+
 // Load a saved profile
 static void load_profile(GtkWidget *widget, gpointer data)
 {
@@ -394,32 +448,19 @@ static void load_profile(GtkWidget *widget, gpointer data)
         char *filename;
         filename = gtk_file_chooser_get_filename(chooser);
 
-        FILE *fp = fopen(filename, "r");
-        if (fp)
-        {
-            int core_id, status;
-            char line[64];
+        CpuProfile profile;
+        int error = cpu_profile_load(filename, &profile);
+        char message[256];
 
-            while (fgets(line, sizeof(line), fp))
-            {
-                if (sscanf(line, "%d:%d", &core_id, &status) == 2)
-                {
-                    if (core_id >= 0 && core_id < app.num_cores && core_id > 0)
-                    { // Don't touch core 0
-                        bool online = status != 0;
-
-                        if (set_core_online_status(core_id, online))
-                        {
-                            app.cores[core_id].online = online;
-                            gtk_switch_set_active(GTK_SWITCH(app.cores[core_id].toggle), online);
-                        }
-                    }
-                }
-            }
-
-            fclose(fp);
-
-            char message[256];
+        if (error)
+        {
+            snprintf(message, sizeof(message), "Failed to load %s: %s", filename,
+                     error == EINVAL ? "not a valid profile" : strerror(error));
+            gtk_statusbar_push(GTK_STATUSBAR(app.status_bar), 0, message);
+        }
+        else if (confirm_profile_mismatch(&profile))
+        {
+            apply_cpu_profile(&profile);
             snprintf(message, sizeof(message), "Profile loaded from %s", filename);
             gtk_statusbar_push(GTK_STATUSBAR(app.status_bar), 0, message);
         }
@@ -434,64 +475,74 @@ static void load_profile(GtkWidget *widget, gpointer data)
 static void change_power_profile(GtkWidget *widget, gpointer data)
 {
     const char *profile = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(widget));
+    int profile_id = power_profile_from_name(profile);
+    int target[MAX_CORES];
+    CpufreqSettings settings;
 
-    if (strcmp(profile, "Power Saver") == 0)
-    {
-        // Turn off all cores except 0 and 1
-        for (int i = 2; i < app.num_cores; i++)
-        {
-            if (app.cores[i].online)
-            {
-                set_core_online_status(i, false);
-                app.cores[i].online = false;
-                gtk_switch_set_active(GTK_SWITCH(app.cores[i].toggle), false);
-            }
-        }
-    }
-    else if (strcmp(profile, "Balanced") == 0)
-    {
-        // Turn on about half the cores
-        for (int i = 0; i < app.num_cores; i++)
-        {
-            bool should_be_on = i < (app.num_cores + 1) / 2;
+    if (profile_id < 0)
+        return;
 
-            if (app.cores[i].online != should_be_on)
-            {
-                set_core_online_status(i, should_be_on);
-                app.cores[i].online = should_be_on;
-                gtk_switch_set_active(GTK_SWITCH(app.cores[i].toggle), should_be_on);
-            }
-        }
-    }
-    else if (strcmp(profile, "Performance") == 0)
-    {
-        // Turn on all cores
-        for (int i = 0; i < app.num_cores; i++)
-        {
-            if (!app.cores[i].online)
-            {
-                set_core_online_status(i, true);
-                app.cores[i].online = true;
-                gtk_switch_set_active(GTK_SWITCH(app.cores[i].toggle), true);
-            }
-        }
-    }
+    power_profile_target(profile_id, app.num_cores, app.topology.order, target);
+    request_core_states(target);
+
+    // The worker runs this after the hotplug requests above, so newly onlined cores get it too
+    power_profile_cpufreq(profile_id, &settings);
+    cpu_worker_request_cpufreq(&app.worker, &settings);
+    governor_set_freq_cap(&app.governor, settings.max_pct);
+    app.applied_freq_cap = settings.max_pct;
 
     char message[64];
     snprintf(message, sizeof(message), "Applied %s profile", profile);
     gtk_statusbar_push(GTK_STATUSBAR(app.status_bar), 0, message);
 }
 
-// Draw a chart for CPU stats
-static void draw_chart(GtkWidget *widget, cairo_t *cr, gpointer data)
+// Map a value onto the plot area, clamped to its edges
+static double chart_y(double value, double y_max, int plot_top, int plot_bottom)
 {
-    const int chart_type = GPOINTER_TO_INT(data); // 0 = usage, 1 = power, 2 = temp
+    double fraction = value / y_max;
+    if (fraction < 0.0)
+        fraction = 0.0;
+    if (fraction > 1.0)
+        fraction = 1.0;
 
-    GtkAllocation allocation;
-    gtk_widget_get_allocation(widget, &allocation);
+    return plot_bottom - fraction * (plot_bottom - plot_top);
+}
 
-    const int width = allocation.width;
-    const int height = allocation.height;
+// Chart title, line colour and metric for each chart type
+static const struct
+{
+    const char *title;
+    HistoryMetric metric;
+    double red, green, blue;
+} chart_styles[CHART_COUNT] = {
+    {"CPU Usage (%)", HISTORY_LOAD, 0.2, 0.6, 0.9},
+    {"Power Usage (Relative)", HISTORY_FREQ, 0.9, 0.6, 0.2},
+    {"Temperature (°C)", HISTORY_TEMP, 0.9, 0.2, 0.2},
+};
+
+// Label for the left end of the time axis, i.e. how far back the history reaches
+static void format_chart_axis(char *text, size_t size)
+{
+    unsigned long recorded = app.history.count < (unsigned long)app.history.capacity
+                                 ? app.history.count
+                                 : (unsigned long)app.history.capacity;
+    snprintf(text, size, "-%lus", recorded * REFRESH_INTERVAL / 1000);
+}
+
+// Render everything that does not move with the data (background, border,
+// title, axis and its fixed label) into the chart's cached layer. The title's
+// layout only happens here, so it runs once per resize rather than once per tick.
+static void build_chart_layer(GtkWidget *widget, ChartCache *cache, int chart_type, int width, int height)
+{
+    if (cache->layer)
+        cairo_surface_destroy(cache->layer);
+
+    cache->layer = gdk_window_create_similar_surface(gtk_widget_get_window(widget),
+                                                     CAIRO_CONTENT_COLOR, width, height);
+    cache->width = width;
+    cache->height = height;
+
+    cairo_t *cr = cairo_create(cache->layer);
 
     // Draw background
     cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
@@ -504,208 +555,199 @@ static void draw_chart(GtkWidget *widget, cairo_t *cr, gpointer data)
     cairo_stroke(cr);
 
     // Draw chart title
+    cairo_text_extents_t extents;
     cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
     cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
     cairo_set_font_size(cr, 14);
-
-    const char *title;
-    switch (chart_type)
-    {
-    case 0:
-        title = "CPU Usage (%)";
-        break;
-    case 1:
-        title = "Power Usage (Relative)";
-        break;
-    case 2:
-        title = "Temperature (°C)";
-        break;
-    default:
-        title = "Unknown Chart";
-        break;
-    }
-
-    cairo_text_extents_t extents;
-    cairo_text_extents(cr, title, &extents);
+    cairo_text_extents(cr, chart_styles[chart_type].title, &extents);
     cairo_move_to(cr, (width - extents.width) / 2, 20);
-    cairo_show_text(cr, title);
+    cairo_show_text(cr, chart_styles[chart_type].title);
 
-    // Draw bars for each core
-    const int bar_padding = 5;
-    const int bar_width = (width - (app.num_cores + 1) * bar_padding) / app.num_cores;
-    const int chart_top = 30;
-    const int chart_bottom = height - 30;
-    const int chart_height = chart_bottom - chart_top;
+    // Time axis
+    const int plot_right = width - CHART_MARGIN;
+    const int plot_bottom = height - CHART_AXIS_HEIGHT;
 
     cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
     cairo_set_font_size(cr, 10);
+    cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
 
-    for (int i = 0; i < app.num_cores; i++)
+    cairo_text_extents(cr, "now", &extents);
+    cairo_move_to(cr, plot_right - extents.width, height - 6);
+    cairo_show_text(cr, "now");
+
+    cairo_move_to(cr, CHART_MARGIN, plot_bottom + 0.5);
+    cairo_line_to(cr, plot_right, plot_bottom + 0.5);
+    cairo_stroke(cr);
+
+    cairo_destroy(cr);
+}
+
+// Draw a chart of the recorded history, one line per core, newest sample at the right edge
+static void draw_chart(GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+    const int chart_type = GPOINTER_TO_INT(data); // CHART_USAGE, CHART_POWER or CHART_TEMP
+    static float column_min[MAX_CHART_COLUMNS];
+    static float column_max[MAX_CHART_COLUMNS];
+
+    if (chart_type < 0 || chart_type >= CHART_COUNT)
+        return;
+
+    ChartCache *cache = &app.charts[chart_type];
+    const int width = gtk_widget_get_allocated_width(widget);
+    const int height = gtk_widget_get_allocated_height(widget);
+
+    if (!cache->layer || cache->width != width || cache->height != height)
+        build_chart_layer(widget, cache, chart_type, width, height);
+
+    // GTK has already clipped cr to the invalidated area, so this only copies that much
+    cairo_set_source_surface(cr, cache->layer, 0, 0);
+    cairo_paint(cr);
+
+    const int plot_right = width - CHART_MARGIN;
+    const int plot_top = CHART_TITLE_HEIGHT;
+    const int plot_bottom = height - CHART_AXIS_HEIGHT;
+
+    // The range label grows every tick until the history is full, so it is drawn
+    // here rather than in the layer, and only when the redraw reaches the axis
+    double clip_x1, clip_y1, clip_x2, clip_y2;
+    cairo_clip_extents(cr, &clip_x1, &clip_y1, &clip_x2, &clip_y2);
+    if (clip_y2 > plot_bottom)
     {
-        if (!app.cores[i].online)
-        {
-            // Draw inactive bar
-            cairo_set_source_rgb(cr, 0.7, 0.7, 0.7);
-            cairo_rectangle(cr,
-                            bar_padding + i * (bar_width + bar_padding),
-                            chart_bottom - 2,
-                            bar_width,
-                            2);
-            cairo_fill(cr);
-
-            // Draw "Offline" text
-            cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
-            cairo_move_to(cr,
-                          bar_padding + i * (bar_width + bar_padding) + bar_width / 2 - 15,
-                          chart_bottom - 5);
-            cairo_show_text(cr, "Offline");
-            continue;
-        }
+        char axis_text[32];
+        format_chart_axis(axis_text, sizeof(axis_text));
+        cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+        cairo_set_font_size(cr, 10);
+        cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
+        cairo_move_to(cr, CHART_MARGIN, height - 6);
+        cairo_show_text(cr, axis_text);
+    }
+    int plot_width = plot_right - CHART_MARGIN;
+    if (plot_width <= 0 || plot_bottom <= plot_top)
+        return;
+    if (plot_width > MAX_CHART_COLUMNS)
+        plot_width = MAX_CHART_COLUMNS;
 
-        double value = 0.0;
-        switch (chart_type)
-        {
-        case 0:
-            value = get_core_load(i);
-            cairo_set_source_rgb(cr, 0.2, 0.6, 0.9);
-            break;
-        case 1:
-            value = get_core_frequency(i) / 1000.0 * 100.0; // Normalized to percentage
-            if (value > 100.0)
-                value = 100.0;
-            cairo_set_source_rgb(cr, 0.9, 0.6, 0.2);
-            break;
-        case 2:
-            value = get_core_temperature(i);
-            value = (value / 80.0) * 100.0; // Normalized to percentage (80C = 100%)
-            if (value > 100.0)
-                value = 100.0;
-            cairo_set_source_rgb(cr, 0.9, 0.2, 0.2);
-            break;
-        }
+    // Frequency is drawn relative to the highest seen so far
+    const double y_max = chart_styles[chart_type].metric == HISTORY_FREQ ? app.freq_peak : 100.0;
 
-        const int bar_height = (int)((value / 100.0) * chart_height);
+    cairo_set_source_rgba(cr, chart_styles[chart_type].red, chart_styles[chart_type].green,
+                          chart_styles[chart_type].blue, 0.6);
+    cairo_set_line_width(cr, 1.0);
 
-        // Draw the bar
-        cairo_rectangle(cr,
-                        bar_padding + i * (bar_width + bar_padding),
-                        chart_bottom - bar_height,
-                        bar_width,
-                        bar_height);
-        cairo_fill(cr);
+    for (int i = 0; i < app.num_cores; i++)
+    {
+        int columns = history_columns(&app.history, chart_styles[chart_type].metric, i, 0, plot_width,
+                                      column_min, column_max);
+        double x = plot_right - columns + 0.5;
+        bool drawing = false;
 
-        // Draw the value
-        char value_text[16];
-        switch (chart_type)
+        // Each column spans the min..max of the samples it covers, so spikes survive downsampling
+        for (int c = 0; c < columns; c++, x += 1.0)
         {
-        case 0:
-            snprintf(value_text, sizeof(value_text), "%.1f%%", value);
-            break;
-        case 1:
-            snprintf(value_text, sizeof(value_text), "%.2f GHz", get_core_frequency(i) / 1000.0);
-            break;
-        case 2:
-            snprintf(value_text, sizeof(value_text), "%.1f°C", get_core_temperature(i));
-            break;
+            if (isnan(column_min[c]))
+            {
+                drawing = false; // Core was offline; leave a gap
+                continue;
+            }
+
+            double y_low = chart_y(column_min[c], y_max, plot_top, plot_bottom);
+            double y_high = chart_y(column_max[c], y_max, plot_top, plot_bottom);
+            if (drawing)
+                cairo_line_to(cr, x, y_low);
+            else
+                cairo_move_to(cr, x, y_low);
+            cairo_line_to(cr, x, y_high);
+            drawing = true;
         }
 
-        cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
-        cairo_text_extents(cr, value_text, &extents);
-        cairo_move_to(cr,
-                      bar_padding + i * (bar_width + bar_padding) + (bar_width - extents.width) / 2,
-                      chart_bottom - bar_height - 5);
-        cairo_show_text(cr, value_text);
-
-        // Draw the CPU number
-        char cpu_text[8];
-        snprintf(cpu_text, sizeof(cpu_text), "CPU%d", i);
-
-        cairo_text_extents(cr, cpu_text, &extents);
-        cairo_move_to(cr,
-                      bar_padding + i * (bar_width + bar_padding) + (bar_width - extents.width) / 2,
-                      chart_bottom + 15);
-        cairo_show_text(cr, cpu_text);
+        cairo_stroke(cr);
+    }
+}
+
+// Invalidate the part of a chart that a new sample changes: the plot area,
+// plus the time-axis label while the history is still filling up
+static void queue_chart_redraw(int chart_type, bool axis_changed)
+{
+    GtkWidget *widget = app.charts[chart_type].widget;
+    const int width = gtk_widget_get_allocated_width(widget);
+    const int height = gtk_widget_get_allocated_height(widget);
+
+    if (axis_changed)
+    {
+        gtk_widget_queue_draw_area(widget, 0, CHART_TITLE_HEIGHT, width, height - CHART_TITLE_HEIGHT);
+        return;
     }
+
+    gtk_widget_queue_draw_area(widget, CHART_MARGIN, CHART_TITLE_HEIGHT,
+                               width - 2 * CHART_MARGIN, height - CHART_AXIS_HEIGHT - CHART_TITLE_HEIGHT + 1);
 }
 
-// Update the UI with current core information
+// Update the UI with the latest snapshot published by the worker thread
 static gboolean update_ui(gpointer data)
 {
     pthread_mutex_lock(&app.mutex);
 
+    // Labels, charts and the governor all read this one snapshot
+    atomic_store(&app.ui_update_queued, false);
+    const TelemetrySnapshot *snap = evaluate_governor();
+
     for (int i = 0; i < app.num_cores; i++)
     {
-        app.cores[i].online = read_core_online_status(i);
+        app.cores[i].online = snap->online[i];
 
-        // Update the toggle switch state (without triggering the callback)
-        g_signal_handlers_block_by_func(app.cores[i].toggle, G_CALLBACK(toggle_core), GINT_TO_POINTER(i));
-        gtk_switch_set_active(GTK_SWITCH(app.cores[i].toggle), app.cores[i].online);
-        g_signal_handlers_unblock_by_func(app.cores[i].toggle, G_CALLBACK(toggle_core), GINT_TO_POINTER(i));
+        // Leave the switch showing the requested state until the worker reports back
+        if (!app.cores[i].pending)
+        {
+            // Update the toggle switch state (without triggering the callback)
+            if (gtk_switch_get_active(GTK_SWITCH(app.cores[i].toggle)) != app.cores[i].online)
+                set_core_switch(i, app.cores[i].online);
 
-        // Update status label
-        gtk_label_set_text(GTK_LABEL(app.cores[i].status_label),
-                           app.cores[i].online ? "Online" : "Offline");
+            // Update status label
+            set_label_text(app.cores[i].status_label, app.cores[i].online ? "Online" : "Offline");
+        }
 
         // Update stats for online cores
         if (app.cores[i].online)
         {
-            double load = get_core_load(i);
-            double freq = get_core_frequency(i);
-            double temp = get_core_temperature(i);
+            double load = snap->load[i];
+            double freq = snap->freq[i];
+            double temp = snap->temp[i];
 
             char load_text[32], freq_text[32], temp_text[32];
             snprintf(load_text, sizeof(load_text), "%.1f%%", load);
             snprintf(freq_text, sizeof(freq_text), "%.2f GHz", freq / 1000.0);
             snprintf(temp_text, sizeof(temp_text), "%.1f°C", temp);
 
-            gtk_label_set_text(GTK_LABEL(app.cores[i].load_label), load_text);
-            gtk_label_set_text(GTK_LABEL(app.cores[i].freq_label), freq_text);
-            gtk_label_set_text(GTK_LABEL(app.cores[i].temp_label), temp_text);
+            set_label_text(app.cores[i].load_label, load_text);
+            set_label_text(app.cores[i].freq_label, freq_text);
+            set_label_text(app.cores[i].temp_label, temp_text);
 
             // Update recommendation icon
-            if (should_be_active(i))
-            {
-                gtk_image_set_from_icon_name(GTK_IMAGE(app.cores[i].recommendation_icon),
-                                             "emblem-ok", GTK_ICON_SIZE_SMALL_TOOLBAR);
-            }
-            else
-            {
-                gtk_image_set_from_icon_name(GTK_IMAGE(app.cores[i].recommendation_icon),
-                                             "process-stop", GTK_ICON_SIZE_SMALL_TOOLBAR);
-            }
+            set_recommendation_icon(i, app.governor.recommend[i] ? "emblem-ok" : "process-stop");
 
-            gtk_widget_set_sensitive(app.cores[i].load_label, TRUE);
-            gtk_widget_set_sensitive(app.cores[i].freq_label, TRUE);
-            gtk_widget_set_sensitive(app.cores[i].temp_label, TRUE);
+            set_core_stats_visible(i, true);
         }
         else
         {
-            gtk_label_set_text(GTK_LABEL(app.cores[i].load_label), "N/A");
-            gtk_label_set_text(GTK_LABEL(app.cores[i].freq_label), "N/A");
-            gtk_label_set_text(GTK_LABEL(app.cores[i].temp_label), "N/A");
-
-            gtk_widget_set_sensitive(app.cores[i].load_label, FALSE);
-            gtk_widget_set_sensitive(app.cores[i].freq_label, FALSE);
-            gtk_widget_set_sensitive(app.cores[i].temp_label, FALSE);
+            set_core_stats_visible(i, false);
 
             // Update recommendation icon for offline cores
-            if (should_be_active(i))
-            {
-                gtk_image_set_from_icon_name(GTK_IMAGE(app.cores[i].recommendation_icon),
-                                             "emblem-important", GTK_ICON_SIZE_SMALL_TOOLBAR);
-            }
-            else
-            {
-                gtk_image_set_from_icon_name(GTK_IMAGE(app.cores[i].recommendation_icon),
-                                             "emblem-ok", GTK_ICON_SIZE_SMALL_TOOLBAR);
-            }
+            set_recommendation_icon(i, app.governor.recommend[i] ? "emblem-important" : "emblem-ok");
         }
     }
 
-    // Refresh charts
-    gtk_widget_queue_draw(app.cpu_usage_chart);
-    gtk_widget_queue_draw(app.power_usage_chart);
-    gtk_widget_queue_draw(app.temperature_chart);
+    // Record the snapshot for the charts
+    bool history_full = app.history.count >= (unsigned long)app.history.capacity;
+    history_append(&app.history, snap);
+    for (int i = 0; i < app.num_cores; i++)
+    {
+        if (snap->online[i] && snap->freq[i] > app.freq_peak)
+            app.freq_peak = ceil(snap->freq[i] / 500.0) * 500.0;
+    }
+
+    // Refresh only the plot areas; titles and borders come from each chart's cached layer
+    for (int c = 0; c < CHART_COUNT; c++)
+        queue_chart_redraw(c, !history_full);
 
     // Apply recommendations if in auto mode
     if (app.auto_mode)
@@ -715,7 +757,21 @@ static gboolean update_ui(gpointer data)
 
     pthread_mutex_unlock(&app.mutex);
 
-    return G_SOURCE_CONTINUE;
+    return G_SOURCE_REMOVE;
+}
+
+// Called on the worker thread each time a snapshot is published
+static void on_worker_snapshot(void *user_data)
+{
+    // If the UI has not caught up with the last one yet, that pending update will show this one
+    if (!atomic_exchange(&app.ui_update_queued, true))
+        g_idle_add(update_ui, NULL);
+}
+
+// Called on the worker thread once queued hotplug writes have completed
+static void on_worker_hotplug(void *user_data)
+{
+    g_idle_add(handle_hotplug_results, NULL);
 }
 
 int main(int argc, char *argv[])
@@ -726,6 +782,34 @@ int main(int argc, char *argv[])
     GtkWidget *scrolled_window, *cores_grid;
     GtkWidget *control_panel, *profile_box;
     GtkWidget *load_profile_button;
+    long history_seconds = DEFAULT_HISTORY_SECONDS;
+    int policy = GOVERNOR_POLICY_LOAD;
+
+    // Servers without a display get the GTK-free daemon instead
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--headless") == 0)
+        {
+            execvp(HEADLESS_BINARY, argv);
+            perror("Failed to start " HEADLESS_BINARY);
+            return 1;
+        }
+        else if (strncmp(argv[i], "--history=", 10) == 0)
+        {
+            history_seconds = strtol(argv[i] + 10, NULL, 10);
+            if (history_seconds <= 0)
+                history_seconds = DEFAULT_HISTORY_SECONDS;
+        }
+        else if (strncmp(argv[i], "--policy=", 9) == 0)
+        {
+            policy = governor_policy_from_name(argv[i] + 9);
+            if (policy < 0)
+            {
+                fprintf(stderr, "Unknown policy '%s'\n", argv[i] + 9);
+                return 1;
+            }
+        }
+    }
 
     gtk_init(&argc, &argv);
 
@@ -735,6 +819,28 @@ int main(int argc, char *argv[])
     // Load core information
     load_core_info();
 
+    // Allocate the per-tick snapshot buffers and take the baseline load sample
+    if (telemetry_init(&app.telemetry, app.num_cores) < 0)
+    {
+        fprintf(stderr, "Failed to allocate telemetry buffers\n");
+        return 1;
+    }
+    telemetry_refresh(&app.telemetry);
+
+    // The whole chart history is allocated here; ticks only overwrite it
+    if (history_init(&app.history, app.num_cores, (int)(history_seconds * 1000 / REFRESH_INTERVAL)) < 0)
+    {
+        fprintf(stderr, "Failed to allocate %ld seconds of history\n", history_seconds);
+        return 1;
+    }
+    app.freq_peak = 1000.0;
+
+    governor_init(&app.governor, app.num_cores, NULL);
+    app.governor.cfg.policy = policy;
+    topology_load(&app.topology, app.num_cores);
+    governor_set_order(&app.governor, app.topology.order);
+    app.applied_freq_cap = app.governor.freq_cap_pct;
+
     // Create the main window
     window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     gtk_window_set_title(GTK_WINDOW(window), "CPU Hotplug Governor");
@@ -807,22 +913,22 @@ int main(int argc, char *argv[])
     gtk_box_pack_start(GTK_BOX(content_box), chart_box, TRUE, TRUE, 0);
 
     // CPU Usage Chart
-    app.cpu_usage_chart = gtk_drawing_area_new();
-    gtk_widget_set_size_request(app.cpu_usage_chart, 250, 200);
-    g_signal_connect(app.cpu_usage_chart, "draw", G_CALLBACK(draw_chart), GINT_TO_POINTER(0));
-    gtk_box_pack_start(GTK_BOX(chart_box), app.cpu_usage_chart, TRUE, TRUE, 0);
+    app.charts[CHART_USAGE].widget = gtk_drawing_area_new();
+    gtk_widget_set_size_request(app.charts[CHART_USAGE].widget, 250, 200);
+    g_signal_connect(app.charts[CHART_USAGE].widget, "draw", G_CALLBACK(draw_chart), GINT_TO_POINTER(CHART_USAGE));
+    gtk_box_pack_start(GTK_BOX(chart_box), app.charts[CHART_USAGE].widget, TRUE, TRUE, 0);
 
     // Power Usage Chart
-    app.power_usage_chart = gtk_drawing_area_new();
-    gtk_widget_set_size_request(app.power_usage_chart, 250, 200);
-    g_signal_connect(app.power_usage_chart, "draw", G_CALLBACK(draw_chart), GINT_TO_POINTER(1));
-    gtk_box_pack_start(GTK_BOX(chart_box), app.power_usage_chart, TRUE, TRUE, 0);
+    app.charts[CHART_POWER].widget = gtk_drawing_area_new();
+    gtk_widget_set_size_request(app.charts[CHART_POWER].widget, 250, 200);
+    g_signal_connect(app.charts[CHART_POWER].widget, "draw", G_CALLBACK(draw_chart), GINT_TO_POINTER(CHART_POWER));
+    gtk_box_pack_start(GTK_BOX(chart_box), app.charts[CHART_POWER].widget, TRUE, TRUE, 0);
 
     // Temperature Chart
-    app.temperature_chart = gtk_drawing_area_new();
-    gtk_widget_set_size_request(app.temperature_chart, 250, 200);
-    g_signal_connect(app.temperature_chart, "draw", G_CALLBACK(draw_chart), GINT_TO_POINTER(2));
-    gtk_box_pack_start(GTK_BOX(chart_box), app.temperature_chart, TRUE, TRUE, 0);
+    app.charts[CHART_TEMP].widget = gtk_drawing_area_new();
+    gtk_widget_set_size_request(app.charts[CHART_TEMP].widget, 250, 200);
+    g_signal_connect(app.charts[CHART_TEMP].widget, "draw", G_CALLBACK(draw_chart), GINT_TO_POINTER(CHART_TEMP));
+    gtk_box_pack_start(GTK_BOX(chart_box), app.charts[CHART_TEMP].widget, TRUE, TRUE, 0);
 
     // Create scrolled window for cores grid
     scrolled_window = gtk_scrolled_window_new(NULL, NULL);
@@ -910,6 +1016,7 @@ int main(int argc, char *argv[])
 
         // Recommendation icon
         app.cores[i].recommendation_icon = gtk_image_new_from_icon_name("emblem-ok", GTK_ICON_SIZE_SMALL_TOOLBAR);
+        app.cores[i].icon = "emblem-ok";
         gtk_widget_set_halign(app.cores[i].recommendation_icon, GTK_ALIGN_CENTER);
         gtk_grid_attach(GTK_GRID(cores_grid), app.cores[i].recommendation_icon, 6, i + 1, 1, 1);
 
@@ -926,8 +1033,13 @@ int main(int argc, char *argv[])
     gtk_box_pack_end(GTK_BOX(main_vbox), app.status_bar, FALSE, FALSE, 0);
     gtk_statusbar_push(GTK_STATUSBAR(app.status_bar), 0, "Ready. Found CPU cores: 0 to N");
 
-    // Set up a timer to update the UI periodically
-    app.refresh_timeout_id = g_timeout_add(REFRESH_INTERVAL, update_ui, NULL);
+    // Hand all sysfs sampling and hotplug writes to the worker thread
+    if (cpu_worker_start(&app.worker, &app.telemetry, REFRESH_INTERVAL,
+                         on_worker_snapshot, on_worker_hotplug, NULL) != 0)
+    {
+        fprintf(stderr, "Failed to start sampler thread\n");
+        return 1;
+    }
 
     // Show all widgets
     gtk_widget_show_all(window);
@@ -936,7 +1048,14 @@ int main(int argc, char *argv[])
     gtk_main();
 
     // Clean up
-    g_source_remove(app.refresh_timeout_id);
+    cpu_worker_stop(&app.worker);
+    telemetry_free(&app.telemetry);
+    history_free(&app.history);
+    for (int c = 0; c < CHART_COUNT; c++)
+    {
+        if (app.charts[c].layer)
+            cairo_surface_destroy(app.charts[c].layer);
+    }
     pthread_mutex_destroy(&app.mutex);
 
     return 0;
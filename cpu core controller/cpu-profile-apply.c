@@ -0,0 +1,133 @@
+// Apply a saved CPU profile without the GUI, e.g. from a boot service:
+//
+//   cpu-profile-apply [--force] [--dry-run] PROFILE
+//
+// Cores are switched as one batch that is rolled back if any core fails,
+// then the profile's cpufreq settings are written to every online core.
+// Profiles saved on a machine with a different core count or CPU layout are
+// refused unless --force is given. Governor thresholds and auto mode are only
+// used by the GUI and the daemon (cpu-hotplug-governord --load).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "cpu-common.h"
+#include "cpu-profile.h"
+#include "hotplug.h"
+#include "cpufreq.h"
+#include "telemetry.h"
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [--force] [--dry-run] PROFILE\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    bool force = false;
+    bool dry_run = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--force") == 0)
+            force = true;
+        else if (strcmp(argv[i], "--dry-run") == 0)
+            dry_run = true;
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!path)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    CpuProfile profile;
+    int error = cpu_profile_load(path, &profile);
+    if (error)
+    {
+        fprintf(stderr, "Failed to load %s: %s\n", path, error == EINVAL ? "not a valid profile" : strerror(error));
+        return 1;
+    }
+
+    int num_cores = telemetry_count_cores();
+    int mismatch = cpu_profile_check(&profile, num_cores);
+    if (mismatch & CPU_PROFILE_CORES_DIFFER)
+        fprintf(stderr, "Profile is for %d cores, this machine has %d\n", profile.num_cores, num_cores);
+    if (mismatch & CPU_PROFILE_TOPOLOGY_DIFFERS)
+        fprintf(stderr, "Profile was saved on a machine with a different CPU layout\n");
+    if (mismatch && !force)
+    {
+        fprintf(stderr, "Not applying; use --force to apply it anyway\n");
+        return 1;
+    }
+
+    // Cores the profile does not cover keep their state
+    bool current[MAX_CORES];
+    bool target[MAX_CORES];
+    for (int i = 0; i < num_cores; i++)
+    {
+        current[i] = telemetry_read_online(i);
+        target[i] = i < profile.num_cores ? profile.online[i] : current[i];
+    }
+    target[0] = true;
+
+    if (dry_run)
+    {
+        for (int i = 1; i < num_cores; i++)
+        {
+            if (current[i] != target[i])
+                printf("cpu%d -> %s\n", i, target[i] ? "online" : "offline");
+        }
+        if (profile.has_cpufreq)
+            printf("cpufreq governor \"%s\" min %d%% max %d%% epp \"%s\"\n", profile.cpufreq.governor,
+                   profile.cpufreq.min_pct, profile.cpufreq.max_pct, profile.cpufreq.epp);
+        return 0;
+    }
+
+    HotplugBatch batch;
+    error = hotplug_apply_mask(current, target, num_cores, HOTPLUG_DEFAULT_THREADS, true, &batch);
+    for (int i = 0; i < batch.count; i++)
+    {
+        const HotplugResult *r = &batch.results[i];
+        if (r->error == ECANCELED)
+            continue;
+        printf("cpu%d %s: %s (%.1f ms)%s\n", r->core_id, r->online ? "online" : "offline",
+               r->error ? strerror(r->error) : "ok", r->latency_ms, r->rolled_back ? ", rolled back" : "");
+    }
+    printf("%d change%s in %.1f ms\n", batch.count, batch.count == 1 ? "" : "s", batch.total_ms);
+
+    if (error)
+    {
+        fprintf(stderr, "Hotplug failed; %s\n",
+                batch.rolled_back ? "previous core states restored" : "some cores could not be restored");
+        return 1;
+    }
+
+    if (profile.has_cpufreq)
+    {
+        CpufreqInfo info;
+        bool online[MAX_CORES];
+
+        for (int i = 0; i < num_cores; i++)
+            online[i] = telemetry_read_online(i);
+
+        cpufreq_init(&info, num_cores);
+        error = cpufreq_apply(&info, online, &profile.cpufreq);
+        if (error)
+        {
+            fprintf(stderr, "Failed to apply cpufreq settings: %s\n", strerror(error));
+            return 1;
+        }
+    }
+
+    return 0;
+}
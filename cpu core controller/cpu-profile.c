@@ -0,0 +1,429 @@
+#include "cpu-profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+
+// File layout, all integers little-endian:
+//
+//   magic "CPUPROF\n", u16 version, then sections of
+//   u16 tag, u16 length, payload[length]
+//   and finally u32 FNV-1a checksum of everything before it.
+//
+// Readers skip sections they do not know, so later versions can add some
+// without breaking older tools.
+#define PROFILE_MAGIC "CPUPROF\n"
+#define PROFILE_MAGIC_LEN 8
+#define PROFILE_MAX_SIZE 16384
+
+enum
+{
+    SECTION_CORES = 1,    // u16 num_cores, online bitmap
+    SECTION_CPUFREQ = 2,  // i16 min_pct, i16 max_pct, str governor, str epp
+    SECTION_TOPOLOGY = 3, // u64 fingerprint
+    SECTION_GOVERNOR = 4, // thresholds in hundredths, ints, flags
+    SECTION_POLICY = 5,   // u8 policy, setpoint, kp, ki in hundredths
+};
+
+typedef struct
+{
+    unsigned char *data;
+    size_t len;
+    size_t size;
+    bool failed; // Ran past the end while writing or reading
+} Buffer;
+
+static uint32_t fnv1a32(const unsigned char *data, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+static void put_bytes(Buffer *b, const void *data, size_t len)
+{
+    if (b->len + len > b->size)
+    {
+        b->failed = true;
+        return;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void put_uint(Buffer *b, uint64_t value, int bytes)
+{
+    unsigned char out[8];
+    for (int i = 0; i < bytes; i++)
+        out[i] = (unsigned char)(value >> (8 * i));
+    put_bytes(b, out, (size_t)bytes);
+}
+
+static void put_string(Buffer *b, const char *s)
+{
+    size_t len = strlen(s);
+    if (len > 255)
+        len = 255;
+    put_uint(b, len, 1);
+    put_bytes(b, s, len);
+}
+
+static void put_hundredths(Buffer *b, double value)
+{
+    put_uint(b, (uint32_t)(int32_t)lround(value * 100.0), 4);
+}
+
+static const unsigned char *get_bytes(Buffer *b, size_t len)
+{
+    if (b->failed || b->len + len > b->size)
+    {
+        b->failed = true;
+        return NULL;
+    }
+    const unsigned char *p = b->data + b->len;
+    b->len += len;
+    return p;
+}
+
+static uint64_t get_uint(Buffer *b, int bytes)
+{
+    const unsigned char *p = get_bytes(b, (size_t)bytes);
+    uint64_t value = 0;
+    for (int i = 0; p && i < bytes; i++)
+        value |= (uint64_t)p[i] << (8 * i);
+    return value;
+}
+
+static void get_string(Buffer *b, char *out, size_t size)
+{
+    size_t len = (size_t)get_uint(b, 1);
+    const unsigned char *p = get_bytes(b, len);
+
+    out[0] = '\0';
+    if (!p)
+        return;
+    if (len >= size)
+        len = size - 1;
+    memcpy(out, p, len);
+    out[len] = '\0';
+}
+
+static double get_hundredths(Buffer *b)
+{
+    return (int32_t)(uint32_t)get_uint(b, 4) / 100.0;
+}
+
+// Open a section; its length is patched in by end_section
+static size_t begin_section(Buffer *b, int tag)
+{
+    put_uint(b, (uint64_t)tag, 2);
+    put_uint(b, 0, 2);
+    return b->len;
+}
+
+static void end_section(Buffer *b, size_t start)
+{
+    if (b->failed)
+        return;
+    size_t len = b->len - start;
+    b->data[start - 2] = (unsigned char)len;
+    b->data[start - 1] = (unsigned char)(len >> 8);
+}
+
+static uint64_t fnv1a64(uint64_t hash, const char *text)
+{
+    for (; *text; text++)
+        hash = (hash ^ (unsigned char)*text) * 1099511628211ull;
+    return hash;
+}
+
+static bool read_text_file(const char *name, char *buf, size_t size)
+{
+    char path[MAX_PATH];
+    cpu_path(path, MAX_PATH, "%s", name);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n <= 0)
+        return false;
+
+    buf[n] = '\0';
+    return true;
+}
+
+uint64_t cpu_profile_fingerprint(void)
+{
+    uint64_t hash = 14695981039346656037ull;
+    char buf[4096];
+
+    if (read_text_file("/sys/devices/system/cpu/present", buf, sizeof(buf)))
+        hash = fnv1a64(hash, buf);
+    if (read_text_file("/sys/devices/system/node/online", buf, sizeof(buf)))
+        hash = fnv1a64(hash, buf);
+
+    // The first processor's identification lines; the rest repeat them
+    if (read_text_file("/proc/cpuinfo", buf, sizeof(buf)))
+    {
+        static const char *const keys[] = {"vendor_id", "cpu family", "model\t", "model name", "CPU part"};
+        for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++)
+        {
+            const char *line = strstr(buf, keys[k]);
+            if (!line)
+                continue;
+
+            char value[128];
+            size_t len = strcspn(line, "\n");
+            if (len >= sizeof(value))
+                len = sizeof(value) - 1;
+            memcpy(value, line, len);
+            value[len] = '\0';
+            hash = fnv1a64(hash, value);
+        }
+    }
+
+    return hash;
+}
+
+int cpu_profile_save(const char *path, const CpuProfile *profile)
+{
+    unsigned char data[PROFILE_MAX_SIZE];
+    Buffer b = {.data = data, .size = sizeof(data)};
+    size_t section;
+
+    put_bytes(&b, PROFILE_MAGIC, PROFILE_MAGIC_LEN);
+    put_uint(&b, CPU_PROFILE_VERSION, 2);
+
+    section = begin_section(&b, SECTION_CORES);
+    put_uint(&b, (uint64_t)profile->num_cores, 2);
+    for (int i = 0; i < profile->num_cores; i += 8)
+    {
+        unsigned int bits = 0;
+        for (int j = 0; j < 8 && i + j < profile->num_cores; j++)
+            bits |= (unsigned int)profile->online[i + j] << j;
+        put_uint(&b, bits, 1);
+    }
+    end_section(&b, section);
+
+    if (profile->has_cpufreq)
+    {
+        section = begin_section(&b, SECTION_CPUFREQ);
+        put_uint(&b, (uint16_t)(int16_t)profile->cpufreq.min_pct, 2);
+        put_uint(&b, (uint16_t)(int16_t)profile->cpufreq.max_pct, 2);
+        put_string(&b, profile->cpufreq.governor);
+        put_string(&b, profile->cpufreq.epp);
+        end_section(&b, section);
+    }
+
+    if (profile->has_topology)
+    {
+        section = begin_section(&b, SECTION_TOPOLOGY);
+        put_uint(&b, profile->topology, 8);
+        end_section(&b, section);
+    }
+
+    if (profile->has_governor)
+    {
+        const GovernorConfig *cfg = &profile->governor;
+        section = begin_section(&b, SECTION_GOVERNOR);
+        put_hundredths(&b, cfg->low_threshold);
+        put_hundredths(&b, cfg->high_threshold);
+        put_hundredths(&b, cfg->target_load);
+        put_hundredths(&b, cfg->ewma_alpha);
+        put_hundredths(&b, cfg->thermal_limit);
+        put_uint(&b, (uint32_t)cfg->min_dwell_ticks, 4);
+        put_uint(&b, (uint32_t)cfg->min_cores, 4);
+        put_uint(&b, (uint32_t)cfg->freq_step_pct, 4);
+        put_uint(&b, (uint32_t)cfg->min_freq_pct, 4);
+        put_uint(&b, (cfg->prefer_frequency ? 1u : 0u) | (profile->auto_mode ? 2u : 0u), 1);
+        end_section(&b, section);
+
+        // Kept apart so older readers still load the thresholds and skip the policy
+        section = begin_section(&b, SECTION_POLICY);
+        put_uint(&b, (uint64_t)cfg->policy, 1);
+        put_hundredths(&b, cfg->pressure_setpoint);
+        put_hundredths(&b, cfg->pi_kp);
+        put_hundredths(&b, cfg->pi_ki);
+        end_section(&b, section);
+    }
+
+    put_uint(&b, fnv1a32(data, b.len), 4);
+    if (b.failed)
+        return EOVERFLOW;
+
+    // Write a sibling file and rename it over, so a crash never leaves half a profile
+    char tmp_path[MAX_PATH + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return errno;
+
+    int error = 0;
+    if (write(fd, data, b.len) != (ssize_t)b.len)
+        error = errno ? errno : EIO;
+    if (close(fd) != 0 && !error)
+        error = errno;
+    if (!error && rename(tmp_path, path) != 0)
+        error = errno;
+    if (error)
+        unlink(tmp_path);
+
+    return error;
+}
+
+// The original format: one "core:state" line per core, online mask only
+static int load_legacy(const unsigned char *data, size_t len, CpuProfile *profile)
+{
+    char text[PROFILE_MAX_SIZE + 1];
+    memcpy(text, data, len);
+    text[len] = '\0';
+
+    for (char *line = strtok(text, "\n"); line; line = strtok(NULL, "\n"))
+    {
+        int core_id, status;
+        if (sscanf(line, "%d:%d", &core_id, &status) != 2)
+            continue;
+        if (core_id < 0 || core_id >= MAX_CORES)
+            return EINVAL;
+
+        profile->online[core_id] = status != 0;
+        if (core_id >= profile->num_cores)
+            profile->num_cores = core_id + 1;
+    }
+
+    return profile->num_cores > 0 ? 0 : EINVAL;
+}
+
+static void load_section(Buffer *b, int tag, CpuProfile *profile)
+{
+    switch (tag)
+    {
+    case SECTION_CORES:
+        profile->num_cores = (int)get_uint(b, 2);
+        if (profile->num_cores > MAX_CORES)
+        {
+            b->failed = true;
+            return;
+        }
+        for (int i = 0; i < profile->num_cores; i += 8)
+        {
+            unsigned int bits = (unsigned int)get_uint(b, 1);
+            for (int j = 0; j < 8 && i + j < profile->num_cores; j++)
+                profile->online[i + j] = (bits >> j) & 1;
+        }
+        break;
+
+    case SECTION_CPUFREQ:
+        profile->cpufreq.min_pct = (int16_t)get_uint(b, 2);
+        profile->cpufreq.max_pct = (int16_t)get_uint(b, 2);
+        get_string(b, profile->cpufreq.governor, sizeof(profile->cpufreq.governor));
+        get_string(b, profile->cpufreq.epp, sizeof(profile->cpufreq.epp));
+        profile->has_cpufreq = true;
+        break;
+
+    case SECTION_TOPOLOGY:
+        profile->topology = get_uint(b, 8);
+        profile->has_topology = true;
+        break;
+
+    case SECTION_GOVERNOR:
+    {
+        GovernorConfig *cfg = &profile->governor;
+        cfg->low_threshold = get_hundredths(b);
+        cfg->high_threshold = get_hundredths(b);
+        cfg->target_load = get_hundredths(b);
+        cfg->ewma_alpha = get_hundredths(b);
+        cfg->thermal_limit = get_hundredths(b);
+        cfg->min_dwell_ticks = (int32_t)get_uint(b, 4);
+        cfg->min_cores = (int32_t)get_uint(b, 4);
+        cfg->freq_step_pct = (int32_t)get_uint(b, 4);
+        cfg->min_freq_pct = (int32_t)get_uint(b, 4);
+        unsigned int flags = (unsigned int)get_uint(b, 1);
+        cfg->prefer_frequency = flags & 1;
+        profile->auto_mode = flags & 2;
+        profile->has_governor = true;
+        break;
+    }
+
+    case SECTION_POLICY:
+    {
+        GovernorConfig *cfg = &profile->governor;
+        unsigned int policy = (unsigned int)get_uint(b, 1);
+        cfg->policy = policy < GOVERNOR_POLICY_COUNT ? (GovernorPolicy)policy : GOVERNOR_POLICY_LOAD;
+        cfg->pressure_setpoint = get_hundredths(b);
+        cfg->pi_kp = get_hundredths(b);
+        cfg->pi_ki = get_hundredths(b);
+        break;
+    }
+    }
+}
+
+int cpu_profile_load(const char *path, CpuProfile *profile)
+{
+    unsigned char data[PROFILE_MAX_SIZE];
+
+    memset(profile, 0, sizeof(*profile));
+    profile->cpufreq.min_pct = -1;
+    profile->cpufreq.max_pct = -1;
+    governor_default_config(&profile->governor);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return errno;
+
+    ssize_t len = read(fd, data, sizeof(data));
+    int error = len < 0 ? errno : 0;
+    close(fd);
+    if (error)
+        return error;
+
+    if (len < PROFILE_MAGIC_LEN + 2 + 4 || memcmp(data, PROFILE_MAGIC, PROFILE_MAGIC_LEN) != 0)
+        return load_legacy(data, (size_t)len, profile);
+
+    size_t body = (size_t)len - 4;
+    Buffer b = {.data = data, .len = body, .size = (size_t)len};
+    if (get_uint(&b, 4) != fnv1a32(data, body))
+        return EINVAL;
+
+    b = (Buffer){.data = data, .len = PROFILE_MAGIC_LEN, .size = body};
+    if (get_uint(&b, 2) > CPU_PROFILE_VERSION)
+        return EINVAL; // Written by a newer tool that changed the meaning of existing sections
+
+    while (b.len < body && !b.failed)
+    {
+        int tag = (int)get_uint(&b, 2);
+        size_t section_len = (size_t)get_uint(&b, 2);
+        if (b.failed || b.len + section_len > body)
+            return EINVAL;
+
+        // Parse within the section's bounds, then continue after it whatever was read
+        Buffer section = {.data = b.data, .len = b.len, .size = b.len + section_len};
+        load_section(&section, tag, profile);
+        if (section.failed)
+            return EINVAL;
+        b.len += section_len;
+    }
+
+    return profile->num_cores > 0 && !b.failed ? 0 : EINVAL;
+}
+
+int cpu_profile_check(const CpuProfile *profile, int num_cores)
+{
+    int mismatch = 0;
+
+    if (profile->num_cores != num_cores)
+        mismatch |= CPU_PROFILE_CORES_DIFFER;
+    if (profile->has_topology && profile->topology != cpu_profile_fingerprint())
+        mismatch |= CPU_PROFILE_TOPOLOGY_DIFFERS;
+
+    return mismatch;
+}
@@ -0,0 +1,48 @@
+#ifndef CPU_PROFILE_H
+#define CPU_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cpu-common.h"
+#include "cpufreq.h"
+#include "governor.h"
+
+#define CPU_PROFILE_VERSION 1
+
+// Mismatches between a profile and the machine it is applied to
+#define CPU_PROFILE_CORES_DIFFER 0x1
+#define CPU_PROFILE_TOPOLOGY_DIFFERS 0x2
+
+// Everything a saved profile can carry. Legacy "core:state" text files only
+// fill in the online mask; the has_* flags say which parts are present.
+typedef struct
+{
+    int num_cores;
+    bool online[MAX_CORES];
+
+    bool has_cpufreq;
+    CpufreqSettings cpufreq;
+
+    bool has_topology;
+    uint64_t topology; // cpu_profile_fingerprint() of the machine it was saved on
+
+    bool has_governor;
+    GovernorConfig governor;
+    bool auto_mode;
+} CpuProfile;
+
+// Identity of this machine's CPU layout: present cores, NUMA nodes and CPU
+// model. Stable across hotplug, unlike the per-core topology of online cores.
+uint64_t cpu_profile_fingerprint(void);
+
+// Write a profile in the binary format. Returns 0 or an errno value.
+int cpu_profile_save(const char *path, const CpuProfile *profile);
+
+// Read a binary profile, or a legacy "core:state" text file. Returns 0, an
+// errno value, or EINVAL for a corrupt or unsupported file.
+int cpu_profile_load(const char *path, CpuProfile *profile);
+
+// CPU_PROFILE_* flags for everything that does not match this machine
+int cpu_profile_check(const CpuProfile *profile, int num_cores);
+
+#endif // CPU_PROFILE_H
@@ -0,0 +1,204 @@
+#include "cpu-sampler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define PROC_STAT_PATH "/proc/stat"
+
+// Read the whole of /proc/stat with one pread, growing the buffer only if it was too small
+static ssize_t read_proc_stat(CpuSampler *s)
+{
+    for (;;)
+    {
+        ssize_t n = pread(s->fd, s->buf, s->buf_size - 1, 0);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        if ((size_t)n < s->buf_size - 1)
+        {
+            s->buf[n] = '\0';
+            return n;
+        }
+
+        // Buffer filled up; the file may be longer than we thought
+        size_t new_size = s->buf_size * 2;
+        char *new_buf = realloc(s->buf, new_size);
+        if (!new_buf)
+            return -1;
+        s->buf = new_buf;
+        s->buf_size = new_size;
+    }
+}
+
+// Parse the counters following "cpu" / "cpuN" on one line
+static const char *parse_times(const char *p, CpuTimes *t)
+{
+    unsigned long long *fields[] = {&t->user, &t->nice, &t->system, &t->idle,
+                                    &t->iowait, &t->irq, &t->softirq, &t->steal};
+    char *end;
+
+    memset(t, 0, sizeof(*t));
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+    {
+        *fields[i] = strtoull(p, &end, 10);
+        if (end == p)
+            break; // Older kernels have fewer columns
+        p = end;
+    }
+
+    return p;
+}
+
+static unsigned long long times_total(const CpuTimes *t)
+{
+    // guest/guest_nice are already accounted in user/nice, so they are left out
+    return t->user + t->nice + t->system + t->idle + t->iowait + t->irq + t->softirq + t->steal;
+}
+
+// Turn two counter snapshots into a percentage breakdown of the interval between them
+static void compute_load(const CpuTimes *prev, const CpuTimes *cur, CpuLoad *load)
+{
+    unsigned long long prev_total = times_total(prev);
+    unsigned long long cur_total = times_total(cur);
+
+    memset(load, 0, sizeof(*load));
+    if (cur_total <= prev_total)
+        return; // No time elapsed, or counters went backwards after a hotplug
+
+    double scale = 100.0 / (double)(cur_total - prev_total);
+
+#define DELTA(field) (cur->field >= prev->field ? (double)(cur->field - prev->field) * scale : 0.0)
+    load->user = DELTA(user);
+    load->nice = DELTA(nice);
+    load->system = DELTA(system);
+    load->irq = DELTA(irq);
+    load->softirq = DELTA(softirq);
+    load->steal = DELTA(steal);
+    load->iowait = DELTA(iowait);
+#undef DELTA
+
+    load->busy = load->user + load->nice + load->system + load->irq + load->softirq + load->steal;
+    if (load->busy > 100.0)
+        load->busy = 100.0;
+    load->valid = true;
+}
+
+// The runqueue counters sit near the end, after the interrupt tables
+static void parse_procs(CpuSampler *s, const char *p)
+{
+    const char *running = strstr(p, "\nprocs_running ");
+    if (running)
+        s->procs_running = (int)strtol(running + 15, NULL, 10);
+
+    const char *blocked = strstr(running ? running : p, "\nprocs_blocked ");
+    if (blocked)
+        s->procs_blocked = (int)strtol(blocked + 15, NULL, 10);
+}
+
+// Parse every "cpu" line of the buffer in one pass, then the runqueue counters
+static void parse_proc_stat(CpuSampler *s)
+{
+    const char *p = s->buf;
+
+    memset(s->cur_seen, 0, (size_t)s->num_cores * sizeof(s->cur_seen[0]));
+
+    while (*p)
+    {
+        if (strncmp(p, "cpu", 3) != 0)
+            break; // The per-CPU lines come first
+
+        p += 3;
+        if (*p == ' ')
+        {
+            p = parse_times(p, &s->cur_total);
+        }
+        else
+        {
+            char *end;
+            long id = strtol(p, &end, 10);
+            p = end;
+            if (id >= 0 && id < s->num_cores)
+            {
+                p = parse_times(p, &s->cur[id]);
+                s->cur_seen[id] = true;
+            }
+        }
+
+        p = strchr(p, '\n');
+        if (!p)
+            return;
+        p++;
+    }
+
+    // Step back onto the newline so the searches can anchor on line starts
+    if (p > s->buf)
+        parse_procs(s, p - 1);
+}
+
+int cpu_sampler_open(CpuSampler *s, int num_cores)
+{
+    memset(s, 0, sizeof(*s));
+    s->num_cores = num_cores > MAX_CORES ? MAX_CORES : num_cores;
+
+    char path[MAX_PATH];
+    cpu_path(path, MAX_PATH, PROC_STAT_PATH);
+    s->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (s->fd < 0)
+        return -1;
+
+    // Roughly 100 bytes per cpu line plus the interrupt and softirq tables
+    s->buf_size = 16384 + (size_t)s->num_cores * 128;
+    s->buf = malloc(s->buf_size);
+    if (!s->buf)
+    {
+        close(s->fd);
+        s->fd = -1;
+        return -1;
+    }
+
+    return cpu_sampler_update(s);
+}
+
+int cpu_sampler_update(CpuSampler *s)
+{
+    if (s->fd < 0 || read_proc_stat(s) < 0)
+        return -1;
+
+    parse_proc_stat(s);
+
+    for (int i = 0; i < s->num_cores; i++)
+    {
+        // Offline cores are missing from /proc/stat; they have no load for this interval
+        if (s->primed && s->cur_seen[i] && s->prev_seen[i])
+            compute_load(&s->prev[i], &s->cur[i], &s->load[i]);
+        else
+            memset(&s->load[i], 0, sizeof(s->load[i]));
+    }
+
+    if (s->primed)
+        compute_load(&s->prev_total, &s->cur_total, &s->total);
+
+    memcpy(s->prev, s->cur, (size_t)s->num_cores * sizeof(s->prev[0]));
+    memcpy(s->prev_seen, s->cur_seen, (size_t)s->num_cores * sizeof(s->prev_seen[0]));
+    s->prev_total = s->cur_total;
+    s->primed = true;
+
+    return 0;
+}
+
+void cpu_sampler_close(CpuSampler *s)
+{
+    if (s->fd >= 0)
+        close(s->fd);
+    s->fd = -1;
+    free(s->buf);
+    s->buf = NULL;
+}
@@ -0,0 +1,63 @@
+#ifndef CPU_SAMPLER_H
+#define CPU_SAMPLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "cpu-common.h"
+
+// Raw cumulative jiffy counters from one "cpu" line of /proc/stat
+typedef struct
+{
+    unsigned long long user;
+    unsigned long long nice;
+    unsigned long long system;
+    unsigned long long idle;
+    unsigned long long iowait;
+    unsigned long long irq;
+    unsigned long long softirq;
+    unsigned long long steal;
+} CpuTimes;
+
+// Utilization over the last sampling interval, in percent of that interval
+typedef struct
+{
+    bool valid; // false until the core has been seen in two consecutive samples
+    double busy;
+    double user;
+    double nice;
+    double system;
+    double irq;
+    double softirq;
+    double steal;
+    double iowait;
+} CpuLoad;
+
+typedef struct
+{
+    int fd;
+    int num_cores;
+    char *buf;
+    size_t buf_size;
+    CpuTimes prev[MAX_CORES];
+    CpuTimes cur[MAX_CORES];
+    bool prev_seen[MAX_CORES];
+    bool cur_seen[MAX_CORES];
+    CpuTimes prev_total;
+    CpuTimes cur_total;
+    bool primed;
+    CpuLoad load[MAX_CORES];
+    CpuLoad total;
+    int procs_running; // Runnable tasks at sample time, this sampler included
+    int procs_blocked; // Tasks waiting on I/O
+} CpuSampler;
+
+// Open /proc/stat once and take the baseline sample. Returns 0 on success, -1 on error.
+int cpu_sampler_open(CpuSampler *s, int num_cores);
+
+// Re-read /proc/stat in a single pread and recompute per-interval load for every core
+// and the runqueue counters.
+int cpu_sampler_update(CpuSampler *s);
+
+void cpu_sampler_close(CpuSampler *s);
+
+#endif // CPU_SAMPLER_H
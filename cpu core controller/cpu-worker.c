@@ -0,0 +1,244 @@
+#include "cpu-worker.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static void deadline_after(struct timespec *ts, unsigned int ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static bool deadline_passed(const struct timespec *ts)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > ts->tv_sec || (now.tv_sec == ts->tv_sec && now.tv_nsec >= ts->tv_nsec);
+}
+
+// Carry out everything queued so far. Called and returns with the lock held,
+// but drops it around the sysfs writes.
+static bool run_pending_hotplug(CpuWorker *w)
+{
+    int requests[MAX_CORES];
+    bool current[MAX_CORES];
+    bool target[MAX_CORES];
+
+    if (w->pending_count == 0)
+        return false;
+
+    bool transaction = w->pending_transaction;
+    memcpy(requests, w->pending, (size_t)w->num_cores * sizeof(int));
+    memset(w->pending, -1, (size_t)w->num_cores * sizeof(int));
+    w->pending_count = 0;
+    w->pending_transaction = false;
+
+    pthread_mutex_unlock(&w->lock);
+
+    // The snapshot may be a tick old; diff against what the kernel says right now
+    for (int i = 0; i < w->num_cores; i++)
+    {
+        current[i] = requests[i] < 0 || telemetry_read_online(i);
+        target[i] = requests[i] < 0 ? current[i] : requests[i] == 1;
+    }
+
+    HotplugBatch batch;
+    hotplug_apply_mask(current, target, w->num_cores, HOTPLUG_DEFAULT_THREADS, transaction, &batch);
+
+    pthread_mutex_lock(&w->lock);
+
+    // Cores that were already in the requested state still get a result, so the UI can settle them
+    for (int i = 0; i < w->num_cores; i++)
+    {
+        if (requests[i] < 0 || current[i] != target[i] || w->result_count == MAX_CORES)
+            continue;
+
+        HotplugResult *r = &w->results[w->result_count++];
+        memset(r, 0, sizeof(*r));
+        r->core_id = i;
+        r->online = target[i];
+    }
+
+    for (int i = 0; i < batch.count; i++)
+    {
+        if (w->result_count == MAX_CORES)
+            break; // The UI is far behind; it will resync from the next snapshot
+        w->results[w->result_count++] = batch.results[i];
+    }
+
+    return true;
+}
+
+// Apply a queued cpufreq change. Same locking rules as run_pending_hotplug.
+static void run_pending_cpufreq(CpuWorker *w, const TelemetrySnapshot *snap)
+{
+    if (!w->freq_pending)
+        return;
+
+    CpufreqSettings settings = w->freq_request;
+    w->freq_pending = false;
+
+    pthread_mutex_unlock(&w->lock);
+    int error = cpufreq_apply(&w->cpufreq, snap->online, &settings);
+    pthread_mutex_lock(&w->lock);
+
+    w->freq_error = error;
+}
+
+static void *worker_main(void *arg)
+{
+    CpuWorker *w = arg;
+    struct timespec next_tick;
+    const TelemetrySnapshot *snap = telemetry_refresh(w->telemetry);
+
+    deadline_after(&next_tick, w->interval_ms);
+
+    pthread_mutex_lock(&w->lock);
+    while (w->running)
+    {
+        bool refresh = false;
+
+        if (run_pending_hotplug(w))
+        {
+            if (w->on_hotplug)
+                w->on_hotplug(w->user_data);
+            refresh = true; // Show the new core states without waiting a full tick
+        }
+        else
+        {
+            // Only once no hotplug is outstanding, against a snapshot taken after it,
+            // so a profile's frequency settings reach the cores it just onlined
+            run_pending_cpufreq(w, snap);
+        }
+
+        if (deadline_passed(&next_tick))
+        {
+            deadline_after(&next_tick, w->interval_ms);
+            refresh = true;
+        }
+
+        if (refresh)
+        {
+            pthread_mutex_unlock(&w->lock);
+            snap = telemetry_refresh(w->telemetry);
+            if (w->on_snapshot)
+                w->on_snapshot(w->user_data);
+            pthread_mutex_lock(&w->lock);
+            continue;
+        }
+
+        if (w->pending_count == 0 && !w->freq_pending)
+            pthread_cond_timedwait(&w->wake, &w->lock, &next_tick);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return NULL;
+}
+
+int cpu_worker_start(CpuWorker *w, Telemetry *telemetry, unsigned int interval_ms,
+                     CpuWorkerNotify on_snapshot, CpuWorkerNotify on_hotplug, void *user_data)
+{
+    pthread_condattr_t attr;
+
+    memset(w, 0, sizeof(*w));
+    w->telemetry = telemetry;
+    w->num_cores = telemetry->buffers[0].num_cores;
+    w->interval_ms = interval_ms;
+    w->on_snapshot = on_snapshot;
+    w->on_hotplug = on_hotplug;
+    w->user_data = user_data;
+    w->running = true;
+    memset(w->pending, -1, sizeof(w->pending));
+    cpufreq_init(&w->cpufreq, w->num_cores);
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&w->wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&w->thread, NULL, worker_main, w) != 0)
+    {
+        pthread_cond_destroy(&w->wake);
+        pthread_mutex_destroy(&w->lock);
+        return -1;
+    }
+
+    return 0;
+}
+
+void cpu_worker_stop(CpuWorker *w)
+{
+    pthread_mutex_lock(&w->lock);
+    w->running = false;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_join(w->thread, NULL);
+    pthread_cond_destroy(&w->wake);
+    pthread_mutex_destroy(&w->lock);
+}
+
+void cpu_worker_request_hotplug(CpuWorker *w, int core_id, bool online)
+{
+    if (core_id <= 0 || core_id >= w->num_cores)
+        return;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->pending[core_id] < 0)
+        w->pending_count++;
+    w->pending[core_id] = online ? 1 : 0;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+}
+
+void cpu_worker_request_cpufreq(CpuWorker *w, const CpufreqSettings *settings)
+{
+    pthread_mutex_lock(&w->lock);
+    if (!w->freq_pending)
+    {
+        memset(&w->freq_request, 0, sizeof(w->freq_request));
+        w->freq_request.min_pct = -1;
+        w->freq_request.max_pct = -1;
+    }
+    cpufreq_settings_merge(&w->freq_request, settings);
+    w->freq_pending = true;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+}
+
+void cpu_worker_request_transaction(CpuWorker *w, const int *target)
+{
+    pthread_mutex_lock(&w->lock);
+    for (int i = 1; i < w->num_cores; i++)
+    {
+        if (target[i] < 0)
+            continue;
+        if (w->pending[i] < 0)
+            w->pending_count++;
+        w->pending[i] = target[i] == 1 ? 1 : 0;
+    }
+    w->pending_transaction = true;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+}
+
+int cpu_worker_take_results(CpuWorker *w, HotplugResult *out, int max)
+{
+    pthread_mutex_lock(&w->lock);
+
+    int n = w->result_count < max ? w->result_count : max;
+    memcpy(out, w->results, (size_t)n * sizeof(HotplugResult));
+    memmove(w->results, w->results + n, (size_t)(w->result_count - n) * sizeof(HotplugResult));
+    w->result_count -= n;
+
+    pthread_mutex_unlock(&w->lock);
+    return n;
+}
@@ -0,0 +1,62 @@
+#ifndef CPU_WORKER_H
+#define CPU_WORKER_H
+
+#include <stdbool.h>
+#include <pthread.h>
+#include "telemetry.h"
+#include "cpufreq.h"
+#include "hotplug.h"
+
+typedef void (*CpuWorkerNotify)(void *user_data);
+
+// Background thread that owns all /sys/devices/system/cpu I/O. It refreshes the
+// telemetry snapshot every interval and carries out queued hotplug requests, so
+// the caller's thread never blocks on the kernel. The notify callbacks run on
+// the worker thread and must only hand off (e.g. with g_idle_add).
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool running;
+    unsigned int interval_ms;
+    Telemetry *telemetry;
+    int num_cores;
+
+    // Pending requests, coalesced per core: -1 none, 0 offline, 1 online
+    int pending[MAX_CORES];
+    int pending_count;
+    bool pending_transaction; // Roll all pending requests back if one of them fails
+
+    HotplugResult results[MAX_CORES];
+    int result_count;
+
+    // Pending cpufreq change, merged field by field with any newer request
+    CpufreqInfo cpufreq;
+    CpufreqSettings freq_request;
+    bool freq_pending;
+    int freq_error; // Result of the last cpufreq write, 0 on success
+
+    CpuWorkerNotify on_snapshot;
+    CpuWorkerNotify on_hotplug;
+    void *user_data;
+} CpuWorker;
+
+int cpu_worker_start(CpuWorker *w, Telemetry *telemetry, unsigned int interval_ms,
+                     CpuWorkerNotify on_snapshot, CpuWorkerNotify on_hotplug, void *user_data);
+void cpu_worker_stop(CpuWorker *w);
+
+// Queue a core state change. A newer request for the same core replaces an older one.
+void cpu_worker_request_hotplug(CpuWorker *w, int core_id, bool online);
+
+// Queue a whole target mask (-1 leave, 0 offline, 1 online) as one batch that
+// is rolled back if any of its transitions fails
+void cpu_worker_request_transaction(CpuWorker *w, const int *target);
+
+// Queue a cpufreq change for every online core
+void cpu_worker_request_cpufreq(CpuWorker *w, const CpufreqSettings *settings);
+
+// Move finished hotplug results into out[]. Returns how many were copied.
+int cpu_worker_take_results(CpuWorker *w, HotplugResult *out, int max);
+
+#endif // CPU_WORKER_H
@@ -0,0 +1,218 @@
+#include "cpufreq.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define CPUFREQ_PATH "/sys/devices/system/cpu/cpu%d/cpufreq/%s"
+
+static bool read_attr(int core_id, const char *attr, char *buf, size_t size)
+{
+    char path[MAX_PATH];
+    cpu_path(path, MAX_PATH, CPUFREQ_PATH, core_id, attr);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n <= 0)
+        return false;
+
+    buf[n] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return true;
+}
+
+// Returns 0 or an errno value
+static int write_attr(int core_id, const char *attr, const char *value)
+{
+    char path[MAX_PATH];
+    cpu_path(path, MAX_PATH, CPUFREQ_PATH, core_id, attr);
+
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return errno;
+
+    int error = 0;
+    size_t len = strlen(value);
+    if (write(fd, value, len) != (ssize_t)len)
+        error = errno;
+    close(fd);
+
+    return error;
+}
+
+static void probe_core(CpufreqInfo *info, int core_id)
+{
+    char buf[256];
+
+    info->probed[core_id] = true;
+    info->present[core_id] = false;
+
+    if (!read_attr(core_id, "cpuinfo_min_freq", buf, sizeof(buf)))
+        return;
+    info->hw_min_khz[core_id] = atol(buf);
+
+    if (!read_attr(core_id, "cpuinfo_max_freq", buf, sizeof(buf)))
+        return;
+    info->hw_max_khz[core_id] = atol(buf);
+
+    info->policy[core_id] = core_id;
+    if (read_attr(core_id, "related_cpus", buf, sizeof(buf)))
+        info->policy[core_id] = atoi(buf); // Space-separated list; the first one names the policy
+
+    if (!read_attr(core_id, "scaling_available_governors", info->governors[core_id], sizeof(info->governors[core_id])))
+        info->governors[core_id][0] = '\0';
+
+    info->has_epp[core_id] = read_attr(core_id, "energy_performance_preference", buf, sizeof(buf));
+    info->present[core_id] = true;
+}
+
+void cpufreq_init(CpufreqInfo *info, int num_cores)
+{
+    memset(info, 0, sizeof(*info));
+    info->num_cores = num_cores > MAX_CORES ? MAX_CORES : num_cores;
+}
+
+// Pick the first governor from a preference list that the driver offers
+static const char *choose_governor(const char *available, const char *wanted, char *out, size_t size)
+{
+    char list[64];
+    snprintf(list, sizeof(list), "%s", wanted);
+
+    for (char *save = NULL, *name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save))
+    {
+        // Match whole words in the space-separated available list
+        size_t len = strlen(name);
+        for (const char *p = strstr(available, name); p; p = strstr(p + 1, name))
+        {
+            bool starts = p == available || p[-1] == ' ';
+            bool ends = p[len] == '\0' || p[len] == ' ';
+            if (starts && ends)
+            {
+                snprintf(out, size, "%s", name);
+                return out;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static long pct_to_khz(const CpufreqInfo *info, int core_id, int pct)
+{
+    long range = info->hw_max_khz[core_id] - info->hw_min_khz[core_id];
+    return info->hw_min_khz[core_id] + range * pct / 100;
+}
+
+static int apply_policy(const CpufreqInfo *info, int core_id, const CpufreqSettings *s)
+{
+    int last_error = 0;
+    int error;
+    char value[64];
+
+    if (s->governor[0] && choose_governor(info->governors[core_id], s->governor, value, sizeof(value)))
+    {
+        if ((error = write_attr(core_id, "scaling_governor", value)) != 0)
+            last_error = error;
+    }
+
+    if (s->min_pct >= 0 || s->max_pct >= 0)
+    {
+        long min_khz = s->min_pct >= 0 ? pct_to_khz(info, core_id, s->min_pct) : -1;
+        long max_khz = s->max_pct >= 0 ? pct_to_khz(info, core_id, s->max_pct) : -1;
+        char current[32];
+
+        // The kernel rejects min > max, so order the writes to never cross the limits
+        bool raise_max_first = max_khz >= 0 && read_attr(core_id, "scaling_max_freq", current, sizeof(current)) &&
+                               max_khz > atol(current);
+
+        if (raise_max_first)
+        {
+            snprintf(value, sizeof(value), "%ld", max_khz);
+            if ((error = write_attr(core_id, "scaling_max_freq", value)) != 0)
+                last_error = error;
+        }
+
+        if (min_khz >= 0)
+        {
+            if (max_khz >= 0 && min_khz > max_khz)
+                min_khz = max_khz;
+            snprintf(value, sizeof(value), "%ld", min_khz);
+            if ((error = write_attr(core_id, "scaling_min_freq", value)) != 0)
+                last_error = error;
+        }
+
+        if (max_khz >= 0 && !raise_max_first)
+        {
+            snprintf(value, sizeof(value), "%ld", max_khz);
+            if ((error = write_attr(core_id, "scaling_max_freq", value)) != 0)
+                last_error = error;
+        }
+    }
+
+    if (s->epp[0] && info->has_epp[core_id])
+    {
+        // intel_pstate pins EPP while the performance governor is active and refuses writes
+        error = write_attr(core_id, "energy_performance_preference", s->epp);
+        if (error && error != EBUSY)
+            last_error = error;
+    }
+
+    return last_error;
+}
+
+int cpufreq_apply(CpufreqInfo *info, const bool *online, const CpufreqSettings *settings)
+{
+    bool done[MAX_CORES] = {false};
+    int last_error = 0;
+
+    for (int i = 0; i < info->num_cores; i++)
+    {
+        if (!online[i])
+            continue;
+        if (!info->probed[i])
+            probe_core(info, i);
+        if (!info->present[i])
+            continue;
+
+        // Cores sharing a policy share its files; write each policy once
+        int policy = info->policy[i];
+        if (policy >= 0 && policy < info->num_cores)
+        {
+            if (done[policy])
+                continue;
+            done[policy] = true;
+        }
+
+        int error = apply_policy(info, i, settings);
+        if (error)
+            last_error = error;
+    }
+
+    return last_error;
+}
+
+void cpufreq_settings_max_pct(CpufreqSettings *settings, int max_pct)
+{
+    memset(settings, 0, sizeof(*settings));
+    settings->min_pct = -1;
+    settings->max_pct = max_pct;
+}
+
+void cpufreq_settings_merge(CpufreqSettings *dst, const CpufreqSettings *src)
+{
+    if (src->governor[0])
+        snprintf(dst->governor, sizeof(dst->governor), "%s", src->governor);
+    if (src->min_pct >= 0)
+        dst->min_pct = src->min_pct;
+    if (src->max_pct >= 0)
+        dst->max_pct = src->max_pct;
+    if (src->epp[0])
+        snprintf(dst->epp, sizeof(dst->epp), "%s", src->epp);
+}
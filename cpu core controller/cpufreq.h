@@ -0,0 +1,42 @@
+#ifndef CPUFREQ_H
+#define CPUFREQ_H
+
+#include <stdbool.h>
+#include "cpu-common.h"
+
+// Desired cpufreq policy settings. Fields left at their "unset" value are not touched.
+typedef struct
+{
+    char governor[64]; // Comma-separated preference list, first one the driver offers wins; "" = unset
+    int min_pct;       // scaling_min_freq as a percentage of the hardware range; -1 = unset
+    int max_pct;       // scaling_max_freq as a percentage of the hardware range; -1 = unset
+    char epp[32];      // energy_performance_preference; "" = unset
+} CpufreqSettings;
+
+// What each core's cpufreq policy supports. Policies only exist for online
+// cores, so cores are probed the first time they are seen online.
+typedef struct
+{
+    int num_cores;
+    bool probed[MAX_CORES];
+    bool present[MAX_CORES]; // Core has a cpufreq policy
+    int policy[MAX_CORES];   // Lowest CPU of the policy; settings are written once per policy
+    long hw_min_khz[MAX_CORES];
+    long hw_max_khz[MAX_CORES];
+    bool has_epp[MAX_CORES];
+    char governors[MAX_CORES][128]; // scaling_available_governors
+} CpufreqInfo;
+
+void cpufreq_init(CpufreqInfo *info, int num_cores);
+
+// Write the settings to every online core's policy. Returns 0 if everything
+// requested was applied, otherwise the last errno seen.
+int cpufreq_apply(CpufreqInfo *info, const bool *online, const CpufreqSettings *settings);
+
+// Settings that only cap the maximum frequency
+void cpufreq_settings_max_pct(CpufreqSettings *settings, int max_pct);
+
+// Overlay the fields that are set in src onto dst
+void cpufreq_settings_merge(CpufreqSettings *dst, const CpufreqSettings *src);
+
+#endif // CPUFREQ_H
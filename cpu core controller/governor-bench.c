@@ -0,0 +1,468 @@
+// Benchmark of the per-tick hot path: telemetry refresh (/proc/stat, online
+// state, frequency, temperature), topology learning, the governor decision,
+// applying its hotplug recommendations and appending to the chart history.
+// It runs against a fake /sys and /proc tree in a temporary directory with
+// 1 to 1024 synthetic cores, so it needs neither root nor a big machine:
+//
+//   cpu-hotplug-bench [--cores 1,8,64,1024] [--ticks N]
+//
+// For each core count it prints per-tick latency percentiles and how many
+// file syscalls and forks one tick made. The syscall counts come from the
+// linker wrapping (-Wl,--wrap) the libc entry points the project code calls.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include "cpu-common.h"
+#include "telemetry.h"
+#include "topology.h"
+#include "governor.h"
+#include "hotplug.h"
+#include "history.h"
+
+#define DEFAULT_TICKS 1000
+#define WARMUP_TICKS 20
+#define CORES_PER_PACKAGE 32 // 16 physical cores with two threads each
+#define HISTORY_SAMPLES 3600
+
+typedef struct
+{
+    unsigned long open;
+    unsigned long read;
+    unsigned long pread;
+    unsigned long write;
+    unsigned long close;
+    unsigned long access;
+    unsigned long opendir;
+    unsigned long fork; // fork, popen and system
+} SyscallCounts;
+
+static SyscallCounts counts;
+static bool counting;
+
+// Linker-wrapped libc entry points: count while a tick is being timed, then forward
+int __real_open(const char *path, int flags, ...);
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __real_pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+int __real_close(int fd);
+int __real_access(const char *path, int mode);
+DIR *__real_opendir(const char *path);
+pid_t __real_fork(void);
+FILE *__real_popen(const char *command, const char *type);
+int __real_system(const char *command);
+
+int __wrap_open(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    if (flags & O_CREAT)
+    {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, mode_t);
+        va_end(ap);
+    }
+    counts.open += counting;
+    return __real_open(path, flags, mode);
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t count)
+{
+    counts.read += counting;
+    return __real_read(fd, buf, count);
+}
+
+ssize_t __wrap_pread(int fd, void *buf, size_t count, off_t offset)
+{
+    counts.pread += counting;
+    return __real_pread(fd, buf, count, offset);
+}
+
+ssize_t __wrap_write(int fd, const void *buf, size_t count)
+{
+    counts.write += counting;
+    return __real_write(fd, buf, count);
+}
+
+int __wrap_close(int fd)
+{
+    counts.close += counting;
+    return __real_close(fd);
+}
+
+int __wrap_access(const char *path, int mode)
+{
+    counts.access += counting;
+    return __real_access(path, mode);
+}
+
+DIR *__wrap_opendir(const char *path)
+{
+    counts.opendir += counting;
+    return __real_opendir(path);
+}
+
+pid_t __wrap_fork(void)
+{
+    counts.fork += counting;
+    return __real_fork();
+}
+
+FILE *__wrap_popen(const char *command, const char *type)
+{
+    counts.fork += counting;
+    return __real_popen(command, type);
+}
+
+int __wrap_system(const char *command)
+{
+    counts.fork += counting;
+    return __real_system(command);
+}
+
+// Synthetic machine: per-core jiffy counters that /proc/stat is regenerated from
+typedef struct
+{
+    char root[MAX_PATH];
+    int num_cores;
+    int stat_fd;
+    unsigned long long user[MAX_CORES];
+    unsigned long long system[MAX_CORES];
+    unsigned long long idle[MAX_CORES];
+    unsigned int seed;
+} FakeTree;
+
+static void write_file(const char *root, const char *content, const char *fmt, ...)
+{
+    char path[MAX_PATH * 2];
+    size_t len = (size_t)snprintf(path, sizeof(path), "%s", root);
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(path + len, sizeof(path) - len, fmt, ap);
+    va_end(ap);
+
+    // Create every parent directory on the way
+    for (char *p = path + strlen(root) + 1; (p = strchr(p, '/')) != NULL; p++)
+    {
+        *p = '\0';
+        mkdir(path, 0755);
+        *p = '/';
+    }
+
+    int fd = __real_open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || __real_write(fd, content, strlen(content)) != (ssize_t)strlen(content))
+    {
+        perror(path);
+        exit(1);
+    }
+    __real_close(fd);
+}
+
+static bool fake_online(const FakeTree *t, int core_id)
+{
+    char path[MAX_PATH * 2];
+    char c = '1';
+
+    if (core_id == 0)
+        return true;
+
+    snprintf(path, sizeof(path), "%s/sys/devices/system/cpu/cpu%d/online", t->root, core_id);
+    int fd = __real_open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        __real_read(fd, &c, 1);
+        __real_close(fd);
+    }
+    return c == '1';
+}
+
+// Advance the counters by one interval and rewrite /proc/stat in place, so the
+// sampler's persistent fd sees the new content like it would on a live system
+static void fake_advance(FakeTree *t, long tick)
+{
+    static char buf[MAX_CORES * 96 + 4096];
+    size_t len = 0;
+    unsigned long long total_user = 0, total_system = 0, total_idle = 0;
+    int running = 0;
+
+    // Demand sweeps between 10% and 90% of the machine so the governor has work to do
+    double demand = 0.5 + 0.4 * sin((double)tick / 50.0);
+
+    for (int i = 0; i < t->num_cores; i++)
+    {
+        unsigned int busy = (unsigned int)(demand * 100.0) + rand_r(&t->seed) % 20;
+        if (busy > 100)
+            busy = 100;
+        t->user[i] += busy * 3 / 4;
+        t->system[i] += busy / 4;
+        t->idle[i] += 100 - busy;
+        total_user += t->user[i];
+        total_system += t->system[i];
+        total_idle += t->idle[i];
+        running += busy > 50;
+    }
+
+    len += (size_t)snprintf(buf + len, sizeof(buf) - len, "cpu  %llu 0 %llu %llu 0 0 0 0 0 0\n",
+                            total_user, total_system, total_idle);
+    for (int i = 0; i < t->num_cores; i++)
+    {
+        if (!fake_online(t, i))
+            continue; // Offline cores vanish from /proc/stat
+        len += (size_t)snprintf(buf + len, sizeof(buf) - len, "cpu%d %llu 0 %llu %llu 0 0 0 0 0 0\n",
+                                i, t->user[i], t->system[i], t->idle[i]);
+    }
+    len += (size_t)snprintf(buf + len, sizeof(buf) - len,
+                            "intr 0\nctxt %ld\nbtime 0\nprocesses %ld\nprocs_running %d\nprocs_blocked 0\n",
+                            tick * 1000, tick, running + 1);
+
+    if (ftruncate(t->stat_fd, 0) != 0 || pwrite(t->stat_fd, buf, len, 0) != (ssize_t)len)
+    {
+        perror("Failed to update fake /proc/stat");
+        exit(1);
+    }
+}
+
+static void fake_create(FakeTree *t, int num_cores)
+{
+    char buf[64];
+
+    memset(t, 0, sizeof(*t));
+    t->num_cores = num_cores;
+    t->seed = 1;
+
+    snprintf(t->root, sizeof(t->root), "%s/cpu-hotplug-bench.XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(t->root))
+    {
+        perror("mkdtemp");
+        exit(1);
+    }
+
+    snprintf(buf, sizeof(buf), "0-%d\n", num_cores - 1);
+    write_file(t->root, buf, "/sys/devices/system/cpu/present");
+    write_file(t->root, buf, "/sys/devices/system/node/node0/cpulist");
+    write_file(t->root, "coretemp\n", "/sys/class/hwmon/hwmon0/name");
+    write_file(t->root, "Package id 0\n", "/sys/class/hwmon/hwmon0/temp1_label");
+    write_file(t->root, "55000\n", "/sys/class/hwmon/hwmon0/temp1_input");
+
+    for (int i = 0; i < num_cores; i++)
+    {
+        int package = i / CORES_PER_PACKAGE;
+        int core = (i % CORES_PER_PACKAGE) / 2;
+
+        if (i > 0)
+            write_file(t->root, "1\n", "/sys/devices/system/cpu/cpu%d/online", i);
+
+        snprintf(buf, sizeof(buf), "%d\n", package);
+        write_file(t->root, buf, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", i);
+        snprintf(buf, sizeof(buf), "%d\n", core);
+        write_file(t->root, buf, "/sys/devices/system/cpu/cpu%d/topology/core_id", i);
+        write_file(t->root, "3\n", "/sys/devices/system/cpu/cpu%d/cache/index3/level", i);
+        snprintf(buf, sizeof(buf), "%d-%d\n", package * CORES_PER_PACKAGE, package * CORES_PER_PACKAGE + CORES_PER_PACKAGE - 1);
+        write_file(t->root, buf, "/sys/devices/system/cpu/cpu%d/cache/index3/shared_cpu_list", i);
+        snprintf(buf, sizeof(buf), "%d\n", 2000000 + (i % 8) * 100000);
+        write_file(t->root, buf, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", i);
+
+        // Core sensors live in their package's coretemp instance
+        if (package == 0 && i % 2 == 0)
+        {
+            snprintf(buf, sizeof(buf), "Core %d\n", core);
+            write_file(t->root, buf, "/sys/class/hwmon/hwmon0/temp%d_label", core + 2);
+            write_file(t->root, "60000\n", "/sys/class/hwmon/hwmon0/temp%d_input", core + 2);
+        }
+    }
+
+    write_file(t->root, "some avg10=0.00 avg60=0.00 avg300=0.00 total=0\n"
+                        "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n", "/proc/pressure/cpu");
+    write_file(t->root, "", "/proc/stat");
+    char path[MAX_PATH * 2];
+    snprintf(path, sizeof(path), "%s/proc/stat", t->root);
+    t->stat_fd = __real_open(path, O_WRONLY | O_CLOEXEC);
+    fake_advance(t, 0);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+static void fake_destroy(FakeTree *t)
+{
+    __real_close(t->stat_fd);
+    nftw(t->root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double *sorted, int n, double p)
+{
+    int index = (int)ceil(p / 100.0 * n) - 1;
+    return sorted[index < 0 ? 0 : index];
+}
+
+static void run(int num_cores, int ticks, GovernorPolicy policy)
+{
+    FakeTree *tree = malloc(sizeof(FakeTree));
+    Telemetry *telemetry = malloc(sizeof(Telemetry));
+    Governor *governor = malloc(sizeof(Governor));
+    CpuTopology *topology = malloc(sizeof(CpuTopology));
+    HotplugBatch *batch = malloc(sizeof(HotplugBatch));
+    History history;
+    double *latency = malloc((size_t)ticks * sizeof(double));
+    int hotplugs = 0;
+
+    if (!tree || !telemetry || !governor || !topology || !batch || !latency)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    fake_create(tree, num_cores);
+    cpu_set_path_root(tree->root);
+
+    if (telemetry_init(telemetry, num_cores) < 0 || history_init(&history, num_cores, HISTORY_SAMPLES) < 0)
+    {
+        fprintf(stderr, "Failed to set up %d cores\n", num_cores);
+        exit(1);
+    }
+    governor_init(governor, num_cores, NULL);
+    governor->cfg.policy = policy;
+    topology_load(topology, num_cores);
+    governor_set_order(governor, topology->order);
+
+    memset(&counts, 0, sizeof(counts));
+    for (long tick = 1; tick <= WARMUP_TICKS + ticks; tick++)
+    {
+        fake_advance(tree, tick);
+
+        bool measured = tick > WARMUP_TICKS;
+        counting = measured;
+        double start = now_us();
+
+        const TelemetrySnapshot *snap = telemetry_refresh(telemetry);
+        snap = telemetry_current(telemetry);
+        if (topology_learn(topology, snap->online))
+            governor_set_order(governor, topology->order);
+        if (governor_update(governor, snap) > 0)
+        {
+            hotplug_apply_mask(snap->online, governor->recommend, num_cores, HOTPLUG_DEFAULT_THREADS, false, batch);
+            hotplugs += measured ? batch->count : 0;
+        }
+        history_append(&history, snap);
+
+        double elapsed = now_us() - start;
+        counting = false;
+        if (measured)
+            latency[tick - WARMUP_TICKS - 1] = elapsed;
+    }
+
+    qsort(latency, (size_t)ticks, sizeof(double), compare_double);
+    printf("%5d %9.1f %9.1f %9.1f %9.1f %7.1f %7.1f %7.1f %7.1f %7.1f %7.1f %6lu %9.2f\n",
+           num_cores,
+           percentile(latency, ticks, 50), percentile(latency, ticks, 90),
+           percentile(latency, ticks, 99), latency[ticks - 1],
+           (double)counts.open / ticks, (double)counts.read / ticks, (double)counts.pread / ticks,
+           (double)counts.write / ticks, (double)counts.close / ticks,
+           (double)(counts.access + counts.opendir) / ticks, counts.fork,
+           (double)hotplugs / ticks);
+    fflush(stdout);
+
+    history_free(&history);
+    telemetry_free(telemetry);
+    cpu_set_path_root(NULL);
+    fake_destroy(tree);
+    free(latency);
+    free(batch);
+    free(topology);
+    free(governor);
+    free(telemetry);
+    free(tree);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [--cores LIST] [--ticks N] [--policy NAME]\n"
+            "  --cores LIST  comma-separated core counts, 1..%d (default 1,2,4,...,%d)\n"
+            "  --ticks N     measured ticks per core count (default %d)\n"
+            "  --policy NAME auto-governor policy: load (default) or pressure\n",
+            prog, MAX_CORES, MAX_CORES, DEFAULT_TICKS);
+}
+
+int main(int argc, char *argv[])
+{
+    int core_counts[32];
+    int num_counts = 0;
+    int ticks = DEFAULT_TICKS;
+    int policy = GOVERNOR_POLICY_LOAD;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--cores") == 0 && i + 1 < argc)
+        {
+            for (char *p = argv[++i]; *p && num_counts < 32;)
+            {
+                char *end;
+                long n = strtol(p, &end, 10);
+                if (end == p || n < 1 || n > MAX_CORES)
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                core_counts[num_counts++] = (int)n;
+                p = *end == ',' ? end + 1 : end;
+            }
+        }
+        else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc)
+            ticks = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc &&
+                 (policy = governor_policy_from_name(argv[i + 1])) >= 0)
+            i++;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (ticks < 1)
+        ticks = DEFAULT_TICKS;
+    if (num_counts == 0)
+    {
+        for (int n = 1; n <= MAX_CORES; n *= 2)
+            core_counts[num_counts++] = n;
+    }
+
+    printf("# per-tick latency in microseconds; syscalls and hotplugged cores per tick; forks in total\n");
+    printf("%5s %9s %9s %9s %9s %7s %7s %7s %7s %7s %7s %6s %9s\n",
+           "cores", "p50", "p90", "p99", "max", "open", "read", "pread", "write", "close", "other", "forks", "hotplugs");
+
+    for (int i = 0; i < num_counts; i++)
+        run(core_counts[i], ticks, (GovernorPolicy)policy);
+
+    return 0;
+}
@@ -0,0 +1,628 @@
+// Headless CPU hotplug governor.
+//
+// Runs the same telemetry, auto-governor and power profile logic as the GTK
+// front end without linking GTK. Sampling is driven by a timerfd in a single
+// epoll loop, and the daemon is controlled with line-based commands over a
+// Unix domain socket:
+//
+//   status                 summary lines followed by one line per core
+//   auto on|off            enable or disable the auto-governor
+//   policy load|pressure   choose how the auto-governor sizes the core count
+//   profile <name>         apply "Power Saver", "Balanced" or "Performance"
+//   online <cpu> <0|1>     set one core's state
+//
+// Every reply ends with a line starting with "ok" or "error".
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "cpu-common.h"
+#include "telemetry.h"
+#include "governor.h"
+#include "power-profile.h"
+#include "hotplug.h"
+#include "topology.h"
+#include "cpufreq.h"
+#include "cpu-profile.h"
+
+#define DEFAULT_SOCKET_PATH "/run/cpu-hotplug-governor.sock"
+#define DEFAULT_INTERVAL_MS 1000
+#define MAX_CLIENTS 16
+#define CLIENT_BUF_SIZE 512
+#define MAX_EVENTS 16
+
+typedef struct
+{
+    int fd;
+    size_t len;
+    char buf[CLIENT_BUF_SIZE];
+} Client;
+
+typedef struct
+{
+    int num_cores;
+    Telemetry telemetry;
+    Governor governor;
+    CpuTopology topology;
+    CpufreqInfo cpufreq;
+    int applied_freq_cap; // Frequency cap last written (% of hardware range)
+    bool auto_mode;
+    int profile; // Last applied power profile, -1 if none
+    HotplugBatch last_batch; // Most recent multi-core hotplug, for status
+
+    int epoll_fd;
+    int timer_fd;
+    int signal_fd;
+    int listen_fd;
+    const char *socket_path;
+    Client clients[MAX_CLIENTS];
+    bool running;
+} Daemon;
+
+static Daemon daemon_state;
+
+// Write the whole reply, dropping the client if its socket is backed up
+static void client_send(Client *c, const char *text)
+{
+    size_t len = strlen(text);
+    if (send(c->fd, text, len, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)len)
+    {
+        shutdown(c->fd, SHUT_RDWR);
+    }
+}
+
+static void client_printf(Client *c, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void client_printf(Client *c, const char *fmt, ...)
+{
+    char line[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    client_send(c, line);
+}
+
+// Set one core's state synchronously; there is no UI here to keep responsive
+static int set_core_state(int core_id, bool online)
+{
+    int error = hotplug_set_online(core_id, online);
+    if (error)
+        fprintf(stderr, "Failed to turn CPU%d %s: %s\n", core_id, online ? "online" : "offline", strerror(error));
+    return error;
+}
+
+// Move to a target online mask in one batch, logging failures and per-batch timing
+static int apply_core_mask(Daemon *d, const bool *current, const bool *target, bool rollback)
+{
+    HotplugBatch *batch = &d->last_batch;
+    int error = hotplug_apply_mask(current, target, d->num_cores, HOTPLUG_DEFAULT_THREADS, rollback, batch);
+
+    for (int i = 0; i < batch->count; i++)
+    {
+        const HotplugResult *r = &batch->results[i];
+        if (r->error && r->error != ECANCELED)
+            fprintf(stderr, "Failed to turn CPU%d %s: %s\n", r->core_id, r->online ? "online" : "offline",
+                    strerror(r->error));
+    }
+    if (error && rollback)
+        fprintf(stderr, "Hotplug batch %s\n", batch->rolled_back ? "rolled back" : "could not be fully rolled back");
+
+    return error;
+}
+
+// Write cpufreq settings to every online core, logging failures
+static int apply_cpufreq(Daemon *d, const CpufreqSettings *settings)
+{
+    const TelemetrySnapshot *snap = telemetry_current(&d->telemetry);
+    int error = cpufreq_apply(&d->cpufreq, snap->online, settings);
+    if (error)
+        fprintf(stderr, "Failed to apply cpufreq settings: %s\n", strerror(error));
+    return error;
+}
+
+// Apply automatic core recommendations
+static void apply_recommendations(Daemon *d, const TelemetrySnapshot *snap)
+{
+    // A partial step is still a step in the right direction, so no rollback here
+    if (governor_update(&d->governor, snap) > 0)
+        apply_core_mask(d, snap->online, d->governor.recommend, false);
+
+    if (d->governor.freq_cap_pct != d->applied_freq_cap)
+    {
+        CpufreqSettings settings;
+        cpufreq_settings_max_pct(&settings, d->governor.freq_cap_pct);
+        apply_cpufreq(d, &settings);
+        d->applied_freq_cap = d->governor.freq_cap_pct;
+    }
+}
+
+// Apply a power profile; returns the number of cores that failed to switch
+static int change_power_profile(Daemon *d, PowerProfile profile)
+{
+    const TelemetrySnapshot *snap = telemetry_current(&d->telemetry);
+    int target[MAX_CORES];
+    bool mask[MAX_CORES];
+    int failures = 0;
+    CpufreqSettings settings;
+
+    power_profile_target(profile, d->num_cores, d->topology.order, target);
+    for (int i = 0; i < d->num_cores; i++)
+        mask[i] = target[i] < 0 ? snap->online[i] : target[i] == 1;
+
+    // All or nothing, so a failure cannot leave the machine between two profiles
+    apply_core_mask(d, snap->online, mask, true);
+    failures += d->last_batch.failed;
+
+    // Re-read online state so the cores just brought up get the frequency settings too
+    telemetry_refresh(&d->telemetry);
+    power_profile_cpufreq(profile, &settings);
+    failures += apply_cpufreq(d, &settings) != 0;
+    governor_set_freq_cap(&d->governor, settings.max_pct);
+    d->applied_freq_cap = settings.max_pct;
+
+    d->profile = profile;
+    return failures;
+}
+
+// Apply a saved profile: online mask, cpufreq settings, governor thresholds and auto mode
+static int load_profile_file(Daemon *d, const char *path)
+{
+    CpuProfile profile;
+    int error = cpu_profile_load(path, &profile);
+    if (error)
+    {
+        fprintf(stderr, "Failed to load %s: %s\n", path, error == EINVAL ? "not a valid profile" : strerror(error));
+        return -1;
+    }
+
+    if (cpu_profile_check(&profile, d->num_cores))
+    {
+        fprintf(stderr, "%s was saved for a different CPU layout; apply it with cpu-profile-apply --force\n", path);
+        return -1;
+    }
+
+    const TelemetrySnapshot *snap = telemetry_current(&d->telemetry);
+    bool mask[MAX_CORES];
+    for (int i = 0; i < d->num_cores; i++)
+        mask[i] = profile.online[i];
+    if (apply_core_mask(d, snap->online, mask, true) != 0)
+        return -1;
+
+    if (profile.has_cpufreq)
+    {
+        telemetry_refresh(&d->telemetry);
+        apply_cpufreq(d, &profile.cpufreq);
+        if (profile.cpufreq.max_pct >= 0)
+        {
+            governor_set_freq_cap(&d->governor, profile.cpufreq.max_pct);
+            d->applied_freq_cap = profile.cpufreq.max_pct;
+        }
+    }
+
+    if (profile.has_governor)
+    {
+        d->governor.cfg = profile.governor;
+        d->auto_mode = profile.auto_mode;
+    }
+
+    return 0;
+}
+
+static void handle_tick(Daemon *d)
+{
+    uint64_t expirations;
+    if (read(d->timer_fd, &expirations, sizeof(expirations)) < 0)
+        return;
+
+    // The daemon is both producer and consumer, so publish and read back at once
+    telemetry_refresh(&d->telemetry);
+    const TelemetrySnapshot *snap = telemetry_current(&d->telemetry);
+
+    // Cores only expose their topology while online; pick it up as they appear
+    if (topology_learn(&d->topology, snap->online))
+        governor_set_order(&d->governor, d->topology.order);
+
+    if (d->auto_mode)
+        apply_recommendations(d, snap);
+}
+
+static void send_status(Daemon *d, Client *c)
+{
+    const TelemetrySnapshot *snap = telemetry_current(&d->telemetry);
+
+    governor_update(&d->governor, snap);
+    client_printf(c, "cores %d online %d target %d load %.1f max_temp %.1f freq_cap %d%% auto %s profile %s\n",
+                  d->num_cores, d->governor.online_count, d->governor.target_online,
+                  d->governor.average_load, d->governor.max_temp, d->governor.freq_cap_pct, d->auto_mode ? "on" : "off",
+                  d->profile >= 0 ? power_profile_name(d->profile) : "none");
+    client_printf(c, "policy %s pressure %.1f setpoint %.1f runnable %.1f steal %.1f iowait %.1f\n",
+                  governor_policy_name(d->governor.cfg.policy), d->governor.pressure,
+                  d->governor.cfg.pressure_setpoint, d->governor.runnable, snap->total.steal, snap->total.iowait);
+    client_printf(c, "last_batch changes %d failed %d rolled_back %s time %.1fms\n",
+                  d->last_batch.count, d->last_batch.failed, d->last_batch.rolled_back ? "yes" : "no",
+                  d->last_batch.total_ms);
+
+    for (int i = 0; i < d->num_cores; i++)
+    {
+        client_printf(c, "cpu%d %s load %.1f freq %.0f temp %.1f recommend %s\n",
+                      i, snap->online[i] ? "online" : "offline",
+                      snap->load[i], snap->freq[i], snap->temp[i],
+                      d->governor.recommend[i] ? "online" : "offline");
+    }
+
+    client_send(c, "ok\n");
+}
+
+static void handle_command(Daemon *d, Client *c, char *line)
+{
+    char *cmd = strtok(line, " \t\r");
+    char *arg = strtok(NULL, "\r");
+
+    if (!cmd)
+        return;
+
+    if (strcmp(cmd, "status") == 0)
+    {
+        send_status(d, c);
+    }
+    else if (strcmp(cmd, "auto") == 0 && arg && (strcmp(arg, "on") == 0 || strcmp(arg, "off") == 0))
+    {
+        d->auto_mode = strcmp(arg, "on") == 0;
+        client_printf(c, "ok auto %s\n", d->auto_mode ? "on" : "off");
+    }
+    else if (strcmp(cmd, "policy") == 0 && arg)
+    {
+        int policy = governor_policy_from_name(arg);
+        if (policy < 0)
+        {
+            client_printf(c, "error unknown policy '%s'\n", arg);
+            return;
+        }
+
+        d->governor.cfg.policy = policy;
+        d->governor.pi_integral = 0.0;
+        client_printf(c, "ok policy %s\n", governor_policy_name(policy));
+    }
+    else if (strcmp(cmd, "profile") == 0 && arg)
+    {
+        int profile = power_profile_from_name(arg);
+        if (profile < 0)
+        {
+            client_printf(c, "error unknown profile '%s'\n", arg);
+            return;
+        }
+
+        int failures = change_power_profile(d, profile);
+        if (failures)
+            client_printf(c, "error %d cores failed to switch\n", failures);
+        else
+            client_printf(c, "ok applied %s\n", power_profile_name(profile));
+    }
+    else if (strcmp(cmd, "online") == 0 && arg)
+    {
+        int core_id, state;
+        if (sscanf(arg, "%d %d", &core_id, &state) != 2 || core_id <= 0 || core_id >= d->num_cores)
+        {
+            client_send(c, "error usage: online <cpu 1..n-1> <0|1>\n");
+            return;
+        }
+
+        int error = set_core_state(core_id, state != 0);
+        if (error)
+            client_printf(c, "error %s\n", strerror(error));
+        else
+            client_printf(c, "ok cpu%d %s\n", core_id, state ? "online" : "offline");
+    }
+    else
+    {
+        client_send(c, "error unknown command\n");
+    }
+}
+
+static void close_client(Daemon *d, Client *c)
+{
+    epoll_ctl(d->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    c->len = 0;
+}
+
+static void handle_client(Daemon *d, Client *c)
+{
+    ssize_t n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - 1 - c->len, 0);
+    if (n <= 0)
+    {
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            return;
+        close_client(d, c);
+        return;
+    }
+
+    c->len += (size_t)n;
+    c->buf[c->len] = '\0';
+
+    // Run every complete line; keep a trailing partial one for the next read
+    char *start = c->buf;
+    char *newline;
+    while ((newline = strchr(start, '\n')) != NULL)
+    {
+        *newline = '\0';
+        handle_command(d, c, start);
+        start = newline + 1;
+    }
+
+    c->len -= (size_t)(start - c->buf);
+    memmove(c->buf, start, c->len);
+
+    if (c->len == sizeof(c->buf) - 1)
+    {
+        client_send(c, "error line too long\n");
+        close_client(d, c);
+    }
+}
+
+static void accept_clients(Daemon *d)
+{
+    for (;;)
+    {
+        int fd = accept4(d->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        Client *slot = NULL;
+        for (int i = 0; i < MAX_CLIENTS; i++)
+        {
+            if (d->clients[i].fd < 0)
+            {
+                slot = &d->clients[i];
+                break;
+            }
+        }
+
+        if (!slot)
+        {
+            send(fd, "error too many clients\n", 23, MSG_NOSIGNAL);
+            close(fd);
+            continue;
+        }
+
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = slot};
+        slot->fd = fd;
+        slot->len = 0;
+        epoll_ctl(d->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static int open_control_socket(const char *path)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    // Hotplug needs root, so only root may drive it through the socket
+    mode_t old_mask = umask(077);
+    int ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+
+    if (ret < 0 || listen(fd, MAX_CLIENTS) < 0)
+    {
+        perror("Failed to bind control socket");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int epoll_add(int epoll_fd, int fd, void *tag)
+{
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = tag};
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static int setup(Daemon *d, unsigned int interval_ms)
+{
+    sigset_t mask;
+
+    d->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    d->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    d->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    d->listen_fd = open_control_socket(d->socket_path);
+
+    if (d->epoll_fd < 0 || d->timer_fd < 0 || d->signal_fd < 0 || d->listen_fd < 0)
+        return -1;
+
+    struct itimerspec its = {
+        .it_interval = {.tv_sec = interval_ms / 1000, .tv_nsec = (long)(interval_ms % 1000) * 1000000L},
+        .it_value = {.tv_sec = interval_ms / 1000, .tv_nsec = (long)(interval_ms % 1000) * 1000000L},
+    };
+    timerfd_settime(d->timer_fd, 0, &its, NULL);
+
+    // Tags identify the fixed fds; anything else is a Client pointer
+    epoll_add(d->epoll_fd, d->timer_fd, &d->timer_fd);
+    epoll_add(d->epoll_fd, d->signal_fd, &d->signal_fd);
+    epoll_add(d->epoll_fd, d->listen_fd, &d->listen_fd);
+
+    return 0;
+}
+
+static void run(Daemon *d)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    d->running = true;
+    while (d->running)
+    {
+        int n = epoll_wait(d->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            void *tag = events[i].data.ptr;
+
+            if (tag == &d->timer_fd)
+                handle_tick(d);
+            else if (tag == &d->signal_fd)
+                d->running = false;
+            else if (tag == &d->listen_fd)
+                accept_clients(d);
+            else
+                handle_client(d, tag);
+        }
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [--headless] [--socket PATH] [--interval MS] [--profile NAME] [--load FILE] [--policy NAME] [--manual]\n"
+            "  --socket PATH   control socket (default %s)\n"
+            "  --interval MS   sampling interval (default %d)\n"
+            "  --profile NAME  apply a power profile at startup\n"
+            "  --load FILE     apply a saved profile file at startup\n"
+            "  --policy NAME   auto-governor policy: load (default) or pressure\n"
+            "  --manual        start with the auto-governor off\n",
+            prog, DEFAULT_SOCKET_PATH, DEFAULT_INTERVAL_MS);
+}
+
+int main(int argc, char *argv[])
+{
+    Daemon *d = &daemon_state;
+    unsigned int interval_ms = DEFAULT_INTERVAL_MS;
+    const char *startup_profile = NULL;
+    const char *profile_file = NULL;
+    int policy = GOVERNOR_POLICY_LOAD;
+
+    d->socket_path = DEFAULT_SOCKET_PATH;
+    d->auto_mode = true;
+    d->profile = -1;
+    for (int i = 0; i < MAX_CLIENTS; i++)
+        d->clients[i].fd = -1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--headless") == 0)
+            continue; // Accepted so the GUI binary can forward its arguments unchanged
+        else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+            d->socket_path = argv[++i];
+        else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+            interval_ms = (unsigned int)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            startup_profile = argv[++i];
+        else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc)
+            profile_file = argv[++i];
+        else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc)
+        {
+            policy = governor_policy_from_name(argv[++i]);
+            if (policy < 0)
+            {
+                fprintf(stderr, "Unknown policy '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--manual") == 0)
+            d->auto_mode = false;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (interval_ms == 0)
+        interval_ms = DEFAULT_INTERVAL_MS;
+
+    d->num_cores = telemetry_count_cores();
+    if (telemetry_init(&d->telemetry, d->num_cores) < 0)
+    {
+        fprintf(stderr, "Failed to allocate telemetry buffers\n");
+        return 1;
+    }
+    telemetry_refresh(&d->telemetry);
+    governor_init(&d->governor, d->num_cores, NULL);
+    d->governor.cfg.policy = policy;
+    topology_load(&d->topology, d->num_cores);
+    governor_set_order(&d->governor, d->topology.order);
+    cpufreq_init(&d->cpufreq, d->num_cores);
+    d->applied_freq_cap = d->governor.freq_cap_pct;
+
+    if (startup_profile)
+    {
+        int profile = power_profile_from_name(startup_profile);
+        if (profile < 0)
+        {
+            fprintf(stderr, "Unknown profile '%s'\n", startup_profile);
+            return 1;
+        }
+        change_power_profile(d, profile);
+    }
+
+    if (profile_file && load_profile_file(d, profile_file) < 0)
+        return 1;
+
+    if (setup(d, interval_ms) < 0)
+        return 1;
+
+    printf("CPU hotplug governor running headless on %s (%d cores, auto %s)\n",
+           d->socket_path, d->num_cores, d->auto_mode ? "on" : "off");
+    fflush(stdout);
+
+    run(d);
+
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (d->clients[i].fd >= 0)
+            close(d->clients[i].fd);
+    }
+    close(d->listen_fd);
+    unlink(d->socket_path);
+    close(d->signal_fd);
+    close(d->timer_fd);
+    close(d->epoll_fd);
+    telemetry_free(&d->telemetry);
+
+    return 0;
+}
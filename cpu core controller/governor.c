@@ -0,0 +1,288 @@
+#include "governor.h"
+
+#include <math.h>
+#include <string.h>
+
+// Tasks blocked on I/O as a share of the interval above which cores are not parked
+#define IOWAIT_HOLD_PCT 10.0
+
+static const char *policy_names[GOVERNOR_POLICY_COUNT] = {"load", "pressure"};
+
+void governor_default_config(GovernorConfig *cfg)
+{
+    cfg->policy = GOVERNOR_POLICY_LOAD;
+    cfg->low_threshold = 30.0;
+    cfg->high_threshold = 70.0;
+    cfg->target_load = 50.0;
+    cfg->ewma_alpha = 0.3;
+    cfg->min_dwell_ticks = 5;
+    cfg->min_cores = 1;
+    cfg->freq_step_pct = 10;
+    cfg->min_freq_pct = 40;
+    cfg->prefer_frequency = false;
+    cfg->thermal_limit = 90.0;
+    cfg->pressure_setpoint = 5.0;
+    cfg->pi_kp = 0.1;
+    cfg->pi_ki = 0.02;
+}
+
+const char *governor_policy_name(GovernorPolicy policy)
+{
+    return policy >= 0 && policy < GOVERNOR_POLICY_COUNT ? policy_names[policy] : "unknown";
+}
+
+int governor_policy_from_name(const char *name)
+{
+    for (int i = 0; i < GOVERNOR_POLICY_COUNT; i++)
+    {
+        if (strcmp(name, policy_names[i]) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+void governor_init(Governor *g, int num_cores, const GovernorConfig *cfg)
+{
+    memset(g, 0, sizeof(*g));
+    g->num_cores = num_cores > MAX_CORES ? MAX_CORES : num_cores;
+    if (cfg)
+        g->cfg = *cfg;
+    else
+        governor_default_config(&g->cfg);
+
+    for (int i = 0; i < g->num_cores; i++)
+        g->order[i] = i;
+
+    g->freq_cap_pct = 100;
+}
+
+void governor_set_order(Governor *g, const int *order)
+{
+    memcpy(g->order, order, (size_t)g->num_cores * sizeof(int));
+}
+
+void governor_set_freq_cap(Governor *g, int max_pct)
+{
+    g->freq_cap_pct = max_pct;
+    g->last_freq_change = g->tick;
+}
+
+static bool dwell_elapsed(const Governor *g, int core_id)
+{
+    return g->tick - g->last_change[core_id] >= g->cfg.min_dwell_ticks;
+}
+
+static bool over_thermal_limit(const Governor *g)
+{
+    return g->cfg.thermal_limit > 0.0 && g->max_temp >= g->cfg.thermal_limit;
+}
+
+// Move the frequency cap one step if that is the lever to pull this tick.
+// Returns true when it moved, in which case the core count is left alone.
+static bool adjust_frequency(Governor *g)
+{
+    const GovernorConfig *cfg = &g->cfg;
+    int min_online = cfg->min_cores > 1 ? cfg->min_cores : 1;
+
+    if (cfg->freq_step_pct <= 0 || g->tick - g->last_freq_change < cfg->min_dwell_ticks)
+        return false;
+
+    if (over_thermal_limit(g) && g->freq_cap_pct > cfg->min_freq_pct)
+    {
+        // Shed heat first; the load that wanted more speed will have to wait
+        g->freq_cap_pct -= cfg->freq_step_pct;
+        if (g->freq_cap_pct < cfg->min_freq_pct)
+            g->freq_cap_pct = cfg->min_freq_pct;
+    }
+    else if (g->average_load > cfg->high_threshold && g->freq_cap_pct < 100 && !over_thermal_limit(g))
+    {
+        // Raising the clock is cheaper and faster than bringing a core up, so go straight to full speed
+        g->freq_cap_pct = 100;
+    }
+    else if (g->average_load < cfg->low_threshold && g->freq_cap_pct > cfg->min_freq_pct &&
+             (cfg->prefer_frequency || g->online_count <= min_online))
+    {
+        g->freq_cap_pct -= cfg->freq_step_pct;
+        if (g->freq_cap_pct < cfg->min_freq_pct)
+            g->freq_cap_pct = cfg->min_freq_pct;
+    }
+    else
+    {
+        return false;
+    }
+
+    g->last_freq_change = g->tick;
+    return true;
+}
+
+static int clamp_target(const Governor *g, int target)
+{
+    // Another online core only adds heat to a package that is already at its limit
+    if (over_thermal_limit(g) && target > g->online_count)
+        target = g->online_count;
+
+    if (target < g->cfg.min_cores)
+        target = g->cfg.min_cores;
+    if (target < 1)
+        target = 1;
+    if (target > g->num_cores)
+        target = g->num_cores;
+
+    return target;
+}
+
+// Decide how many cores should be online for the smoothed demand
+static int choose_target_load(const Governor *g)
+{
+    const GovernorConfig *cfg = &g->cfg;
+    int target = g->online_count;
+
+    // Inside the hysteresis band nothing changes
+    if (g->average_load > cfg->high_threshold || g->average_load < cfg->low_threshold)
+    {
+        target = (int)ceil(g->demand * 100.0 / cfg->target_load);
+
+        // Only move in the direction that took us out of the band
+        if (g->average_load > cfg->high_threshold && target <= g->online_count)
+            target = g->online_count + 1;
+        if (g->average_load < cfg->low_threshold && target > g->online_count)
+            target = g->online_count;
+    }
+
+    return clamp_target(g, target);
+}
+
+// Decide how many cores the runnable tasks need, with a PI correction on CPU pressure
+static int choose_target_pressure(Governor *g, const TelemetrySnapshot *snap)
+{
+    const GovernorConfig *cfg = &g->cfg;
+
+    if (g->pressure < 0.0)
+        return choose_target_load(g);
+
+    // Every runnable task wants a core of its own, waiting or not; busy time gets headroom
+    double need = g->demand * 100.0 / cfg->target_load;
+    if (g->runnable > need)
+        need = g->runnable;
+
+    double usable = 1.0 - snap->total.steal / 100.0; // Share of each core the hypervisor leaves us
+    if (usable < 0.1)
+        usable = 0.1;
+
+    double base = need / usable;
+    double error = g->pressure - cfg->pressure_setpoint;
+    double ideal = base + cfg->pi_kp * error + cfg->pi_ki * (g->pi_integral + error);
+    int wanted = (int)ceil(ideal - 0.05); // Slack so rounding noise does not add a core
+    int target = clamp_target(g, wanted);
+
+    // Stop integrating while a limit holds the output back (anti-windup)
+    bool saturated = target != wanted && (wanted > target) == (error > 0.0);
+    if (!saturated)
+        g->pi_integral += error;
+
+    double limit = cfg->pi_ki > 0.0 ? g->num_cores / cfg->pi_ki : 0.0;
+    if (g->pi_integral > limit)
+        g->pi_integral = limit;
+    if (g->pi_integral < -limit)
+        g->pi_integral = -limit;
+
+    // Pressure above the setpoint means tasks are already queueing: never shrink then
+    if (target < g->online_count && (error > 0.0 || snap->total.iowait > IOWAIT_HOLD_PCT))
+        target = g->online_count;
+
+    return target;
+}
+
+static int choose_target(Governor *g, const TelemetrySnapshot *snap)
+{
+    if (g->cfg.policy == GOVERNOR_POLICY_PRESSURE)
+        return choose_target_pressure(g, snap);
+
+    return choose_target_load(g);
+}
+
+int governor_update(Governor *g, const TelemetrySnapshot *snap)
+{
+    const double alpha = g->cfg.ewma_alpha;
+    double demand = 0.0;
+    double max_temp = 0.0;
+    int online = 0;
+
+    if (g->primed && snap->seq == g->last_seq)
+        return 0;
+
+    g->last_seq = snap->seq;
+    g->tick++;
+
+    // One pass over the snapshot for aggregate demand and transition tracking
+    for (int i = 0; i < g->num_cores; i++)
+    {
+        if (!g->primed)
+        {
+            // Cores found in a state at startup are free to move right away
+            g->was_online[i] = snap->online[i];
+            g->last_change[i] = g->tick - g->cfg.min_dwell_ticks;
+        }
+        else if (snap->online[i] != g->was_online[i])
+        {
+            g->was_online[i] = snap->online[i];
+            g->last_change[i] = g->tick;
+        }
+
+        if (!snap->online[i])
+            continue;
+
+        online++;
+        demand += snap->load[i] / 100.0;
+        if (snap->temp[i] > max_temp)
+            max_temp = snap->temp[i];
+    }
+
+    g->demand = g->primed ? alpha * demand + (1.0 - alpha) * g->demand : demand;
+    g->online_count = online;
+    g->max_temp = max_temp;
+    g->average_load = online > 0 ? g->demand * 100.0 / online : 0.0;
+
+    if (snap->cpu_pressure < 0.0)
+        g->pressure = -1.0;
+    else
+        g->pressure = g->primed && g->pressure >= 0.0 ? alpha * snap->cpu_pressure + (1.0 - alpha) * g->pressure
+                                                      : snap->cpu_pressure;
+    g->runnable = g->primed ? alpha * snap->procs_running + (1.0 - alpha) * g->runnable : snap->procs_running;
+    g->primed = true;
+
+    g->target_online = adjust_frequency(g) ? online : choose_target(g, snap);
+    memcpy(g->recommend, snap->online, (size_t)g->num_cores * sizeof(bool));
+    g->recommend[0] = true; // Core 0 cannot be taken offline
+
+    int changes = 0;
+    if (g->target_online > online)
+    {
+        // Fill from the front of the order, so new cores land next to the busy ones
+        for (int k = 0; k < g->num_cores && online + changes < g->target_online; k++)
+        {
+            int i = g->order[k];
+            if (i != 0 && !snap->online[i] && dwell_elapsed(g, i))
+            {
+                g->recommend[i] = true;
+                changes++;
+            }
+        }
+    }
+    else if (g->target_online < online)
+    {
+        // Park from the back of the order, emptying whole siblings, L3 domains and nodes
+        for (int k = g->num_cores - 1; k >= 0 && online - changes > g->target_online; k--)
+        {
+            int i = g->order[k];
+            if (i != 0 && snap->online[i] && dwell_elapsed(g, i))
+            {
+                g->recommend[i] = false;
+                changes++;
+            }
+        }
+    }
+
+    return changes;
+}
@@ -0,0 +1,89 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <stdbool.h>
+#include "telemetry.h"
+
+typedef enum
+{
+    GOVERNOR_POLICY_LOAD,     // Size the core count from busy time inside a hysteresis band
+    GOVERNOR_POLICY_PRESSURE, // Size it from runqueue length, steal time and CPU pressure
+    GOVERNOR_POLICY_COUNT
+} GovernorPolicy;
+
+typedef struct
+{
+    GovernorPolicy policy;
+    double low_threshold;  // Shed cores when smoothed average load drops below this (%)
+    double high_threshold; // Add cores when smoothed average load rises above this (%)
+    double target_load;    // Average load (%) the core count is sized for once outside the band
+    double ewma_alpha;     // Weight of the newest sample, 0..1
+    int min_dwell_ticks;   // Ticks a core must stay in its state before it may flip again
+    int min_cores;         // Never recommend fewer online cores than this
+    int freq_step_pct;     // Lowering step of the frequency cap per decision; 0 leaves frequency alone
+    int min_freq_pct;      // Lowest frequency cap the governor will set
+    bool prefer_frequency; // Lower the frequency cap before parking cores (latency-sensitive hosts)
+    double thermal_limit;  // Hottest online core (°C) at which cores stop being added; 0 disables
+    double pressure_setpoint; // Pressure policy: CPU stall time (%) the controller steers towards
+    double pi_kp;          // Pressure policy: cores added per point of pressure above the setpoint
+    double pi_ki;          // Pressure policy: cores added per point-tick of accumulated error
+} GovernorConfig;
+
+// Incremental auto-governor. Each snapshot is folded in once: aggregate demand
+// is computed in one pass, smoothed, and turned into a single decision on how
+// many cores should be online and which ones (following the bring-up order).
+// Frequency is the second lever: load above the band raises the cap before any
+// core is added, and load below it lowers the cap either before parking cores
+// (prefer_frequency) or once no more cores can be parked. While the hottest
+// core is at the thermal limit no core is added and the cap is stepped down.
+//
+// The pressure policy asks how many cores the runnable tasks need rather than
+// how busy the online ones are: the larger of busy time and runqueue length is
+// sized for target_load, scaled up for capacity lost to steal, and corrected by
+// a PI controller that holds the CPU pressure stall time at the setpoint.
+// Cores are not parked while tasks are stuck on I/O, since their CPU demand
+// returns once the I/O completes. Without PSI it behaves like the load policy.
+typedef struct
+{
+    GovernorConfig cfg;
+    int num_cores;
+    long tick;
+    unsigned long last_seq; // Snapshot already evaluated
+    bool primed;
+
+    double demand;          // Smoothed busy time across all cores, in cores
+    double average_load;    // Smoothed demand spread over the online cores (%)
+    double max_temp;        // Hottest online core in the last snapshot (°C)
+    double runnable;        // Smoothed runqueue length
+    double pressure;        // Smoothed CPU pressure (%), -1 without PSI
+    double pi_integral;     // Accumulated pressure error, in point-ticks
+    int online_count;
+    int target_online;
+    int freq_cap_pct;     // Recommended scaling_max_freq, as a percentage of the hardware range
+    long last_freq_change;
+
+    int order[MAX_CORES]; // Cores are brought up in this order and parked in reverse
+    bool was_online[MAX_CORES];
+    long last_change[MAX_CORES]; // Tick of the core's last observed transition
+    bool recommend[MAX_CORES]; // Recommended state of every core after the last update
+} Governor;
+
+void governor_default_config(GovernorConfig *cfg);
+
+const char *governor_policy_name(GovernorPolicy policy);
+
+// Parse "load" or "pressure". Returns -1 for anything else.
+int governor_policy_from_name(const char *name);
+void governor_init(Governor *g, int num_cores, const GovernorConfig *cfg);
+
+// Use a topology-aware bring-up order instead of plain index order
+void governor_set_order(Governor *g, const int *order);
+
+// Tell the governor about a frequency cap set from outside (e.g. by a power profile)
+void governor_set_freq_cap(Governor *g, int max_pct);
+
+// Fold in a snapshot and recompute recommend[]. Evaluating the same snapshot
+// twice is a no-op. Returns how many cores the recommendation would flip.
+int governor_update(Governor *g, const TelemetrySnapshot *snap);
+
+#endif // GOVERNOR_H
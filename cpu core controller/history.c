@@ -0,0 +1,150 @@
+#include "history.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+int history_init(History *h, int num_cores, int capacity)
+{
+    memset(h, 0, sizeof(*h));
+    h->num_cores = num_cores > MAX_CORES ? MAX_CORES : num_cores;
+    h->capacity = capacity < 2 ? 2 : capacity;
+
+    // Level 0 holds the raw samples, once; every level above keeps a min and a max
+    // array. Two spare blocks cover the partially filled ones at either end.
+    size_t offset = 0;
+    for (int k = 0; k < HISTORY_MAX_LEVELS && (h->capacity >> k) > 0; k++)
+    {
+        h->level_capacity[k] = (h->capacity >> k) + (k > 0 ? 2 : 0);
+        h->level_offset[k] = offset;
+        offset += (size_t)h->level_capacity[k] * (k > 0 ? 2 : 1);
+        h->levels = k + 1;
+    }
+    h->series_stride = offset;
+
+    size_t total = h->series_stride * HISTORY_METRIC_COUNT * (size_t)h->num_cores;
+    h->data = malloc(total * sizeof(float));
+    if (!h->data)
+        return -1;
+
+    for (size_t i = 0; i < total; i++)
+        h->data[i] = NAN;
+
+    return 0;
+}
+
+static float *series_base(const History *h, HistoryMetric metric, int core_id)
+{
+    return h->data + ((size_t)metric * h->num_cores + core_id) * h->series_stride;
+}
+
+static float *level_min(const History *h, float *base, int k)
+{
+    return base + h->level_offset[k];
+}
+
+static float *level_max(const History *h, float *base, int k)
+{
+    // Level 0 is a single array; min and max of one sample are the sample itself
+    return base + h->level_offset[k] + (k > 0 ? h->level_capacity[k] : 0);
+}
+
+static void series_append(History *h, float *base, unsigned long n, float value)
+{
+    base[h->level_offset[0] + n % h->level_capacity[0]] = value;
+
+    for (int k = 1; k < h->levels; k++)
+    {
+        unsigned long slot = (n >> k) % h->level_capacity[k];
+        float *min = &level_min(h, base, k)[slot];
+        float *max = &level_max(h, base, k)[slot];
+
+        // First sample of a block starts it afresh; fminf/fmaxf skip the NAN gaps
+        if ((n & ((1UL << k) - 1)) == 0)
+        {
+            *min = value;
+            *max = value;
+        }
+        else
+        {
+            *min = fminf(*min, value);
+            *max = fmaxf(*max, value);
+        }
+    }
+}
+
+void history_append(History *h, const TelemetrySnapshot *snap)
+{
+    if (h->count > 0 && snap->seq == h->last_seq)
+        return;
+
+    h->last_seq = snap->seq;
+
+    for (int i = 0; i < h->num_cores; i++)
+    {
+        bool online = snap->online[i];
+        series_append(h, series_base(h, HISTORY_LOAD, i), h->count, online ? (float)snap->load[i] : NAN);
+        series_append(h, series_base(h, HISTORY_FREQ, i), h->count, online ? (float)snap->freq[i] : NAN);
+        series_append(h, series_base(h, HISTORY_TEMP, i), h->count, online ? (float)snap->temp[i] : NAN);
+    }
+
+    h->count++;
+}
+
+int history_columns(const History *h, HistoryMetric metric, int core_id, int span, int columns,
+                    float *min, float *max)
+{
+    if (columns <= 0 || core_id < 0 || core_id >= h->num_cores || h->count == 0)
+        return 0;
+
+    unsigned long available = h->count < (unsigned long)h->capacity ? h->count : (unsigned long)h->capacity;
+    unsigned long samples = span > 0 && (unsigned long)span < available ? (unsigned long)span : available;
+    unsigned long first = h->count - samples;
+    float *base = series_base(h, metric, core_id);
+
+    if (samples <= (unsigned long)columns)
+    {
+        const float *raw = level_min(h, base, 0);
+        for (unsigned long c = 0; c < samples; c++)
+        {
+            min[c] = raw[(first + c) % h->level_capacity[0]];
+            max[c] = min[c];
+        }
+        return (int)samples;
+    }
+
+    // Coarsest level whose blocks still fit inside one column
+    double per_column = (double)samples / columns;
+    int k = 0;
+    while (k + 1 < h->levels && (double)(1UL << (k + 1)) <= per_column)
+        k++;
+
+    const float *mins = level_min(h, base, k);
+    const float *maxs = level_max(h, base, k);
+
+    for (int c = 0; c < columns; c++)
+    {
+        // Column edges snap to block boundaries at this level
+        unsigned long start = first + (unsigned long)(c * per_column);
+        unsigned long end = first + (unsigned long)((c + 1) * per_column);
+        float lo = NAN, hi = NAN;
+
+        for (unsigned long j = start >> k; j <= (end - 1) >> k; j++)
+        {
+            unsigned long slot = j % h->level_capacity[k];
+            lo = fminf(lo, mins[slot]);
+            hi = fmaxf(hi, maxs[slot]);
+        }
+
+        min[c] = lo;
+        max[c] = hi;
+    }
+
+    return columns;
+}
+
+void history_free(History *h)
+{
+    free(h->data);
+    h->data = NULL;
+}
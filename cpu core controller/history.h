@@ -0,0 +1,49 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include "telemetry.h"
+
+#define HISTORY_MAX_LEVELS 24
+
+typedef enum
+{
+    HISTORY_LOAD, // Busy percentage
+    HISTORY_FREQ, // MHz
+    HISTORY_TEMP, // °C
+    HISTORY_METRIC_COUNT
+} HistoryMetric;
+
+// Fixed-capacity time series for every core and metric, allocated once.
+// Besides the raw samples each series keeps a min/max pyramid: level k holds
+// one entry per aligned block of 2^k samples. Reading the history back at a
+// given chart width only touches a couple of blocks per pixel column, so the
+// cost of a redraw follows the width, not the length of the history.
+// Samples taken while a core was offline are stored as NAN and leave gaps.
+typedef struct
+{
+    int num_cores;
+    int capacity;        // Raw samples kept per series
+    int levels;
+    unsigned long count; // Samples appended so far
+    unsigned long last_seq;
+    int level_capacity[HISTORY_MAX_LEVELS];
+    size_t level_offset[HISTORY_MAX_LEVELS];
+    size_t series_stride;
+    float *data;
+} History;
+
+int history_init(History *h, int num_cores, int capacity);
+
+// Append one sample per core and metric; a snapshot already appended is skipped
+void history_append(History *h, const TelemetrySnapshot *snap);
+
+// Downsample the last `span` samples (or fewer, if not that many exist yet)
+// into at most `columns` min/max pairs, oldest first. Returns the number of
+// columns filled; with fewer samples than columns each column is one sample.
+int history_columns(const History *h, HistoryMetric metric, int core_id, int span, int columns,
+                    float *min, float *max);
+
+void history_free(History *h);
+
+#endif // HISTORY_H
@@ -0,0 +1,185 @@
+#include "hotplug.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+int hotplug_set_online(int core_id, bool online)
+{
+    if (core_id == 0)
+        return 0; // Can't toggle core 0
+
+    char path[MAX_PATH];
+    cpu_path(path, MAX_PATH, "/sys/devices/system/cpu/cpu%d/online", core_id);
+
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return errno;
+
+    int error = 0;
+    if (write(fd, online ? "1" : "0", 1) != 1)
+        error = errno;
+    close(fd);
+
+    return error;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// One phase of a batch: a slice of results[] that the writer threads share out
+typedef struct
+{
+    HotplugResult *results;
+    int count;
+    atomic_int next;   // Next unclaimed entry
+    atomic_int failed; // Set by the first failing write; stops new writes
+} HotplugPhase;
+
+static void run_one(HotplugPhase *phase, int index)
+{
+    HotplugResult *r = &phase->results[index];
+    double start = now_ms();
+
+    r->error = hotplug_set_online(r->core_id, r->online);
+    r->latency_ms = now_ms() - start;
+
+    if (r->error)
+        atomic_store(&phase->failed, 1);
+}
+
+static void *phase_thread(void *arg)
+{
+    HotplugPhase *phase = arg;
+
+    for (;;)
+    {
+        int index = atomic_fetch_add(&phase->next, 1);
+        if (index >= phase->count || atomic_load(&phase->failed))
+            break;
+        run_one(phase, index);
+    }
+
+    return NULL;
+}
+
+// Run every entry of results[], on up to `threads` threads including this one.
+// Entries never claimed because of an earlier failure are marked ECANCELED.
+static bool run_phase(HotplugResult *results, int count, int threads)
+{
+    HotplugPhase phase = {.results = results, .count = count};
+    pthread_t helpers[HOTPLUG_DEFAULT_THREADS * 4];
+    int helper_count = 0;
+
+    if (count == 0)
+        return true;
+
+    atomic_init(&phase.next, 0);
+    atomic_init(&phase.failed, 0);
+
+    if (threads > count)
+        threads = count;
+    if (threads > (int)(sizeof(helpers) / sizeof(helpers[0])) + 1)
+        threads = (int)(sizeof(helpers) / sizeof(helpers[0])) + 1;
+
+    for (int i = 0; i < count; i++)
+        results[i].error = ECANCELED;
+
+    for (int i = 1; i < threads; i++)
+    {
+        if (pthread_create(&helpers[helper_count], NULL, phase_thread, &phase) != 0)
+            break; // Fewer threads just means a slower batch
+        helper_count++;
+    }
+
+    phase_thread(&phase);
+
+    for (int i = 0; i < helper_count; i++)
+        pthread_join(helpers[i], NULL);
+
+    return !atomic_load(&phase.failed);
+}
+
+int hotplug_apply_mask(const bool *current, const bool *target, int num_cores, int threads,
+                       bool rollback, HotplugBatch *batch)
+{
+    double start = now_ms();
+
+    memset(batch, 0, sizeof(*batch));
+    if (num_cores > MAX_CORES)
+        num_cores = MAX_CORES;
+    if (threads < 1)
+        threads = 1;
+
+    // Minimal diff, onlining first so capacity is added before any is taken away
+    for (int pass = 0; pass < 2; pass++)
+    {
+        bool online = pass == 0;
+        for (int i = 1; i < num_cores; i++)
+        {
+            if (current[i] != target[i] && target[i] == online)
+            {
+                batch->results[batch->count].core_id = i;
+                batch->results[batch->count].online = online;
+                batch->count++;
+            }
+        }
+    }
+
+    int online_count = 0;
+    while (online_count < batch->count && batch->results[online_count].online)
+        online_count++;
+
+    bool ok = run_phase(batch->results, online_count, threads);
+    if (ok)
+    {
+        ok = run_phase(batch->results + online_count, batch->count - online_count, threads);
+    }
+    else
+    {
+        for (int i = online_count; i < batch->count; i++)
+            batch->results[i].error = ECANCELED;
+    }
+
+    int first_error = 0;
+    for (int i = 0; i < batch->count; i++)
+    {
+        int error = batch->results[i].error;
+        if (error && error != ECANCELED)
+        {
+            batch->failed++;
+            if (!first_error)
+                first_error = error;
+        }
+    }
+
+    if (!ok && rollback)
+    {
+        // Undo in reverse order, one at a time; this path is rare and must not fail halfway too
+        bool restored = true;
+        for (int i = batch->count - 1; i >= 0; i--)
+        {
+            HotplugResult *r = &batch->results[i];
+            if (r->error != 0)
+                continue;
+
+            if (hotplug_set_online(r->core_id, !r->online) == 0)
+                r->rolled_back = true;
+            else
+                restored = false;
+        }
+        batch->rolled_back = restored;
+    }
+
+    batch->total_ms = now_ms() - start;
+    return first_error;
+}
@@ -0,0 +1,40 @@
+#ifndef HOTPLUG_H
+#define HOTPLUG_H
+
+#include <stdbool.h>
+#include "cpu-common.h"
+
+#define HOTPLUG_DEFAULT_THREADS 8
+
+// Outcome of one hotplug write
+typedef struct
+{
+    int core_id;
+    bool online;       // State that was requested
+    int error;         // 0 on success, otherwise an errno value
+    bool rolled_back;  // Succeeded, then undone because another core in the batch failed
+    double latency_ms; // Time the write to the online attribute took
+} HotplugResult;
+
+// Everything one hotplug_apply_mask call did
+typedef struct
+{
+    HotplugResult results[MAX_CORES]; // One entry per core whose state differed
+    int count;
+    int failed;       // Transitions that returned an error
+    bool rolled_back; // Every successful transition was undone after a failure
+    double total_ms;  // Wall time of the whole batch, rollback included
+} HotplugBatch;
+
+// Write the online attribute of a core. Returns 0 or an errno value.
+int hotplug_set_online(int core_id, bool online);
+
+// Move from the current[] online mask to target[] as one transaction. Only the
+// cores that differ are written: all onlining first, then all offlining, each
+// phase spread over up to `threads` writer threads. If any write fails nothing
+// further is started, and with `rollback` set every transition that did
+// succeed is reversed. Core 0 is never touched. Returns 0 or the first errno.
+int hotplug_apply_mask(const bool *current, const bool *target, int num_cores, int threads,
+                       bool rollback, HotplugBatch *batch);
+
+#endif // HOTPLUG_H
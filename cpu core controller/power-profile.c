@@ -0,0 +1,90 @@
+#include "power-profile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *const profile_names[POWER_PROFILE_COUNT] = {
+    "Power Saver",
+    "Balanced",
+    "Performance",
+};
+
+int power_profile_from_name(const char *name)
+{
+    for (int i = 0; i < POWER_PROFILE_COUNT; i++)
+    {
+        if (strcasecmp(name, profile_names[i]) == 0)
+            return i;
+    }
+
+    // Single-word aliases for the command line and the control socket
+    if (strcasecmp(name, "saver") == 0 || strcasecmp(name, "powersave") == 0)
+        return POWER_PROFILE_SAVER;
+    if (strcasecmp(name, "performance") == 0)
+        return POWER_PROFILE_PERFORMANCE;
+
+    return -1;
+}
+
+const char *power_profile_name(PowerProfile profile)
+{
+    return profile < POWER_PROFILE_COUNT ? profile_names[profile] : "Unknown";
+}
+
+void power_profile_target(PowerProfile profile, int num_cores, const int *order, int *target)
+{
+    for (int k = 0; k < num_cores; k++)
+    {
+        int i = order ? order[k] : k;
+
+        switch (profile)
+        {
+        case POWER_PROFILE_SAVER:
+            // Turn off all cores except the first two
+            target[i] = k < 2 ? -1 : 0;
+            break;
+        case POWER_PROFILE_BALANCED:
+            // Turn on about half the cores
+            target[i] = k < (num_cores + 1) / 2 ? 1 : 0;
+            break;
+        case POWER_PROFILE_PERFORMANCE:
+        default:
+            // Turn on all cores
+            target[i] = 1;
+            break;
+        }
+    }
+
+    target[0] = -1; // Core 0 cannot be toggled
+}
+
+void power_profile_cpufreq(PowerProfile profile, CpufreqSettings *settings)
+{
+    // Dynamic governors in order of preference; intel_pstate only offers powersave
+    const char *dynamic = "schedutil,ondemand,powersave";
+
+    memset(settings, 0, sizeof(*settings));
+    settings->min_pct = 0;
+
+    switch (profile)
+    {
+    case POWER_PROFILE_SAVER:
+        // Fewer cores and a lower ceiling
+        snprintf(settings->governor, sizeof(settings->governor), "%s", dynamic);
+        settings->max_pct = 60;
+        snprintf(settings->epp, sizeof(settings->epp), "power");
+        break;
+    case POWER_PROFILE_BALANCED:
+        snprintf(settings->governor, sizeof(settings->governor), "%s", dynamic);
+        settings->max_pct = 100;
+        snprintf(settings->epp, sizeof(settings->epp), "balance_performance");
+        break;
+    case POWER_PROFILE_PERFORMANCE:
+    default:
+        snprintf(settings->governor, sizeof(settings->governor), "performance");
+        settings->max_pct = 100;
+        snprintf(settings->epp, sizeof(settings->epp), "performance");
+        break;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef POWER_PROFILE_H
+#define POWER_PROFILE_H
+
+#include <stdbool.h>
+#include "cpufreq.h"
+
+typedef enum
+{
+    POWER_PROFILE_SAVER,
+    POWER_PROFILE_BALANCED,
+    POWER_PROFILE_PERFORMANCE,
+    POWER_PROFILE_COUNT
+} PowerProfile;
+
+// Parse a profile name as shown in the UI ("Power Saver", "Balanced", "Performance").
+// Returns -1 for an unknown name.
+int power_profile_from_name(const char *name);
+const char *power_profile_name(PowerProfile profile);
+
+// Fill target[] with the state the profile wants for each core:
+// 1 online, 0 offline, -1 leave as it is. Cores are kept in bring-up order
+// (see CpuTopology.order), or index order if order is NULL.
+void power_profile_target(PowerProfile profile, int num_cores, const int *order, int *target);
+
+// Frequency side of the profile: governor, frequency range and energy preference
+void power_profile_cpufreq(PowerProfile profile, CpufreqSettings *settings);
+
+#endif // POWER_PROFILE_H
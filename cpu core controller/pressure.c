@@ -0,0 +1,69 @@
+#include "pressure.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "cpu-common.h"
+
+#define PRESSURE_CPU_PATH "/proc/pressure/cpu"
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+void pressure_open(PressureReader *p)
+{
+    char path[MAX_PATH];
+
+    memset(p, 0, sizeof(*p));
+    p->some = -1.0;
+
+    // Kernels without CONFIG_PSI (or booted with psi=0) have no such file
+    cpu_path(path, MAX_PATH, PRESSURE_CPU_PATH);
+    p->fd = open(path, O_RDONLY | O_CLOEXEC);
+}
+
+void pressure_update(PressureReader *p)
+{
+    char buf[256];
+
+    if (p->fd < 0)
+        return;
+
+    ssize_t n = pread(p->fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return;
+    buf[n] = '\0';
+
+    // "some avg10=0.00 avg60=0.00 avg300=0.00 total=12345"
+    const char *total = strstr(buf, "total=");
+    if (strncmp(buf, "some", 4) != 0 || !total)
+        return;
+
+    unsigned long long stall = strtoull(total + 6, NULL, 10);
+    double now = now_us();
+
+    if (p->primed && now > p->prev_time && stall >= p->prev_total)
+    {
+        p->some = (double)(stall - p->prev_total) * 100.0 / (now - p->prev_time);
+        if (p->some > 100.0)
+            p->some = 100.0;
+    }
+
+    p->prev_total = stall;
+    p->prev_time = now;
+    p->primed = true;
+}
+
+void pressure_close(PressureReader *p)
+{
+    if (p->fd >= 0)
+        close(p->fd);
+    p->fd = -1;
+}
@@ -0,0 +1,25 @@
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+#include <stdbool.h>
+
+// CPU pressure stall information (/proc/pressure/cpu). The file stays open and
+// the cumulative "some" stall time is turned into a percentage of each
+// interval, which reacts faster than the kernel's 10 second average.
+typedef struct
+{
+    int fd;
+    bool primed;
+    unsigned long long prev_total; // Stall time in microseconds
+    double prev_time;              // Monotonic time of the previous read, in microseconds
+    double some;                   // % of the last interval some runnable task waited for a CPU; -1 if unavailable
+} PressureReader;
+
+void pressure_open(PressureReader *p);
+
+// Re-read the stall counter and update p->some
+void pressure_update(PressureReader *p);
+
+void pressure_close(PressureReader *p);
+
+#endif // PRESSURE_H
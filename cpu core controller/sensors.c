@@ -0,0 +1,253 @@
+#include "sensors.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include "topology.h"
+
+#define HWMON_SYSFS "/sys/class/hwmon"
+#define THERMAL_SYSFS "/sys/class/thermal"
+
+static bool read_small_file(const char *path, char *buf, size_t size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n <= 0)
+        return false;
+
+    buf[n] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return true;
+}
+
+static void add_sensor(SensorSet *set, const char *input_path, int package, int core)
+{
+    if (set->count == MAX_SENSORS)
+        return;
+
+    int fd = open(input_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    TempSensor *s = &set->sensors[set->count++];
+    s->fd = fd;
+    s->package = package;
+    s->core = core;
+    s->value = 0.0;
+    s->read_seq = 0;
+}
+
+// Intel coretemp: one instance per package with "Package id P" and "Core C" inputs.
+// AMD k10temp: one instance per package with Tctl/Tdie only, so it is package-level.
+static void scan_hwmon_device(SensorSet *set, const char *dir, const char *driver, int *k10temp_package)
+{
+    char path[MAX_PATH];
+    char label[64];
+    int package = -1;
+    int first = set->count;
+
+    if (strcmp(driver, "k10temp") == 0)
+    {
+        package = (*k10temp_package)++;
+
+        // Tdie is the real die temperature; Tctl may carry a fan-control offset
+        for (int n = 1; n <= 16; n++)
+        {
+            snprintf(path, MAX_PATH, "%s/temp%d_label", dir, n);
+            if (read_small_file(path, label, sizeof(label)) && strcmp(label, "Tdie") == 0)
+            {
+                snprintf(path, MAX_PATH, "%s/temp%d_input", dir, n);
+                add_sensor(set, path, package, -1);
+                return;
+            }
+        }
+
+        snprintf(path, MAX_PATH, "%s/temp1_input", dir);
+        add_sensor(set, path, package, -1);
+        return;
+    }
+
+    for (int n = 1; n <= 256; n++)
+    {
+        snprintf(path, MAX_PATH, "%s/temp%d_label", dir, n);
+        if (!read_small_file(path, label, sizeof(label)))
+            continue;
+
+        int id;
+        snprintf(path, MAX_PATH, "%s/temp%d_input", dir, n);
+        if (sscanf(label, "Package id %d", &id) == 1)
+        {
+            package = id;
+            add_sensor(set, path, id, -1);
+        }
+        else if (sscanf(label, "Core %d", &id) == 1)
+        {
+            add_sensor(set, path, -1, id);
+        }
+    }
+
+    // Core inputs don't name their package; it comes from the instance's package input
+    for (int i = first; i < set->count; i++)
+        set->sensors[i].package = package;
+}
+
+static void scan_hwmon(SensorSet *set)
+{
+    char path[MAX_PATH + 16]; // Room for a file name after a full-length hwmon directory
+    cpu_path(path, MAX_PATH, HWMON_SYSFS);
+
+    DIR *dir = opendir(path);
+    if (!dir)
+        return;
+
+    // Enumerate in index order so k10temp instances line up with package numbers
+    int k10temp_package = 0;
+    for (int index = 0; index < 64; index++)
+    {
+        char base[MAX_PATH];
+        char name[64];
+
+        cpu_path(base, sizeof(base), HWMON_SYSFS "/hwmon%d", index);
+        snprintf(path, sizeof(path), "%s/name", base);
+        if (!read_small_file(path, name, sizeof(name)))
+            continue;
+
+        if (strcmp(name, "coretemp") != 0 && strcmp(name, "k10temp") != 0)
+            continue;
+
+        // Older kernels keep the inputs under device/
+        snprintf(path, sizeof(path), "%s/temp1_input", base);
+        if (access(path, R_OK) != 0)
+            strncat(base, "/device", sizeof(base) - strlen(base) - 1);
+
+        scan_hwmon_device(set, base, name, &k10temp_package);
+    }
+
+    closedir(dir);
+}
+
+// Without hwmon drivers, use x86_pkg_temp zones per package, or failing that zone 0
+static void scan_thermal_zones(SensorSet *set)
+{
+    int package = 0;
+    char path[MAX_PATH];
+    char type[64];
+
+    for (int zone = 0; zone < 64; zone++)
+    {
+        cpu_path(path, MAX_PATH, THERMAL_SYSFS "/thermal_zone%d/type", zone);
+        if (!read_small_file(path, type, sizeof(type)))
+            continue;
+
+        if (strcmp(type, "x86_pkg_temp") == 0)
+        {
+            cpu_path(path, MAX_PATH, THERMAL_SYSFS "/thermal_zone%d/temp", zone);
+            add_sensor(set, path, package++, -1);
+        }
+    }
+
+    if (set->fallback < 0)
+    {
+        int before = set->count;
+        cpu_path(path, MAX_PATH, THERMAL_SYSFS "/thermal_zone0/temp");
+        add_sensor(set, path, -1, -1);
+        if (set->count > before)
+            set->fallback = before;
+    }
+}
+
+void sensors_discover(SensorSet *set, int num_cores)
+{
+    memset(set, 0, sizeof(*set));
+    set->num_cores = num_cores > MAX_CORES ? MAX_CORES : num_cores;
+    set->fallback = -1;
+    for (int i = 0; i < set->num_cores; i++)
+        set->core_sensor[i] = -1;
+
+    scan_hwmon(set);
+    if (set->count == 0)
+        scan_thermal_zones(set);
+
+    // Any package sensor stands in for cores we cannot place
+    for (int i = 0; i < set->count && set->fallback < 0; i++)
+    {
+        if (set->sensors[i].core < 0)
+            set->fallback = i;
+    }
+}
+
+// Pick the per-core sensor for this core's package, else the package sensor
+static int map_core(SensorSet *set, int core_id)
+{
+    int package, core;
+    int package_sensor = -1;
+
+    if (!topology_read_ids(core_id, &package, &core))
+        return set->fallback;
+
+    for (int i = 0; i < set->count; i++)
+    {
+        const TempSensor *s = &set->sensors[i];
+        if (s->package != package)
+            continue;
+        if (s->core == core)
+            return i;
+        if (s->core < 0 && package_sensor < 0)
+            package_sensor = i;
+    }
+
+    return package_sensor >= 0 ? package_sensor : set->fallback;
+}
+
+static double read_sensor(SensorSet *set, int index)
+{
+    TempSensor *s = &set->sensors[index];
+    char buf[32];
+
+    // SMT siblings share a sensor; only the first of them pays for the read
+    if (s->read_seq == set->seq)
+        return s->value;
+
+    ssize_t n = pread(s->fd, buf, sizeof(buf) - 1, 0);
+    if (n > 0)
+    {
+        buf[n] = '\0';
+        s->value = strtol(buf, NULL, 10) / 1000.0; // Convert to °C
+    }
+
+    s->read_seq = set->seq;
+    return s->value;
+}
+
+void sensors_read(SensorSet *set, const bool *online, double *temp)
+{
+    set->seq++;
+
+    for (int i = 0; i < set->num_cores; i++)
+    {
+        if (!online[i])
+        {
+            temp[i] = 0.0;
+            continue;
+        }
+
+        if (set->core_sensor[i] < 0)
+            set->core_sensor[i] = map_core(set, i);
+
+        temp[i] = set->core_sensor[i] >= 0 ? read_sensor(set, set->core_sensor[i]) : 0.0;
+    }
+}
+
+void sensors_close(SensorSet *set)
+{
+    for (int i = 0; i < set->count; i++)
+        close(set->sensors[i].fd);
+    set->count = 0;
+}
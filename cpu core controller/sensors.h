@@ -0,0 +1,39 @@
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include <stdbool.h>
+#include "cpu-common.h"
+
+#define MAX_SENSORS 1024
+
+typedef struct
+{
+    int fd;       // tempN_input or thermal_zoneN/temp, kept open and re-read with pread
+    int package;  // Package the sensor belongs to, -1 if it covers the whole system
+    int core;     // core_id it measures, -1 for a package-level sensor
+    double value; // Last reading in °C
+    unsigned long read_seq;
+} TempSensor;
+
+// Temperature sources discovered once at startup (coretemp / k10temp hwmon
+// inputs, x86_pkg_temp thermal zones, or thermal_zone0 as a last resort) and
+// the sensor that best describes each core.
+typedef struct
+{
+    int num_cores;
+    TempSensor sensors[MAX_SENSORS];
+    int count;
+    int core_sensor[MAX_CORES]; // Index into sensors[], -1 until the core is mapped
+    int fallback;               // Sensor used when nothing better matches, -1 if none
+    unsigned long seq;
+} SensorSet;
+
+void sensors_discover(SensorSet *set, int num_cores);
+
+// Fill temp[] for every online core, reading each sensor at most once per call.
+// Cores seen online for the first time are mapped to their sensor here.
+void sensors_read(SensorSet *set, const bool *online, double *temp);
+
+void sensors_close(SensorSet *set);
+
+#endif // SENSORS_H
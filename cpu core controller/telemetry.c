@@ -0,0 +1,193 @@
+#include "telemetry.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// Read a single integer from a sysfs attribute. Returns false if it is missing.
+static bool read_sysfs_long(const char *path, long *value)
+{
+    char buf[32];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return false;
+
+    buf[n] = '\0';
+    *value = strtol(buf, NULL, 10);
+    return true;
+}
+
+bool telemetry_read_online(int core_id)
+{
+    if (core_id == 0)
+        return true; // Core 0 is always online
+
+    char path[MAX_PATH];
+    cpu_path(path, MAX_PATH, "/sys/devices/system/cpu/cpu%d/online", core_id);
+
+    long status;
+    return read_sysfs_long(path, &status) && status == 1;
+}
+
+int telemetry_count_cores(void)
+{
+    // "present" is a range list such as "0-7" or "0-3,8-11"; the highest id bounds the array
+    char buf[256];
+    char path[MAX_PATH];
+    int count = 0;
+
+    cpu_path(path, MAX_PATH, "/sys/devices/system/cpu/present");
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (n > 0)
+        {
+            buf[n] = '\0';
+            for (char *p = buf; *p;)
+            {
+                char *end;
+                long last = strtol(p, &end, 10);
+                if (end == p)
+                    break;
+                if (*end == '-')
+                    last = strtol(end + 1, &end, 10);
+                if (last + 1 > count)
+                    count = (int)last + 1;
+                p = *end == ',' ? end + 1 : end;
+            }
+        }
+    }
+
+    if (count <= 0)
+    {
+        long conf = sysconf(_SC_NPROCESSORS_CONF);
+        count = conf > 0 ? (int)conf : 1;
+    }
+
+    return count > MAX_CORES ? MAX_CORES : count;
+}
+
+static double read_core_frequency(int core_id)
+{
+    char path[MAX_PATH];
+    cpu_path(path, MAX_PATH, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", core_id);
+
+    long freq;
+    if (!read_sysfs_long(path, &freq))
+        return 0.0;
+
+    return freq / 1000.0; // Convert to MHz
+}
+
+static bool snapshot_alloc(TelemetrySnapshot *snap, int num_cores)
+{
+    memset(snap, 0, sizeof(*snap));
+    snap->num_cores = num_cores;
+    snap->load = calloc(num_cores, sizeof(double));
+    snap->freq = calloc(num_cores, sizeof(double));
+    snap->temp = calloc(num_cores, sizeof(double));
+    snap->online = calloc(num_cores, sizeof(bool));
+
+    return snap->load && snap->freq && snap->temp && snap->online;
+}
+
+static void snapshot_free(TelemetrySnapshot *snap)
+{
+    free(snap->load);
+    free(snap->freq);
+    free(snap->temp);
+    free(snap->online);
+    memset(snap, 0, sizeof(*snap));
+}
+
+int telemetry_init(Telemetry *t, int num_cores)
+{
+    memset(t, 0, sizeof(*t));
+    t->sampler.fd = -1;
+    t->pressure.fd = -1;
+    if (num_cores > MAX_CORES)
+        num_cores = MAX_CORES;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (!snapshot_alloc(&t->buffers[i], num_cores))
+        {
+            telemetry_free(t);
+            return -1;
+        }
+    }
+
+    t->back = 0;
+    atomic_init(&t->middle, 1);
+    t->front = 2;
+
+    // A missing /proc/stat only costs us load figures; keep going without it
+    if (cpu_sampler_open(&t->sampler, num_cores) < 0)
+        perror("Failed to open /proc/stat");
+
+    sensors_discover(&t->sensors, num_cores);
+    pressure_open(&t->pressure);
+    pressure_update(&t->pressure); // Baseline for the first interval
+
+    return 0;
+}
+
+const TelemetrySnapshot *telemetry_refresh(Telemetry *t)
+{
+    TelemetrySnapshot *snap = &t->buffers[t->back];
+
+    cpu_sampler_update(&t->sampler);
+    pressure_update(&t->pressure);
+
+    for (int i = 0; i < snap->num_cores; i++)
+    {
+        snap->online[i] = telemetry_read_online(i);
+        if (snap->online[i])
+        {
+            snap->load[i] = t->sampler.load[i].busy;
+            snap->freq[i] = read_core_frequency(i);
+        }
+        else
+        {
+            snap->load[i] = 0.0;
+            snap->freq[i] = 0.0;
+        }
+    }
+
+    sensors_read(&t->sensors, snap->online, snap->temp);
+
+    snap->total = t->sampler.total;
+    snap->cpu_pressure = t->pressure.some;
+    snap->procs_running = t->sampler.procs_running > 0 ? t->sampler.procs_running - 1 : 0;
+    snap->seq = ++t->seq;
+
+    // Publish; whatever was in the middle slot becomes the next back buffer
+    t->back = atomic_exchange(&t->middle, t->back | TELEMETRY_FRESH) & ~TELEMETRY_FRESH;
+    return snap;
+}
+
+const TelemetrySnapshot *telemetry_current(Telemetry *t)
+{
+    if (atomic_load(&t->middle) & TELEMETRY_FRESH)
+        t->front = atomic_exchange(&t->middle, t->front) & ~TELEMETRY_FRESH;
+
+    return &t->buffers[t->front];
+}
+
+void telemetry_free(Telemetry *t)
+{
+    cpu_sampler_close(&t->sampler);
+    sensors_close(&t->sensors);
+    pressure_close(&t->pressure);
+    for (int i = 0; i < 3; i++)
+        snapshot_free(&t->buffers[i]);
+}
@@ -0,0 +1,61 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "cpu-sampler.h"
+#include "sensors.h"
+#include "pressure.h"
+
+// One consistent set of per-core readings, all taken during the same refresh.
+// Stored as parallel arrays so a consumer walking one metric touches one cache stream.
+typedef struct
+{
+    unsigned long seq; // Refresh number this snapshot was filled on
+    int num_cores;
+    double *load; // Busy percentage over the last interval
+    double *freq; // Current frequency in MHz
+    double *temp; // Temperature in °C
+    bool *online;
+    CpuLoad total; // Whole-system breakdown for the same interval
+    double cpu_pressure; // % of the interval some task waited for a CPU (PSI); -1 without PSI
+    int procs_running;   // Runnable tasks, not counting the refresher itself
+} TelemetrySnapshot;
+
+// Triple-buffered snapshot store with one producer (the refresher) and one
+// consumer (the UI). The producer fills its private back buffer and swaps it
+// into the shared middle slot; the consumer swaps the middle slot into its
+// private front buffer when a newer one is there. Neither side ever blocks or
+// sees a half-written snapshot.
+typedef struct
+{
+    CpuSampler sampler;
+    SensorSet sensors;
+    PressureReader pressure;
+    TelemetrySnapshot buffers[3];
+    int back;
+    atomic_int middle; // Buffer index, plus TELEMETRY_FRESH when not yet consumed
+    int front;
+    unsigned long seq;
+} Telemetry;
+
+#define TELEMETRY_FRESH 0x4
+
+int telemetry_init(Telemetry *t, int num_cores);
+
+// Producer side: read every source exactly once and publish the result. The
+// returned snapshot stays valid for the producer until its next refresh.
+const TelemetrySnapshot *telemetry_refresh(Telemetry *t);
+
+// Consumer side: most recently published snapshot
+const TelemetrySnapshot *telemetry_current(Telemetry *t);
+
+void telemetry_free(Telemetry *t);
+
+// Read the online state of one core straight from sysfs
+bool telemetry_read_online(int core_id);
+
+// Number of present cores, online or not, capped at MAX_CORES
+int telemetry_count_cores(void);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,256 @@
+#include "topology.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#define CPU_SYSFS "/sys/devices/system/cpu"
+#define NODE_SYSFS "/sys/devices/system/node"
+
+static bool read_sysfs_string(const char *path, char *buf, size_t size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n <= 0)
+        return false;
+
+    buf[n] = '\0';
+    return true;
+}
+
+static bool read_sysfs_int(const char *path, int *value)
+{
+    char buf[32];
+    if (!read_sysfs_string(path, buf, sizeof(buf)))
+        return false;
+
+    *value = atoi(buf);
+    return true;
+}
+
+// Call fn for every CPU in a list such as "0-3,8,10-11"
+static void for_each_in_cpulist(const char *list, void (*fn)(int cpu, void *arg), void *arg)
+{
+    const char *p = list;
+    while (*p)
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p)
+            break;
+
+        long last = first;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+
+        for (long cpu = first; cpu <= last; cpu++)
+            fn((int)cpu, arg);
+
+        p = *end == ',' ? end + 1 : end;
+    }
+}
+
+static int first_in_cpulist(const char *list)
+{
+    return atoi(list);
+}
+
+// The L3 is usually cache/index3, but the index numbering is not guaranteed
+static int read_l3_domain(int core_id)
+{
+    char path[MAX_PATH];
+    char buf[1024];
+
+    for (int index = 0; index < 8; index++)
+    {
+        int level;
+        cpu_path(path, MAX_PATH, CPU_SYSFS "/cpu%d/cache/index%d/level", core_id, index);
+        if (!read_sysfs_int(path, &level))
+            break;
+        if (level != 3)
+            continue;
+
+        cpu_path(path, MAX_PATH, CPU_SYSFS "/cpu%d/cache/index%d/shared_cpu_list", core_id, index);
+        if (read_sysfs_string(path, buf, sizeof(buf)))
+            return first_in_cpulist(buf);
+    }
+
+    return -1;
+}
+
+bool topology_read_ids(int core_id, int *package, int *core)
+{
+    char path[MAX_PATH];
+
+    cpu_path(path, MAX_PATH, CPU_SYSFS "/cpu%d/topology/physical_package_id", core_id);
+    if (!read_sysfs_int(path, package))
+        return false;
+
+    cpu_path(path, MAX_PATH, CPU_SYSFS "/cpu%d/topology/core_id", core_id);
+    if (!read_sysfs_int(path, core))
+        *core = core_id;
+
+    return true;
+}
+
+static bool read_core_topology(CpuTopology *t, int core_id)
+{
+    if (!topology_read_ids(core_id, &t->package[core_id], &t->core[core_id]))
+        return false;
+
+    t->l3[core_id] = read_l3_domain(core_id);
+    if (t->l3[core_id] < 0)
+        t->l3[core_id] = core_id; // No shared L3 known: the core is its own domain
+
+    t->known[core_id] = true;
+    return true;
+}
+
+typedef struct
+{
+    CpuTopology *t;
+    int node;
+} NodeAssign;
+
+static void assign_node(int cpu, void *arg)
+{
+    NodeAssign *a = arg;
+    if (cpu >= 0 && cpu < a->t->num_cores)
+        a->t->node[cpu] = a->node;
+}
+
+// Node membership is listed per node and covers offline CPUs too
+static void read_numa_nodes(CpuTopology *t)
+{
+    char path[MAX_PATH];
+    cpu_path(path, MAX_PATH, NODE_SYSFS);
+
+    DIR *dir = opendir(path);
+    if (!dir)
+        return;
+
+    struct dirent *entry;
+    char buf[4096];
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        int node;
+        if (sscanf(entry->d_name, "node%d", &node) != 1)
+            continue;
+
+        cpu_path(path, MAX_PATH, NODE_SYSFS "/node%d/cpulist", node);
+        if (!read_sysfs_string(path, buf, sizeof(buf)))
+            continue;
+
+        NodeAssign a = {t, node};
+        for_each_in_cpulist(buf, assign_node, &a);
+    }
+
+    closedir(dir);
+}
+
+typedef struct
+{
+    int cpu;
+    int keys[5]; // known, node, L3, package, physical core: compared in that order
+} OrderKey;
+
+// Domains holding CPU0 sort first, so core 0 (which never goes offline) anchors the packing
+static int domain_key(int value, int cpu0_value)
+{
+    return value == cpu0_value ? -1 : value;
+}
+
+static int compare_order(const void *a, const void *b)
+{
+    const OrderKey *ka = a, *kb = b;
+
+    for (size_t i = 0; i < sizeof(ka->keys) / sizeof(ka->keys[0]); i++)
+    {
+        if (ka->keys[i] != kb->keys[i])
+            return ka->keys[i] < kb->keys[i] ? -1 : 1;
+    }
+
+    // Siblings of one physical core end up adjacent, lowest thread first
+    return ka->cpu - kb->cpu;
+}
+
+void topology_build_order(CpuTopology *t)
+{
+    OrderKey keys[MAX_CORES];
+
+    // Number the threads of each physical core
+    for (int i = 0; i < t->num_cores; i++)
+    {
+        t->smt_rank[i] = 0;
+        if (!t->known[i])
+            continue;
+
+        for (int j = 0; j < i; j++)
+        {
+            if (t->known[j] && t->package[j] == t->package[i] && t->core[j] == t->core[i])
+                t->smt_rank[i]++;
+        }
+    }
+
+    for (int i = 0; i < t->num_cores; i++)
+    {
+        keys[i].cpu = i;
+        if (!t->known[i])
+        {
+            // Cores we know nothing about go last, in index order
+            keys[i].keys[0] = 1;
+            keys[i].keys[1] = keys[i].keys[2] = keys[i].keys[3] = keys[i].keys[4] = 0;
+            continue;
+        }
+
+        keys[i].keys[0] = 0;
+        keys[i].keys[1] = domain_key(t->node[i], t->node[0]);
+        keys[i].keys[2] = domain_key(t->l3[i], t->l3[0]);
+        keys[i].keys[3] = domain_key(t->package[i], t->package[0]);
+        keys[i].keys[4] = t->core[i];
+    }
+
+    qsort(keys, t->num_cores, sizeof(OrderKey), compare_order);
+
+    for (int i = 0; i < t->num_cores; i++)
+    {
+        t->order[i] = keys[i].cpu;
+        t->rank[keys[i].cpu] = i;
+    }
+}
+
+void topology_load(CpuTopology *t, int num_cores)
+{
+    memset(t, 0, sizeof(*t));
+    t->num_cores = num_cores > MAX_CORES ? MAX_CORES : num_cores;
+
+    read_numa_nodes(t);
+    for (int i = 0; i < t->num_cores; i++)
+        read_core_topology(t, i);
+
+    topology_build_order(t);
+}
+
+bool topology_learn(CpuTopology *t, const bool *online)
+{
+    bool learned = false;
+
+    for (int i = 0; i < t->num_cores; i++)
+    {
+        if (online[i] && !t->known[i])
+            learned |= read_core_topology(t, i);
+    }
+
+    if (learned)
+        topology_build_order(t);
+
+    return learned;
+}
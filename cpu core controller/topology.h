@@ -0,0 +1,39 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdbool.h>
+#include "cpu-common.h"
+
+// Physical layout of every logical CPU, from /sys/devices/system/cpu/cpu*/topology,
+// the level-3 cache entries and /sys/devices/system/node.
+typedef struct
+{
+    int num_cores;
+    bool known[MAX_CORES];  // Topology has been read (sysfs only has it while the core is online)
+    int package[MAX_CORES]; // physical_package_id
+    int core[MAX_CORES];    // core_id within the package
+    int l3[MAX_CORES];      // Lowest CPU sharing this CPU's L3, identifies the cache domain
+    int node[MAX_CORES];    // NUMA node
+    int smt_rank[MAX_CORES]; // 0 for the first thread of a physical core, 1 for its sibling, ...
+
+    // Order to bring cores online in; offlining walks it backwards. Cores are
+    // packed so SMT siblings fill first, then the rest of the L3 domain, then
+    // the NUMA node, starting from the domains that hold CPU0.
+    int order[MAX_CORES];
+    int rank[MAX_CORES]; // Position of each core in order[]
+} CpuTopology;
+
+// Read the topology of every core that is currently online and build the order
+void topology_load(CpuTopology *t, int num_cores);
+
+// Read the topology of cores that have come online since it was last unknown.
+// Returns true if anything new was learned (and the order was rebuilt).
+bool topology_learn(CpuTopology *t, const bool *online);
+
+// Recompute order[] and rank[] from the per-core fields
+void topology_build_order(CpuTopology *t);
+
+// Read just the package and core id of one online core
+bool topology_read_ids(int core_id, int *package, int *core);
+
+#endif // TOPOLOGY_H
@@ -0,0 +1,611 @@
+#define _GNU_SOURCE
+#include "criu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define IMG_SERVICE_MAGIC 0x55105940
+#define STATS_MAGIC 0x57093306
+#define MAX_STATS_SIZE 4096
+#define MAX_RPC_SIZE CRIU_MAX_REQUEST
+#define LOOPBACK "127.0.0.1" // Where page-server connections are made
+
+// criu_req_type, and the field numbers we use of criu_req, criu_opts,
+// criu_page_server_info, criu_resp and criu_restore_resp, from CRIU's rpc.proto
+enum {
+    REQ_DUMP = 1,
+    REQ_RESTORE = 2,
+    REQ_PAGE_SERVER = 5,
+    REQ_NOTIFY = 6,
+    REQ_SINGLE_PRE_DUMP = 13,
+};
+
+enum {
+    REQ_TYPE = 1,
+    REQ_OPTS = 2,
+    REQ_NOTIFY_SUCCESS = 3,
+    REQ_KEEP_OPEN = 4,
+};
+
+enum {
+    OPT_IMAGES_DIR_FD = 1,
+    OPT_PID = 2,
+    OPT_SHELL_JOB = 7,
+    OPT_LOG_FILE = 10, // Relative to the image directory
+    OPT_PS = 11,
+    OPT_PARENT_IMG = 14,
+    OPT_TRACK_MEM = 15,
+    OPT_UNPRIVILEGED = 67,
+    OPT_LEAVE_STOPPED = 69,
+};
+
+enum {
+    PS_ADDRESS = 1,
+    PS_PORT = 2,
+};
+
+enum {
+    RESP_TYPE = 1,
+    RESP_SUCCESS = 2,
+    RESP_RESTORE = 4,
+    RESP_PS = 6,
+    RESP_ERRNO = 7,
+    RESP_ERRMSG = 9,
+};
+
+#define RESTORE_PID 1
+
+typedef struct {
+    int type;
+    int success;
+    int cr_errno;
+    char errmsg[256];
+    pid_t restored; // Root of the restored tree
+    uint16_t port;  // Where a page server listens
+} response_t;
+
+void criu_init(criu_t *c, const char *binary) {
+    c->binary = binary ? binary : CRIU_BINARY;
+}
+
+// Protocol buffers wire format, as far as CRIU's messages need it
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t pos;
+    int failed; // Ran out of room; later writes are ignored
+} pb_t;
+
+typedef struct {
+    int number;
+    int wire_type;
+    uint64_t value;       // A varint's value, or the length of bytes
+    const uint8_t *bytes; // Length-delimited fields only; NULL for others
+} field_t;
+
+static void pb_varint(pb_t *b, uint64_t value) {
+    do {
+        if (b->failed || b->pos == b->size) {
+            b->failed = 1;
+            return;
+        }
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        b->data[b->pos++] = byte | (value ? 0x80 : 0);
+    } while (value);
+}
+
+static void pb_uint(pb_t *b, int field, uint64_t value) {
+    pb_varint(b, (uint64_t)field << 3);
+    pb_varint(b, value);
+}
+
+static void pb_bytes(pb_t *b, int field, const void *data, size_t len) {
+    pb_varint(b, (uint64_t)field << 3 | 2);
+    pb_varint(b, len);
+    if (b->failed || b->size - b->pos < len) {
+        b->failed = 1;
+        return;
+    }
+    memcpy(b->data + b->pos, data, len);
+    b->pos += len;
+}
+
+static void pb_string(pb_t *b, int field, const char *s) {
+    pb_bytes(b, field, s, strlen(s));
+}
+
+static int get_varint(const uint8_t **p, const uint8_t *end, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t byte = *(*p)++;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+// Read the next field of a message, stepping over the value of fixed-size
+// ones. Returns -1 on a malformed message.
+static int next_field(const uint8_t **p, const uint8_t *end, field_t *f) {
+    uint64_t key, len;
+
+    if (get_varint(p, end, &key) < 0)
+        return -1;
+    f->number = key >> 3;
+    f->wire_type = key & 7;
+    f->value = 0;
+    f->bytes = NULL;
+
+    switch (f->wire_type) {
+    case 0:
+        return get_varint(p, end, &f->value);
+    case 1:
+        len = 8;
+        break;
+    case 2:
+        if (get_varint(p, end, &len) < 0)
+            return -1;
+        f->value = len;
+        f->bytes = *p;
+        break;
+    case 5:
+        len = 4;
+        break;
+    default:
+        return -1;
+    }
+
+    if (len > (uint64_t)(end - *p))
+        return -1;
+    *p += len;
+    return 0;
+}
+
+// Start a worker with its end of the socket as its only extra descriptor. No
+// shell is involved, and it serves requests until we hang up.
+static int start_worker(criu_session_t *s) {
+    char fd_arg[16];
+    int sk[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sk) < 0) {
+        perror("Failed to start CRIU");
+        return -1;
+    }
+    snprintf(fd_arg, sizeof(fd_arg), "%d", sk[1]);
+    char *const argv[] = {(char *)s->criu->binary, "swrk", fd_arg, NULL};
+
+    pid_t child = fork();
+    if (child < 0) {
+        perror("Failed to start CRIU");
+        close(sk[0]);
+        close(sk[1]);
+        return -1;
+    }
+
+    if (child == 0) {
+        fcntl(sk[1], F_SETFD, 0);
+        execvp(s->criu->binary, argv);
+        fprintf(stderr, "Failed to run %s: %s\n", s->criu->binary, strerror(errno));
+        _exit(127);
+    }
+    close(sk[1]);
+    s->pid = child;
+    s->sock = sk[0];
+    s->served = 0;
+    return 0;
+}
+
+// A worker waiting for a request exits when we hang up
+static void stop_worker(criu_session_t *s) {
+    if (s->sock >= 0)
+        close(s->sock);
+    s->sock = -1;
+    while (s->pid > 0 && waitpid(s->pid, NULL, 0) < 0 && errno == EINTR)
+        ;
+    s->pid = -1;
+}
+
+static void close_dir(criu_session_t *s) {
+    if (s->dir_fd >= 0)
+        close(s->dir_fd);
+    s->dir_fd = -1;
+}
+
+void criu_session_init(criu_session_t *s, const criu_t *c) {
+    s->criu = c;
+    s->pid = -1;
+    s->sock = -1;
+    s->dir_fd = -1;
+    s->served = 0;
+    s->pending = 0;
+    s->seen = 0;
+    s->last = 0;
+}
+
+void criu_session_close(criu_session_t *s) {
+    close_dir(s);
+    stop_worker(s);
+    s->pending = 0;
+}
+
+// Options every request starts with. CRIU opens the image directory through
+// our descriptor for it, so it stays open until the answer is in.
+static int begin_opts(criu_session_t *s, pb_t *opts, const char *dir, const char *log) {
+    close_dir(s);
+    s->dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (s->dir_fd < 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    pb_uint(opts, OPT_IMAGES_DIR_FD, s->dir_fd);
+    pb_string(opts, OPT_LOG_FILE, log);
+    return 0;
+}
+
+// Send the request in flight, starting a worker if none runs
+static int send_request(criu_session_t *s) {
+    for (int tries = 0; tries < 2; tries++) {
+        if (s->pid < 0 && start_worker(s) < 0)
+            return -1;
+        if (send(s->sock, s->request, s->request_len, MSG_NOSIGNAL) == (ssize_t)s->request_len)
+            return 0;
+        if ((errno != EPIPE && errno != ECONNRESET) || s->served == 0)
+            break;
+        stop_worker(s);
+    }
+    perror("Failed to send CRIU a request");
+    return -1;
+}
+
+// A worker that exits with a request unread resets the connection
+static int hung_up(ssize_t received) {
+    return received == 0 || (received < 0 && errno == ECONNRESET);
+}
+
+// CRIU versions without keep_open serve one request per worker, which exits
+// after answering, maybe before the next request arrived. A worker hanging up
+// on any request but its first never saw it, so it goes to a fresh one.
+static int resend(criu_session_t *s) {
+    if (s->served == 0 || s->seen)
+        return -1;
+    stop_worker(s);
+    return send_request(s);
+}
+
+static int request(criu_session_t *s, int type, const pb_t *opts, int keep_open) {
+    pb_t req = {.data = s->request, .size = sizeof(s->request)};
+
+    pb_uint(&req, REQ_TYPE, type);
+    pb_bytes(&req, REQ_OPTS, opts->data, opts->pos);
+    if (keep_open)
+        pb_uint(&req, REQ_KEEP_OPEN, 1);
+    s->request_len = req.pos;
+    if (req.failed || opts->failed || send_request(s) < 0) {
+        close_dir(s);
+        return -1;
+    }
+    s->pending = 1;
+    s->seen = 0;
+    s->last = !keep_open;
+    return 0;
+}
+
+static int parse_response(const uint8_t *p, const uint8_t *end, response_t *resp) {
+    field_t f, sub;
+
+    while (p < end) {
+        if (next_field(&p, end, &f) < 0)
+            return -1;
+
+        switch (f.number) {
+        case RESP_TYPE: resp->type = f.value; break;
+        case RESP_SUCCESS: resp->success = f.value != 0; break;
+        case RESP_ERRNO: resp->cr_errno = (int)f.value; break;
+        case RESP_ERRMSG:
+            if (f.bytes)
+                snprintf(resp->errmsg, sizeof(resp->errmsg), "%.*s", (int)f.value, (const char *)f.bytes);
+            break;
+        case RESP_RESTORE:
+        case RESP_PS:
+            // Both carry the one number we want as a varint
+            for (const uint8_t *q = f.bytes, *q_end = q + f.value; f.bytes && q < q_end;) {
+                if (next_field(&q, q_end, &sub) < 0)
+                    return -1;
+                if (sub.wire_type != 0)
+                    continue;
+                if (f.number == RESP_RESTORE && sub.number == RESTORE_PID)
+                    resp->restored = sub.value;
+                if (f.number == RESP_PS && sub.number == PS_PORT)
+                    resp->port = sub.value;
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+// Wait for the answer to the request in flight, acknowledging the
+// notifications CRIU may send meanwhile. Returns 0 if the request succeeded.
+static int read_response(criu_session_t *s, response_t *resp) {
+    uint8_t buf[MAX_RPC_SIZE], ack[16];
+    int status = -1;
+
+    memset(resp, 0, sizeof(*resp));
+    while (s->pending) {
+        ssize_t n = recv(s->sock, buf, sizeof(buf), MSG_TRUNC);
+        if ((n < 0 && errno == EINTR) || (hung_up(n) && resend(s) == 0))
+            continue;
+        if (n <= 0 || (size_t)n > sizeof(buf) || parse_response(buf, buf + n, resp) < 0) {
+            fprintf(stderr, "CRIU went away without answering\n");
+            s->last = 1;
+            break;
+        }
+        if (resp->type != REQ_NOTIFY) {
+            status = resp->success ? 0 : -1;
+            s->served++;
+            break;
+        }
+
+        pb_t reply = {.data = ack, .size = sizeof(ack)};
+        pb_uint(&reply, REQ_TYPE, REQ_NOTIFY);
+        pb_uint(&reply, REQ_NOTIFY_SUCCESS, 1);
+        if (send(s->sock, ack, reply.pos, MSG_NOSIGNAL) < 0) {
+            s->last = 1;
+            break;
+        }
+    }
+
+    s->pending = 0;
+    close_dir(s);
+    if (s->last)
+        stop_worker(s);
+    if (status < 0 && resp->errmsg[0])
+        fprintf(stderr, "CRIU: %s (errno %d)\n", resp->errmsg, resp->cr_errno);
+    return status;
+}
+
+static int listen_loopback(uint16_t *port) {
+    struct sockaddr_in addr = {.sin_family = AF_INET};
+    socklen_t len = sizeof(addr);
+
+    inet_pton(AF_INET, LOOPBACK, &addr.sin_addr);
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 1) < 0 ||
+        getsockname(sock, (struct sockaddr *)&addr, &len) < 0) {
+        close(sock);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return sock;
+}
+
+static int connect_loopback(uint16_t port) {
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port)};
+
+    inet_pton(AF_INET, LOOPBACK, &addr.sin_addr);
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Take CRIU's page-server connection, unless it answers first: then the dump
+// failed before it got that far
+static int accept_page_client(criu_session_t *s, int listener) {
+    struct pollfd fds[2] = {{.fd = listener, .events = POLLIN}};
+    char byte;
+
+    for (;;) {
+        fds[1].fd = s->sock;
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (fds[0].revents & POLLIN) {
+            s->seen = 1;
+            return accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        }
+        ssize_t n = recv(s->sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (!hung_up(n) || resend(s) < 0)
+            return -1;
+    }
+}
+
+int criu_dump_start(criu_session_t *s, pid_t pid, const char *dir, const criu_dump_opts_t *opts) {
+    uint8_t buf[MAX_RPC_SIZE], ps_buf[64];
+    pb_t o = {.data = buf, .size = sizeof(buf)};
+    pb_t ps = {.data = ps_buf, .size = sizeof(ps_buf)};
+    int listener = -1, conn = 0;
+    uint16_t port;
+
+    if (begin_opts(s, &o, dir, "dump.log") < 0)
+        return -1;
+    pb_uint(&o, OPT_PID, pid);
+    pb_uint(&o, OPT_SHELL_JOB, 1);
+    pb_uint(&o, OPT_UNPRIVILEGED, 1);
+    if (opts->leave_stopped)
+        pb_uint(&o, OPT_LEAVE_STOPPED, 1);
+    if (opts->track_mem)
+        pb_uint(&o, OPT_TRACK_MEM, 1);
+    if (opts->prev_images_dir)
+        pb_string(&o, OPT_PARENT_IMG, opts->prev_images_dir);
+
+    // CRIU connects to us as to a page server; only the rest of the image is written to dir
+    if (opts->page_server) {
+        listener = listen_loopback(&port);
+        if (listener < 0) {
+            perror("Failed to listen for CRIU's pages");
+            close_dir(s);
+            return -1;
+        }
+        pb_string(&ps, PS_ADDRESS, LOOPBACK);
+        pb_uint(&ps, PS_PORT, port);
+        pb_bytes(&o, OPT_PS, ps.data, ps.pos);
+    }
+
+    // A pre-dump runs in a child of the worker, which then takes the next round
+    if (request(s, opts->pre_dump ? REQ_SINGLE_PRE_DUMP : REQ_DUMP, &o, opts->pre_dump) < 0)
+        conn = -1;
+    else if (listener >= 0)
+        conn = accept_page_client(s, listener);
+    if (listener >= 0)
+        close(listener);
+    return conn;
+}
+
+int criu_dump_finish(criu_session_t *s, const char *dir, criu_dump_stats_t *stats) {
+    response_t resp;
+
+    memset(stats, 0, sizeof(*stats));
+    if (read_response(s, &resp) < 0) {
+        fprintf(stderr, "Checkpointing failed. Ensure CRIU is configured correctly and the process is checkpointable (see %s/dump.log).\n", dir);
+        return -1;
+    }
+
+    criu_read_dump_stats(dir, stats);
+    return 0;
+}
+
+int criu_dump(criu_session_t *s, pid_t pid, const char *dir, criu_dump_stats_t *stats) {
+    criu_dump_opts_t opts = {0};
+
+    criu_dump_start(s, pid, dir, &opts);
+    return criu_dump_finish(s, dir, stats);
+}
+
+int criu_page_server(criu_session_t *s, const char *dir) {
+    uint8_t buf[MAX_RPC_SIZE], ps_buf[64];
+    pb_t o = {.data = buf, .size = sizeof(buf)};
+    pb_t ps = {.data = ps_buf, .size = sizeof(ps_buf)};
+    response_t resp;
+
+    if (begin_opts(s, &o, dir, "page-server.log") < 0)
+        return -1;
+
+    // Port 0 lets CRIU pick one; the answer says which
+    pb_string(&ps, PS_ADDRESS, LOOPBACK);
+    pb_uint(&ps, PS_PORT, 0);
+    pb_bytes(&o, OPT_PS, ps.data, ps.pos);
+
+    if (request(s, REQ_PAGE_SERVER, &o, 1) < 0 || read_response(s, &resp) < 0 || resp.port == 0) {
+        fprintf(stderr, "Failed to start a page server (see %s/page-server.log)\n", dir);
+        return -1;
+    }
+
+    int conn = connect_loopback(resp.port);
+    if (conn < 0)
+        perror("Failed to reach the page server");
+    return conn;
+}
+
+void criu_page_server_close(int conn) {
+    char buf[256];
+
+    shutdown(conn, SHUT_WR);
+    while (read(conn, buf, sizeof(buf)) > 0)
+        ;
+    close(conn);
+}
+
+int criu_restore(criu_session_t *s, const char *dir, pid_t *restored) {
+    uint8_t buf[MAX_RPC_SIZE];
+    pb_t o = {.data = buf, .size = sizeof(buf)};
+    response_t resp;
+
+    // The tree is restored as the worker's child, and outlives it detached from us
+    if (begin_opts(s, &o, dir, "restore.log") < 0)
+        return -1;
+    pb_uint(&o, OPT_SHELL_JOB, 1);
+    pb_uint(&o, OPT_UNPRIVILEGED, 1);
+
+    if (request(s, REQ_RESTORE, &o, 0) < 0 || read_response(s, &resp) < 0) {
+        fprintf(stderr, "Restoring failed. Ensure CRIU is configured correctly and the checkpoint exists (see %s/restore.log).\n", dir);
+        return -1;
+    }
+
+    if (restored)
+        *restored = resp.restored;
+    return 0;
+}
+
+// dump_stats_entry from CRIU's stats.proto; times are in microseconds
+static int parse_dump_entry(const uint8_t *p, const uint8_t *end, criu_dump_stats_t *stats) {
+    field_t f;
+
+    while (p < end) {
+        if (next_field(&p, end, &f) < 0)
+            return -1;
+        if (f.wire_type != 0)
+            continue;
+
+        switch (f.number) {
+        case 1: stats->freezing_us = f.value; break;
+        case 2: stats->frozen_us = f.value; break;
+        case 3: stats->memdump_us = f.value; break;
+        case 4: stats->memwrite_us = f.value; break;
+        case 5: stats->pages_scanned = f.value; break;
+        case 6: stats->pages_skipped_parent = f.value; break;
+        case 7: stats->pages_written = f.value; break;
+        }
+    }
+    return 0;
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// The image is the service magic, the stats magic, then one stats_entry
+// prefixed with its size, all in host (little-endian) order
+int criu_read_dump_stats(const char *dir, criu_dump_stats_t *stats) {
+    char path[4096];
+    uint8_t buf[MAX_STATS_SIZE];
+    field_t f;
+
+    memset(stats, 0, sizeof(*stats));
+    snprintf(path, sizeof(path), "%s/stats-dump", dir);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, buf, sizeof(buf));
+    close(fd);
+
+    const uint8_t *p = buf, *end = buf + (n > 0 ? n : 0);
+    if (end - p >= 4 && get_le32(p) == IMG_SERVICE_MAGIC)
+        p += 4;
+    if (end - p < 8 || get_le32(p) != STATS_MAGIC)
+        return -1;
+    uint32_t size = get_le32(p + 4);
+    p += 8;
+    if (size > (uint32_t)(end - p))
+        return -1;
+    end = p + size;
+
+    // stats_entry: field 1 is the dump_stats_entry
+    while (p < end) {
+        if (next_field(&p, end, &f) < 0)
+            return -1;
+        if (f.number == 1 && f.bytes)
+            return parse_dump_entry(f.bytes, f.bytes + f.value, stats);
+    }
+    return -1;
+}
@@ -0,0 +1,82 @@
+#ifndef CRIU_H
+#define CRIU_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define CRIU_BINARY "criu"
+#define CRIU_MAX_REQUEST 4096
+
+// How this node runs CRIU
+typedef struct {
+    const char *binary; // Program to run; CRIU_BINARY unless overridden
+} criu_t;
+
+// A CRIU RPC worker (criu swrk) taking one caller's requests in turn over a
+// socket. Pre-dumps and page servers keep the worker; a dump or a restore is
+// the last request it serves, and the next one starts another.
+typedef struct {
+    const criu_t *criu;
+    pid_t pid;   // -1 while no worker runs
+    int sock;    // SOCK_SEQPACKET to the worker
+    int served;  // Requests the worker answered
+    int dir_fd;  // Image directory of the request in flight, -1 if none
+    int pending; // A request was sent and its response not yet read
+    int seen;    // The worker is known to have taken it up
+    int last;    // The worker exits after answering the request in flight
+    uint8_t request[CRIU_MAX_REQUEST]; // The one in flight, kept to resend
+    size_t request_len;
+} criu_session_t;
+
+// From the stats-dump image CRIU leaves next to a dump; zero where it had none
+typedef struct {
+    uint64_t freezing_us; // Stopping the process tree
+    uint64_t frozen_us;   // Time the tree stayed stopped
+    uint64_t memdump_us;
+    uint64_t memwrite_us;
+    uint64_t pages_scanned;
+    uint64_t pages_skipped_parent;
+    uint64_t pages_written;
+} criu_dump_stats_t;
+
+typedef struct {
+    int page_server;    // Send pages down a connection handed to the caller, as to a page server, instead of writing them to the image directory
+    int leave_stopped;  // Keep the tree stopped after the dump instead of killing it
+    int pre_dump;       // Only copy memory, leaving the tree running
+    int track_mem;      // Start dirty tracking, so the next dump only takes pages written since
+    const char *prev_images_dir; // Images of the previous round, relative to the new ones; NULL for none
+} criu_dump_opts_t;
+
+void criu_init(criu_t *c, const char *binary);
+
+// A session starts its worker with its first request. Closing it waits for
+// the worker to exit.
+void criu_session_init(criu_session_t *s, const criu_t *c);
+void criu_session_close(criu_session_t *s);
+
+// Checkpoint the tree rooted at pid into dir, which must exist. CRIU kills
+// the tree once the dump is complete. Returns 0 on success, -1 on failure.
+int criu_dump(criu_session_t *s, pid_t pid, const char *dir, criu_dump_stats_t *stats);
+
+// The same in two steps and with options, so the caller can work while CRIU
+// runs. With opts->page_server, start returns the connection CRIU sends the
+// pages on once it made it, otherwise 0; -1 if the dump could not start or
+// failed first. Finish must follow either way.
+int criu_dump_start(criu_session_t *s, pid_t pid, const char *dir, const criu_dump_opts_t *opts);
+int criu_dump_finish(criu_session_t *s, const char *dir, criu_dump_stats_t *stats);
+
+// Start a page server writing into dir and return a connection to it, or -1.
+// It serves one dump, which ends the conversation with it.
+int criu_page_server(criu_session_t *s, const char *dir);
+
+// Hang up on a page server and wait until it wrote everything out
+void criu_page_server_close(int conn);
+
+// Restore the tree saved in dir, detached from us. Stores the restored root's
+// pid in *restored when asked to. Returns 0 on success, -1 on failure.
+int criu_restore(criu_session_t *s, const char *dir, pid_t *restored);
+
+// Parse dir/stats-dump. Returns -1 if it is missing or not understood.
+int criu_read_dump_stats(const char *dir, criu_dump_stats_t *stats);
+
+#endif // CRIU_H
@@ -0,0 +1,180 @@
+#include "job_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+static const char *state_names[] = {"queued", "dumping", "transferring", "restoring", "done", "failed"};
+
+static int is_log(const char *name) {
+    size_t len = strlen(name);
+    return len >= 4 && strcmp(name + len - 4, ".log") == 0;
+}
+
+// Remove everything inside the directory open as fd, CRIU's logs aside if
+// asked to, then close it
+static void empty_dir_fd(int fd, int keep_logs) {
+    DIR *d = fdopendir(fd);
+    struct dirent *entry;
+
+    if (!d) {
+        close(fd);
+        return;
+    }
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || (keep_logs && is_log(entry->d_name)))
+            continue;
+        if (unlinkat(dirfd(d), entry->d_name, 0) == 0 || errno != EISDIR)
+            continue;
+
+        // Each pre-copy round has a directory of its own
+        int sub = openat(dirfd(d), entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (sub >= 0)
+            empty_dir_fd(sub, keep_logs);
+        unlinkat(dirfd(d), entry->d_name, AT_REMOVEDIR); // Fails while logs are left in it
+    }
+    closedir(d);
+}
+
+static int empty_dir(const char *dir, int keep_logs) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        perror("Failed to open checkpoint directory");
+        return -1;
+    }
+    empty_dir_fd(fd, keep_logs);
+    return 0;
+}
+
+int job_prepare_dir(const char *dir) {
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+        perror("Failed to create checkpoint directory");
+        return -1;
+    }
+    return empty_dir(dir, 0);
+}
+
+job_t *job_create(const char *root) {
+    static uint32_t last_id;
+    job_t *job = calloc(1, sizeof(*job));
+
+    if (!job)
+        return NULL;
+    job->sock = -1;
+
+    // Another process sharing the image directory may hold ids of its own
+    for (int tries = 0; tries < 1000; tries++) {
+        job->id = __atomic_add_fetch(&last_id, 1, __ATOMIC_RELAXED);
+        snprintf(job->dir, sizeof(job->dir), "%s/%u", root, job->id);
+        if (mkdir(job->dir, 0700) == 0)
+            return job;
+        if (errno != EEXIST)
+            break;
+    }
+
+    perror("Failed to create a job directory");
+    free(job);
+    return NULL;
+}
+
+void job_destroy(job_t *job) {
+    // Images sit in tmpfs, so they hold as much memory as the process itself
+    int failed = job->state == JOB_FAILED;
+    if (empty_dir(job->dir, failed) == 0 && rmdir(job->dir) < 0 && !failed)
+        perror("Failed to remove a job directory");
+    if (job->sock >= 0)
+        close(job->sock);
+    free(job);
+}
+
+const char *job_state_name(job_state_t state) {
+    return state <= JOB_FAILED ? state_names[state] : "unknown";
+}
+
+void job_set_state(job_t *job, job_state_t state) {
+    if (state <= job->state)
+        return;
+    job->state = state;
+    printf("Job %u: %s\n", job->id, job_state_name(state));
+}
+
+static void *worker(void *arg) {
+    job_pool_t *pool = arg;
+    uint64_t one = 1;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->queued)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        job_t *job = pool->queued;
+        pool->queued = job->next;
+        if (!pool->queued)
+            pool->queued_tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->run(job);
+        if (job->state != JOB_DONE)
+            job_set_state(job, JOB_FAILED);
+
+        pthread_mutex_lock(&pool->lock);
+        job->next = pool->finished;
+        pool->finished = job;
+        pthread_mutex_unlock(&pool->lock);
+        if (write(pool->done_fd, &one, sizeof(one)) < 0)
+            perror("Failed to signal a finished job");
+    }
+    return NULL;
+}
+
+int job_pool_start(job_pool_t *pool, int workers, job_run_t run) {
+    pthread_t thread;
+    int started = 0;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->run = run;
+    pool->done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (pool->done_fd < 0)
+        return -1;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+
+    // The workers live as long as the agent
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&thread, NULL, worker, pool) == 0 && pthread_detach(thread) == 0)
+            started++;
+    }
+    return started > 0 ? 0 : -1;
+}
+
+void job_pool_submit(job_pool_t *pool, job_t *job) {
+    printf("Job %u: %s\n", job->id, job_state_name(job->state));
+
+    pthread_mutex_lock(&pool->lock);
+    job->next = NULL;
+    if (pool->queued_tail)
+        pool->queued_tail->next = job;
+    else
+        pool->queued = job;
+    pool->queued_tail = job;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+job_t *job_pool_reap(job_pool_t *pool) {
+    uint64_t count;
+
+    pthread_mutex_lock(&pool->lock);
+    job_t *job = pool->finished;
+    if (job)
+        pool->finished = job->next;
+    else if (read(pool->done_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("Failed to read finished jobs");
+    pthread_mutex_unlock(&pool->lock);
+    return job;
+}
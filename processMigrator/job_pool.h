@@ -0,0 +1,63 @@
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "migration_protocol.h"
+
+#define MAX_JOB_DIR 4096
+
+typedef enum {
+    JOB_QUEUED,
+    JOB_DUMPING,      // Source: pre-dumps and the final dump, pages streaming meanwhile
+    JOB_TRANSFERRING, // Source: sending the remaining files; target: taking pages and files
+    JOB_RESTORING,    // Source: waiting for the target's restore; target: running it
+    JOB_DONE,
+    JOB_FAILED,
+} job_state_t;
+
+// One migration through this node, in either direction
+typedef struct job {
+    struct job *next; // In its pool's queue or finished list
+    uint32_t id;      // Unique among the jobs using the same image directory
+    job_state_t state; // Only moves forward
+    char dir[MAX_JOB_DIR]; // This job's images and CRIU logs
+    migrate_order_t order; // Outgoing: what to move
+    migrate_result_t result;
+    int sock; // Incoming: the source's connection; -1 otherwise
+} job_t;
+
+// Create a job in state QUEUED, with an empty directory of its own under root.
+// Returns NULL on failure.
+job_t *job_create(const char *root);
+
+// Remove the job's directory and free it. A failed job leaves its CRIU logs.
+void job_destroy(job_t *job);
+
+void job_set_state(job_t *job, job_state_t state);
+const char *job_state_name(job_state_t state);
+
+// Create dir if needed and empty it of what an earlier run left behind
+int job_prepare_dir(const char *dir);
+
+typedef void (*job_run_t)(job_t *job);
+
+// A fixed number of threads running submitted jobs in order. Finished jobs
+// are handed back through job_pool_reap, with done_fd readable while any wait.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    job_t *queued, *queued_tail;
+    job_t *finished;
+    int done_fd;
+    job_run_t run;
+} job_pool_t;
+
+// Returns 0 once at least one worker runs, -1 otherwise
+int job_pool_start(job_pool_t *pool, int workers, job_run_t run);
+void job_pool_submit(job_pool_t *pool, job_t *job);
+
+// Take a finished job, or NULL if there is none
+job_t *job_pool_reap(job_pool_t *pool);
+
+#endif // JOB_POOL_H
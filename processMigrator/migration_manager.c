@@ -1,53 +1,383 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include "migration_protocol.h"
+#include "migration_planner.h"
 
 #define PORT 5000
-#define THRESHOLD 80.0 // CPU or memory usage threshold for migration
+#define SCHEDULE_INTERVAL_MS 2000 // How often the scheduler looks for migrations
+#define MAX_EVENTS 256
+#define INITIAL_BUFFER 4096 // Grown up to one maximum-size frame for agents that need it
+#define MAX_OUTPUT (1024 * 1024) // Agents that stop reading are dropped past this
 
-void handle_client(int client_sock) {
-    char buffer[128];
-    int bytes_read;
+// One persistent agent connection. Frames are handled as soon as they are
+// complete; a partial frame waits here for the rest of its bytes. Orders the
+// socket did not take at once wait in out until it is writable again.
+typedef struct connection {
+    int fd;
+    int role;
+    char addr[INET_ADDRSTRLEN];
+    node_state_t *node; // From the agent's HELLO; keyed by its address until then
+    uint8_t *buffer;
+    size_t len;
+    size_t capacity;
+    uint8_t *out;
+    size_t out_len;
+} connection_t;
 
-    // Receive data from the client
-    bytes_read = recv(client_sock, buffer, sizeof(buffer) - 1, 0);
-    if (bytes_read < 0) {
-        perror("Failed to receive data");
-        close(client_sock);
+static node_report_t report; // Decoded into here, then kept in the node's state
+static cluster_t cluster;
+
+static int epoll_fd;
+static int server_sock;
+static int timer_fd;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+// Each agent holds a descriptor for as long as it runs, so allow as many as the hard limit does
+static void raise_fd_limit(void) {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Find the node an agent speaks for and register the connection with it
+static node_state_t *attach_node(connection_t *conn, const char *node_id, int role) {
+    node_state_t *node = cluster_node(&cluster, node_id);
+    if (!node)
+        return NULL;
+
+    conn->node = node;
+    conn->role = role;
+    if (role == ROLE_EXECUTOR)
+        node->executor = conn;
+    else
+        node->monitor = conn;
+    return node;
+}
+
+// Decisions are left to the scheduler; a report only refreshes the node's state
+static void handle_report(connection_t *conn, const node_report_t *report) {
+    node_state_t *node = conn->node;
+
+    // An agent that never said HELLO is known by its address
+    if (!node && !(node = attach_node(conn, conn->addr, ROLE_MONITOR)))
         return;
+
+    printf("Received from %s (%s): CPU %.2f%%, Memory %.2f%%, %d cores, %d candidate processes\n",
+           node->node_id, conn->addr, report->cpu_usage, report->memory_usage,
+           report->num_cores, report->num_procs);
+
+    node->report = *report;
+    node->has_report = 1;
+    node->report_ms = now_ms();
+}
+
+static void handle_hello(connection_t *conn, const hello_t *hello, int version) {
+    int role = hello->role == ROLE_EXECUTOR ? ROLE_EXECUTOR : ROLE_MONITOR;
+    node_state_t *node = attach_node(conn, hello->node_id, role);
+    if (!node)
+        return;
+
+    // Peers stream images to the executor at the address it reached us from
+    if (role == ROLE_EXECUTOR) {
+        snprintf(node->executor_address, sizeof(node->executor_address), "%s", conn->addr);
+        node->executor_port = hello->port;
+    }
+
+    printf("%s for %s connected from %s (protocol v%d)\n", role == ROLE_EXECUTOR ? "Executor" : "Monitor",
+           node->node_id, conn->addr, version);
+}
+
+static void handle_result(connection_t *conn, const migrate_result_t *result) {
+    static const char *failure[] = {"", "dump failed", "transfer failed", "restore failed"};
+    const char *node_id = conn->node ? conn->node->node_id : conn->addr;
+
+    if (result->status == MIGRATE_OK) {
+        printf("Order #%u done: pid %u left %s; downtime %.1f ms (freeze %.1f ms, dump %.1f ms, transfer %.1f ms, restore %.1f ms), %llu bytes in %d rounds\n",
+               result->order_id, result->pid, node_id, result->downtime_us / 1000.0, result->freeze_us / 1000.0,
+               result->dump_us / 1000.0, result->transfer_us / 1000.0, result->restore_us / 1000.0,
+               (unsigned long long)result->bytes, result->num_rounds);
+        for (int i = 0; i < result->num_rounds; i++) {
+            const precopy_round_t *r = &result->rounds[i];
+            printf("  Round %d: %llu bytes in %.1f ms, stopped for %.1f ms", i + 1, (unsigned long long)r->bytes,
+                   r->duration_us / 1000.0, r->downtime_us / 1000.0);
+            if (r->pages > 0)
+                printf("; %llu of %llu pages were on the target", (unsigned long long)r->pages_known,
+                       (unsigned long long)r->pages);
+            printf("\n");
+        }
+    } else {
+        printf("Order #%u failed: pid %u stays on %s (%s)\n", result->order_id, result->pid, node_id,
+               result->status <= MIGRATE_RESTORE_FAILED ? failure[result->status] : "unknown error");
+    }
+}
+
+static void close_connection(connection_t *conn) {
+    if (conn->node && conn->node->monitor == conn)
+        conn->node->monitor = NULL;
+    if (conn->node && conn->node->executor == conn)
+        conn->node->executor = NULL;
+
+    // Closing the descriptor also removes it from the epoll set
+    close(conn->fd);
+    free(conn->buffer);
+    free(conn->out);
+    free(conn);
+}
+
+// Write as much queued output as the socket takes. Returns -1 if the connection failed.
+static int flush_connection(connection_t *conn) {
+    size_t sent = 0;
+
+    while (sent < conn->out_len) {
+        ssize_t n = send(conn->fd, conn->out + sent, conn->out_len - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return -1;
+        }
+        sent += n;
+    }
+
+    conn->out_len -= sent;
+    memmove(conn->out, conn->out + sent, conn->out_len);
+    return 0;
+}
+
+// Queue a frame behind anything still unsent and start writing it. Returns -1
+// if the agent has to be dropped; the event loop then closes it.
+static int send_frame(connection_t *conn, const uint8_t *frame, size_t len) {
+    uint8_t *out = NULL;
+
+    if (conn->out_len + len <= MAX_OUTPUT)
+        out = realloc(conn->out, conn->out_len + len);
+    if (!out) {
+        shutdown(conn->fd, SHUT_RDWR);
+        return -1;
+    }
+
+    memcpy(out + conn->out_len, frame, len);
+    conn->out = out;
+    conn->out_len += len;
+    if (flush_connection(conn) < 0) {
+        shutdown(conn->fd, SHUT_RDWR);
+        return -1;
+    }
+    return 0;
+}
+
+// Act on one complete frame. Returns -1 if the agent broke the protocol.
+static int handle_frame(connection_t *conn, const frame_header_t *header, const uint8_t *payload) {
+    hello_t hello;
+    migrate_result_t result;
+
+    switch (header->type) {
+    case MSG_HELLO:
+        if (protocol_decode_hello(payload, header->length, &hello) < 0)
+            return -1;
+        handle_hello(conn, &hello, header->version);
+        return 0;
+
+    case MSG_REPORT:
+        if (protocol_decode_report(payload, header->length, &report) < 0)
+            return -1;
+        handle_report(conn, &report);
+        return 0;
+
+    case MSG_RESULT:
+        if (protocol_decode_result(payload, header->length, &result) < 0)
+            return -1;
+        handle_result(conn, &result);
+        return 0;
+
+    default:
+        // A newer agent may send messages we have no use for
+        return 0;
+    }
+}
+
+// Handle every complete frame in the buffer and keep the remainder.
+// Returns -1 if the stream cannot be parsed.
+static int process_buffer(connection_t *conn) {
+    size_t start = 0;
+    frame_header_t header;
+    int status;
+
+    while ((status = protocol_decode_header(conn->buffer + start, conn->len - start, &header)) > 0) {
+        if (handle_frame(conn, &header, conn->buffer + start + PROTOCOL_HEADER_SIZE) < 0) {
+            fprintf(stderr, "Malformed frame (type %d) from %s\n", header.type, conn->addr);
+            return -1;
+        }
+        start += PROTOCOL_HEADER_SIZE + header.length;
     }
 
-    buffer[bytes_read] = '\0';
-    printf("Received: %s\n", buffer);
+    if (status < 0) {
+        fprintf(stderr, "Garbage on connection from %s\n", conn->addr);
+        return -1;
+    }
 
-    // Parse resource usage
-    float cpu_usage, memory_usage;
-    sscanf(buffer, "CPU: %f, Memory: %f", &cpu_usage, &memory_usage);
+    conn->len -= start;
+    memmove(conn->buffer, conn->buffer + start, conn->len);
 
-    // Decide if migration is needed
-    if (cpu_usage > THRESHOLD || memory_usage > THRESHOLD) {
-        printf("Node is overloaded. Triggering migration.\n");
-        // Add migration logic here
+    // Make sure the frame being received fits once it is complete
+    size_t needed = conn->len >= PROTOCOL_HEADER_SIZE ? PROTOCOL_HEADER_SIZE + header.length : INITIAL_BUFFER;
+    if (needed > conn->capacity) {
+        uint8_t *grown = realloc(conn->buffer, needed);
+        if (!grown)
+            return -1;
+        conn->buffer = grown;
+        conn->capacity = needed;
     }
+    return 0;
+}
+
+// Drain the socket. Returns -1 once the connection should be closed.
+static int read_connection(connection_t *conn) {
+    for (;;) {
+        ssize_t n = recv(conn->fd, conn->buffer + conn->len, conn->capacity - conn->len, 0);
+        if (n > 0) {
+            conn->len += n;
+            if (process_buffer(conn) < 0)
+                return -1;
+            continue;
+        }
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if (n < 0 && errno == EINTR)
+            continue;
 
-    close(client_sock);
+        if (n < 0)
+            fprintf(stderr, "Failed to receive from %s: %s\n", conn->addr, strerror(errno));
+        else
+            printf("Agent %s (%s) disconnected\n", conn->node ? conn->node->node_id : conn->addr, conn->addr);
+        return -1;
+    }
+}
+
+static void accept_connections(void) {
+    for (;;) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+
+        int client_sock = accept4(server_sock, (struct sockaddr *)&client_addr, &client_len,
+                                  SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("Accept failed");
+            return;
+        }
+
+        // Notice agents whose host died without closing the connection
+        int on = 1;
+        setsockopt(client_sock, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+
+        connection_t *conn = calloc(1, sizeof(*conn));
+        if (conn) {
+            conn->capacity = INITIAL_BUFFER;
+            conn->buffer = malloc(conn->capacity);
+        }
+        if (!conn || !conn->buffer) {
+            free(conn);
+            fprintf(stderr, "Out of memory; refusing agent\n");
+            close(client_sock);
+            continue;
+        }
+        conn->fd = client_sock;
+        inet_ntop(AF_INET, &client_addr.sin_addr, conn->addr, sizeof(conn->addr));
+
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = conn};
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_sock, &ev) < 0) {
+            perror("Failed to watch agent connection");
+            close_connection(conn);
+        }
+    }
+}
+
+// Hand one planned move to the executor on its source node
+static void dispatch(const planned_migration_t *move) {
+    node_state_t *source = move->source, *target = move->target;
+    uint8_t frame[PROTOCOL_HEADER_SIZE + sizeof(migrate_order_t) + 16];
+
+    printf("Plan #%u: move %s (pid %u, CPU %.1f%%, RSS %llu kB) from %s to %s; relief %.1f points, ~%.1fs\n",
+           move->order_id, move->proc.name, move->proc.pid, move->proc.cpu_usage,
+           (unsigned long long)move->proc.rss_kb, source->node_id, target->node_id, move->relief,
+           move->cost_seconds);
+
+    if (!source->executor || !target->executor || target->executor_port == 0) {
+        printf("Plan #%u not dispatched: no executor on %s\n", move->order_id,
+               source->executor ? target->node_id : source->node_id);
+        return;
+    }
+
+    migrate_order_t order = {.order_id = move->order_id, .pid = move->proc.pid,
+                             .target_port = target->executor_port};
+    snprintf(order.target_address, sizeof(order.target_address), "%s", target->executor_address);
+    snprintf(order.target_node, sizeof(order.target_node), "%s", target->node_id);
+
+    size_t len = protocol_encode_migrate(frame, sizeof(frame), &order);
+    if (len == 0 || send_frame(source->executor, frame, len) < 0)
+        fprintf(stderr, "Failed to send plan #%u to %s\n", move->order_id, source->node_id);
+}
+
+// Runs on its own clock, so a quiet cluster is still rebalanced and a burst of
+// reports does not trigger a burst of decisions
+static void run_scheduler(void) {
+    static migration_plan_t plan;
+    uint64_t expirations;
+
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+        return;
+
+    cluster_plan(&cluster, now_ms(), &plan);
+    for (int i = 0; i < plan.count; i++)
+        dispatch(&plan.moves[i]);
 }
 
 int main() {
-    int server_sock, client_sock;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_len = sizeof(client_addr);
+    struct sockaddr_in server_addr;
+    struct epoll_event events[MAX_EVENTS];
+
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0); // Keep the log current when redirected to a file
+    raise_fd_limit();
 
     // Create socket
-    server_sock = socket(AF_INET, SOCK_STREAM, 0);
+    server_sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (server_sock < 0) {
         perror("Socket creation failed");
         exit(1);
     }
 
+    int on = 1;
+    setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
     // Configure server address
+    memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(PORT);
     server_addr.sin_addr.s_addr = INADDR_ANY;
@@ -59,26 +389,74 @@ int main() {
         exit(1);
     }
 
-    // Listen for connections
-    if (listen(server_sock, 5) < 0) {
+    // Listen for connections; a whole cluster may reconnect at once after a restart
+    if (listen(server_sock, SOMAXCONN) < 0) {
         perror("Listen failed");
         close(server_sock);
         exit(1);
     }
 
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        close(server_sock);
+        exit(1);
+    }
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec interval = {
+        .it_interval = {SCHEDULE_INTERVAL_MS / 1000, SCHEDULE_INTERVAL_MS % 1000 * 1000000L},
+        .it_value = {SCHEDULE_INTERVAL_MS / 1000, SCHEDULE_INTERVAL_MS % 1000 * 1000000L},
+    };
+    if (timer_fd < 0 || timerfd_settime(timer_fd, 0, &interval, NULL) < 0) {
+        perror("Failed to start the scheduler timer");
+        exit(1);
+    }
+
+    // Agents are tagged with their connection, the listening socket and the
+    // timer with the address of their descriptor
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &server_sock};
+    struct epoll_event timer_ev = {.events = EPOLLIN, .data.ptr = &timer_fd};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_sock, &ev) < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &timer_ev) < 0) {
+        perror("Failed to watch listening socket");
+        exit(1);
+    }
+
     printf("Migration Manager is running on port %d...\n", PORT);
 
-    // Accept and handle clients
+    // Serve every agent from one loop; no read or write ever blocks
     while (1) {
-        client_sock = accept(server_sock, (struct sockaddr *)&client_addr, &client_len);
-        if (client_sock < 0) {
-            perror("Accept failed");
-            continue;
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait failed");
+            break;
         }
 
-        handle_client(client_sock);
+        for (int i = 0; i < n; i++) {
+            void *tag = events[i].data.ptr;
+
+            if (tag == &server_sock) {
+                accept_connections();
+                continue;
+            }
+            if (tag == &timer_fd) {
+                run_scheduler();
+                continue;
+            }
+
+            connection_t *conn = tag;
+            if (events[i].events & EPOLLERR ||
+                (events[i].events & EPOLLOUT && flush_connection(conn) < 0) ||
+                (events[i].events & (EPOLLIN | EPOLLRDHUP) && read_connection(conn) < 0))
+                close_connection(conn);
+        }
     }
 
+    close(timer_fd);
+    close(epoll_fd);
     close(server_sock);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,224 @@
+#include "migration_planner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SOURCES_PER_ROUND (MAX_PLAN * 4) // Bounds the work when much of the cluster is hot
+
+// A node's usage as it will be once this round's moves have happened
+typedef struct {
+    node_state_t *node;
+    double cpu;
+    double mem;
+    int used; // Already receives a process this round
+} projected_t;
+
+static unsigned int bucket_of(const char *node_id) {
+    unsigned int hash = 2166136261u;
+    for (const char *p = node_id; *p; p++)
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    return hash % CLUSTER_BUCKETS;
+}
+
+node_state_t *cluster_node(cluster_t *c, const char *node_id) {
+    unsigned int bucket = bucket_of(node_id);
+
+    for (node_state_t *n = c->buckets[bucket]; n; n = n->next) {
+        if (strcmp(n->node_id, node_id) == 0)
+            return n;
+    }
+
+    if (c->num_nodes == c->capacity) {
+        int capacity = c->capacity ? c->capacity * 2 : 64;
+        node_state_t **nodes = realloc(c->nodes, capacity * sizeof(*nodes));
+        if (!nodes)
+            return NULL;
+        c->nodes = nodes;
+        c->capacity = capacity;
+    }
+
+    node_state_t *n = calloc(1, sizeof(*n));
+    if (!n)
+        return NULL;
+    snprintf(n->node_id, sizeof(n->node_id), "%s", node_id);
+    n->next = c->buckets[bucket];
+    c->buckets[bucket] = n;
+    c->nodes[c->num_nodes++] = n;
+    return n;
+}
+
+static double cores_of(const node_report_t *r) {
+    return r->num_cores > 0 ? r->num_cores : 1;
+}
+
+static double memory_share(const proc_report_t *p, const node_report_t *r) {
+    return r->mem_total_kb > 0 ? p->rss_kb * 100.0 / r->mem_total_kb : 0.0;
+}
+
+static int recently_moved(const cluster_t *c, const char *node_id, uint32_t pid, long long now_ms) {
+    for (int i = 0; i < MAX_RECENT_MOVES; i++) {
+        const recent_move_t *m = &c->recent[i];
+        if (m->pid == pid && m->until > now_ms && strcmp(m->node_id, node_id) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// Seconds to copy the resident set, plus what it dirties while that copy runs
+static double migration_cost(const proc_report_t *p) {
+    double rss_mb = p->rss_kb / 1024.0;
+    double copy = rss_mb / TRANSFER_MB_PER_SEC;
+    double dirtied_mb = p->dirty_kb_per_sec / 1024.0 * copy;
+    return (rss_mb + dirtied_mb) / TRANSFER_MB_PER_SEC;
+}
+
+static int by_severity(const void *a, const void *b) {
+    const projected_t *x = *(const projected_t *const *)a, *y = *(const projected_t *const *)b;
+    double sx = x->cpu > x->mem ? x->cpu : x->mem;
+    double sy = y->cpu > y->mem ? y->cpu : y->mem;
+    return sx < sy ? 1 : sx > sy ? -1 : 0;
+}
+
+static int planned(const migration_plan_t *plan, const node_state_t *source, uint32_t pid) {
+    for (int i = 0; i < plan->count; i++) {
+        if (plan->moves[i].source == source && plan->moves[i].proc.pid == pid)
+            return 1;
+    }
+    return 0;
+}
+
+static int overloaded(const projected_t *n) {
+    return n->cpu > HIGH_WATERMARK || n->mem > HIGH_WATERMARK;
+}
+
+// Best move off one source, or 0 if none is worth it
+static int best_move(const cluster_t *c, projected_t *source, projected_t **targets, int num_targets,
+                     long long now_ms, const migration_plan_t *plan, planned_migration_t *move, projected_t **chosen) {
+    const node_report_t *r = &source->node->report;
+    double best_score = 0.0;
+
+    for (int i = 0; i < r->num_procs; i++) {
+        const proc_report_t *p = &r->procs[i];
+        if (recently_moved(c, source->node->node_id, p->pid, now_ms) || planned(plan, source->node, p->pid))
+            continue;
+
+        // Only the resource the node is short of counts as relief
+        double cpu_relief = p->cpu_usage / cores_of(r);
+        double mem_relief = memory_share(p, r);
+        double relief = 0.0;
+        if (source->cpu > HIGH_WATERMARK && cpu_relief > relief)
+            relief = cpu_relief;
+        if (source->mem > HIGH_WATERMARK && mem_relief > relief)
+            relief = mem_relief;
+
+        double cost = migration_cost(p);
+        double score = relief / (1.0 + cost);
+        if (relief < MIN_RELIEF || cost > MAX_COST_SECONDS || score <= best_score)
+            continue;
+
+        // The least loaded target that stays under the ceiling with the process added
+        projected_t *target = NULL;
+        double target_peak = TARGET_CEILING;
+        for (int t = 0; t < num_targets; t++) {
+            projected_t *candidate = targets[t];
+            if (candidate->used)
+                continue;
+
+            const node_report_t *tr = &candidate->node->report;
+            double cpu = candidate->cpu + p->cpu_usage / cores_of(tr);
+            double mem = candidate->mem + memory_share(p, tr);
+            double peak = cpu > mem ? cpu : mem;
+            if (peak < target_peak) {
+                target_peak = peak;
+                target = candidate;
+            }
+        }
+        if (!target)
+            continue;
+
+        best_score = score;
+        *chosen = target;
+        move->source = source->node;
+        move->target = target->node;
+        move->proc = *p;
+        move->relief = relief;
+        move->cost_seconds = cost;
+    }
+
+    return best_score > 0.0;
+}
+
+static void book_move(cluster_t *c, projected_t *source, projected_t *target, const planned_migration_t *move,
+                      long long now_ms) {
+    const proc_report_t *p = &move->proc;
+
+    source->cpu -= p->cpu_usage / cores_of(&source->node->report);
+    source->mem -= memory_share(p, &source->node->report);
+    target->cpu += p->cpu_usage / cores_of(&target->node->report);
+    target->mem += memory_share(p, &target->node->report);
+    source->used = target->used = 1;
+    source->node->cooldown_until = target->node->cooldown_until = now_ms + NODE_COOLDOWN_MS;
+
+    // CRIU restores the same pid, so the process is known by the target and its pid
+    recent_move_t *m = &c->recent[c->recent_next];
+    c->recent_next = (c->recent_next + 1) % MAX_RECENT_MOVES;
+    snprintf(m->node_id, sizeof(m->node_id), "%s", target->node->node_id);
+    m->pid = p->pid;
+    m->until = now_ms + PINGPONG_MS;
+}
+
+void cluster_plan(cluster_t *c, long long now_ms, migration_plan_t *plan) {
+    projected_t *state = malloc((c->num_nodes + 1) * sizeof(*state));
+    projected_t **sources = malloc((c->num_nodes + 1) * sizeof(*sources));
+    projected_t **targets = malloc((c->num_nodes + 1) * sizeof(*targets));
+    int num_sources = 0, num_targets = 0;
+
+    plan->count = 0;
+    if (!state || !sources || !targets)
+        goto out;
+
+    for (int i = 0; i < c->num_nodes; i++) {
+        node_state_t *n = c->nodes[i];
+        projected_t *s = &state[i];
+
+        // A move is only booked if both ends have an executor to carry it out
+        if (!n->monitor || !n->executor || n->executor_port == 0 || !n->has_report ||
+            now_ms - n->report_ms > REPORT_STALE_MS || n->cooldown_until > now_ms || n->report.cpu_usage < 0 ||
+            n->report.memory_usage < 0)
+            continue;
+
+        s->node = n;
+        s->cpu = n->report.cpu_usage;
+        s->mem = n->report.memory_usage;
+        s->used = 0;
+
+        if (overloaded(s))
+            sources[num_sources++] = s;
+        else if (s->cpu < LOW_WATERMARK && s->mem < LOW_WATERMARK)
+            targets[num_targets++] = s;
+    }
+
+    qsort(sources, num_sources, sizeof(*sources), by_severity);
+    if (num_sources > MAX_SOURCES_PER_ROUND)
+        num_sources = MAX_SOURCES_PER_ROUND;
+
+    for (int i = 0; i < num_sources && plan->count < MAX_PLAN; i++) {
+        for (int moves = 0; moves < MAX_MOVES_PER_SOURCE && plan->count < MAX_PLAN && overloaded(sources[i]); moves++) {
+            planned_migration_t *move = &plan->moves[plan->count];
+            projected_t *target = NULL;
+
+            if (!best_move(c, sources[i], targets, num_targets, now_ms, plan, move, &target))
+                break;
+
+            move->order_id = ++c->next_order_id;
+            book_move(c, sources[i], target, move, now_ms);
+            plan->count++;
+        }
+    }
+
+out:
+    free(state);
+    free(sources);
+    free(targets);
+}
@@ -0,0 +1,77 @@
+#ifndef MIGRATION_PLANNER_H
+#define MIGRATION_PLANNER_H
+
+#include "migration_protocol.h"
+
+#define CLUSTER_BUCKETS 4096
+#define MAX_PLAN 8             // Migrations started per scheduling round, cluster-wide
+#define MAX_MOVES_PER_SOURCE 4 // A node's executor runs its migrations in parallel
+#define MAX_RECENT_MOVES 1024
+
+#define HIGH_WATERMARK 80.0 // CPU or memory usage (%) above which a node sheds processes
+#define LOW_WATERMARK 50.0  // A node below this on both may take processes
+#define TARGET_CEILING 70.0 // A move may not push the target above this
+#define MIN_RELIEF 5.0      // Smallest drop in source usage (points) worth a migration
+#define MAX_COST_SECONDS 60.0
+#define TRANSFER_MB_PER_SEC 100.0 // Assumed network throughput between nodes
+#define REPORT_STALE_MS 15000     // Nodes silent for longer are left out of planning
+#define NODE_COOLDOWN_MS 60000    // Pause after a node sent or received a process
+#define PINGPONG_MS 600000        // A moved process stays put at least this long
+
+// Everything the manager knows about one node
+typedef struct node_state {
+    struct node_state *next; // Hash chain
+    char node_id[MAX_NODE_ID];
+    void *monitor;  // Connections, opaque to the planner; NULL while absent
+    void *executor;
+    char executor_address[MAX_ADDRESS];
+    uint16_t executor_port;
+    int has_report;
+    long long report_ms; // Monotonic time the last report arrived
+    node_report_t report;
+    long long cooldown_until;
+} node_state_t;
+
+typedef struct {
+    uint32_t order_id;
+    node_state_t *source;
+    node_state_t *target;
+    proc_report_t proc;
+    float relief;       // Expected drop of the source's usage, in points
+    float cost_seconds; // Expected transfer time
+} planned_migration_t;
+
+typedef struct {
+    int count;
+    planned_migration_t moves[MAX_PLAN];
+} migration_plan_t;
+
+typedef struct {
+    char node_id[MAX_NODE_ID]; // Where the process now lives
+    uint32_t pid;
+    long long until;
+} recent_move_t;
+
+typedef struct {
+    node_state_t *buckets[CLUSTER_BUCKETS];
+    node_state_t **nodes; // Every node, for the scheduler's scans
+    int num_nodes;
+    int capacity;
+    recent_move_t recent[MAX_RECENT_MOVES]; // Ring of the latest moves
+    int recent_next;
+    uint32_t next_order_id;
+} cluster_t;
+
+// Find a node by id, adding it on first sight. Returns NULL when out of memory.
+node_state_t *cluster_node(cluster_t *c, const char *node_id);
+
+// Pick the migrations to start now, among nodes with a fresh report and an
+// executor to carry them out. Overloaded nodes are relieved in order of
+// severity; for each, the candidate process with the best relief per second of
+// transfer goes to the least loaded node that can absorb it, and so on while
+// the node is still projected over the watermark. Chosen moves are
+// booked right away (cooldowns and the ping-pong guard), and later choices in
+// the same round see their projected effect.
+void cluster_plan(cluster_t *c, long long now_ms, migration_plan_t *plan);
+
+#endif // MIGRATION_PLANNER_H
@@ -0,0 +1,429 @@
+#include "migration_protocol.h"
+
+#include <math.h>
+#include <string.h>
+
+// Bounded cursor over a frame. Running off either end sets failed instead of
+// touching memory outside the buffer, so callers check once at the end.
+typedef struct {
+    uint8_t *data;
+    const uint8_t *in;
+    size_t size;
+    size_t pos;
+    int failed;
+} cursor_t;
+
+static void put_uint(cursor_t *c, uint64_t value, int bytes) {
+    if (c->failed || c->size - c->pos < (size_t)bytes) {
+        c->failed = 1;
+        return;
+    }
+    for (int i = bytes - 1; i >= 0; i--)
+        c->data[c->pos++] = (uint8_t)(value >> (8 * i));
+}
+
+static void put_string(cursor_t *c, const char *s, size_t max) {
+    size_t len = strnlen(s, max - 1);
+
+    put_uint(c, len, 1);
+    if (c->failed || c->size - c->pos < len) {
+        c->failed = 1;
+        return;
+    }
+    memcpy(c->data + c->pos, s, len);
+    c->pos += len;
+}
+
+static void put_bytes(cursor_t *c, const void *data, size_t len) {
+    if (c->failed || c->size - c->pos < len) {
+        c->failed = 1;
+        return;
+    }
+    memcpy(c->data + c->pos, data, len);
+    c->pos += len;
+}
+
+// Percentages and other small fractions as hundredths (up to 4 bytes); unknown values as all ones
+static void put_fraction(cursor_t *c, float value, int bytes) {
+    uint64_t max = (1ull << (8 * bytes)) - 1;
+    uint64_t encoded = max;
+
+    if (value >= 0.0f && !isnan(value)) {
+        double scaled = round(value * 100.0);
+        encoded = scaled >= (double)(max - 1) ? max - 1 : (uint64_t)scaled;
+    }
+    put_uint(c, encoded, bytes);
+}
+
+static uint64_t get_uint(cursor_t *c, int bytes) {
+    uint64_t value = 0;
+
+    if (c->failed || c->size - c->pos < (size_t)bytes) {
+        c->failed = 1;
+        return 0;
+    }
+    for (int i = 0; i < bytes; i++)
+        value = value << 8 | c->in[c->pos++];
+    return value;
+}
+
+static void get_string(cursor_t *c, char *out, size_t max) {
+    size_t len = get_uint(c, 1);
+
+    if (c->failed || c->size - c->pos < len || len >= max) {
+        c->failed = 1;
+        out[0] = '\0';
+        return;
+    }
+    memcpy(out, c->in + c->pos, len);
+    out[len] = '\0';
+    c->pos += len;
+}
+
+// Returns where the bytes are in the payload, or NULL past its end
+static const uint8_t *get_bytes(cursor_t *c, size_t len) {
+    if (c->failed || c->size - c->pos < len) {
+        c->failed = 1;
+        return NULL;
+    }
+    c->pos += len;
+    return c->in + c->pos - len;
+}
+
+static float get_fraction(cursor_t *c, int bytes) {
+    uint64_t max = (1ull << (8 * bytes)) - 1;
+    uint64_t value = get_uint(c, bytes);
+
+    return value == max ? PROTOCOL_UNKNOWN : value / 100.0f;
+}
+
+// Reserve the header; finish_frame fills it in once the payload length is known
+static cursor_t begin_frame(uint8_t *buf, size_t size) {
+    cursor_t c = {.data = buf, .size = size, .pos = PROTOCOL_HEADER_SIZE};
+
+    if (size < PROTOCOL_HEADER_SIZE)
+        c.failed = 1;
+    return c;
+}
+
+// Also used on its own for frames whose payload the caller sends itself
+size_t protocol_encode_header(uint8_t *buf, size_t size, message_type_t type, uint32_t length) {
+    if (size < PROTOCOL_HEADER_SIZE || length > PROTOCOL_MAX_PAYLOAD)
+        return 0;
+
+    cursor_t header = {.data = buf, .size = PROTOCOL_HEADER_SIZE};
+    put_uint(&header, PROTOCOL_MAGIC, 2);
+    put_uint(&header, PROTOCOL_VERSION, 1);
+    put_uint(&header, type, 1);
+    put_uint(&header, length, 4);
+    return PROTOCOL_HEADER_SIZE;
+}
+
+static size_t finish_frame(cursor_t *c, message_type_t type) {
+    if (c->failed || protocol_encode_header(c->data, c->size, type, c->pos - PROTOCOL_HEADER_SIZE) == 0)
+        return 0;
+    return c->pos;
+}
+
+size_t protocol_encode_hello(uint8_t *buf, size_t size, const hello_t *hello) {
+    cursor_t c = begin_frame(buf, size);
+
+    put_uint(&c, hello->role, 1);
+    put_uint(&c, hello->port, 2);
+    put_string(&c, hello->node_id, MAX_NODE_ID);
+    return finish_frame(&c, MSG_HELLO);
+}
+
+size_t protocol_encode_report(uint8_t *buf, size_t size, const node_report_t *report) {
+    cursor_t c = begin_frame(buf, size);
+    int num_cores = report->num_cores > MAX_REPORT_CORES ? MAX_REPORT_CORES : report->num_cores;
+    int num_procs = report->num_procs > MAX_REPORT_PROCS ? MAX_REPORT_PROCS : report->num_procs;
+
+    put_uint(&c, report->timestamp_ms, 8);
+    put_fraction(&c, report->cpu_usage, 2);
+    put_fraction(&c, report->memory_usage, 2);
+    put_uint(&c, report->mem_total_kb, 8);
+    put_uint(&c, report->mem_available_kb, 8);
+    for (int i = 0; i < 3; i++)
+        put_fraction(&c, report->load_avg[i], 4);
+    for (int i = 0; i < PSI_COUNT; i++)
+        put_fraction(&c, report->psi[i], 2);
+
+    put_uint(&c, num_cores, 2);
+    for (int i = 0; i < num_cores; i++)
+        put_fraction(&c, report->core_load[i], 2);
+
+    put_uint(&c, num_procs, 1);
+    for (int i = 0; i < num_procs; i++) {
+        const proc_report_t *p = &report->procs[i];
+        put_uint(&c, p->pid, 4);
+        put_fraction(&c, p->cpu_usage, 4);
+        put_uint(&c, p->rss_kb, 8);
+        put_uint(&c, p->dirty_kb_per_sec, 4);
+        put_string(&c, p->name, MAX_PROC_NAME);
+    }
+
+    return finish_frame(&c, MSG_REPORT);
+}
+
+size_t protocol_encode_migrate(uint8_t *buf, size_t size, const migrate_order_t *order) {
+    cursor_t c = begin_frame(buf, size);
+
+    put_uint(&c, order->order_id, 4);
+    put_uint(&c, order->pid, 4);
+    put_uint(&c, order->target_port, 2);
+    put_string(&c, order->target_address, MAX_ADDRESS);
+    put_string(&c, order->target_node, MAX_NODE_ID);
+    return finish_frame(&c, MSG_MIGRATE);
+}
+
+// Serves both RESULT and RESTORED, which carry the same fields
+size_t protocol_encode_result(uint8_t *buf, size_t size, message_type_t type, const migrate_result_t *result) {
+    cursor_t c = begin_frame(buf, size);
+
+    put_uint(&c, result->order_id, 4);
+    put_uint(&c, result->pid, 4);
+    put_uint(&c, result->status, 1);
+    put_uint(&c, result->freeze_us, 8);
+    put_uint(&c, result->dump_us, 8);
+    put_uint(&c, result->transfer_us, 8);
+    put_uint(&c, result->restore_us, 8);
+    put_uint(&c, result->bytes, 8);
+    put_uint(&c, result->downtime_us, 8);
+
+    int num_rounds = result->num_rounds > MAX_PRECOPY_ROUNDS ? MAX_PRECOPY_ROUNDS : result->num_rounds;
+    put_uint(&c, num_rounds, 1);
+    for (int i = 0; i < num_rounds; i++) {
+        put_uint(&c, result->rounds[i].bytes, 8);
+        put_uint(&c, result->rounds[i].duration_us, 8);
+        put_uint(&c, result->rounds[i].downtime_us, 8);
+    }
+    for (int i = 0; i < num_rounds; i++) {
+        put_uint(&c, result->rounds[i].pages, 8);
+        put_uint(&c, result->rounds[i].pages_known, 8);
+    }
+    return finish_frame(&c, type);
+}
+
+size_t protocol_encode_image_file(uint8_t *buf, size_t size, const image_file_t *file) {
+    cursor_t c = begin_frame(buf, size);
+
+    put_string(&c, file->name, MAX_IMAGE_NAME);
+    put_uint(&c, file->size, 8);
+    return finish_frame(&c, MSG_IMAGE_FILE);
+}
+
+size_t protocol_encode_image_end(uint8_t *buf, size_t size, const image_end_t *end) {
+    cursor_t c = begin_frame(buf, size);
+
+    put_uint(&c, end->order_id, 4);
+    put_uint(&c, end->pid, 4);
+    return finish_frame(&c, MSG_IMAGE_END);
+}
+
+size_t protocol_encode_page_stream(uint8_t *buf, size_t size, const page_stream_t *stream) {
+    cursor_t c = begin_frame(buf, size);
+
+    put_uint(&c, stream->round, 4);
+    put_uint(&c, stream->final, 1);
+    put_uint(&c, stream->encoded, 1);
+    return finish_frame(&c, MSG_PAGE_STREAM);
+}
+
+size_t protocol_encode_page_hashes(uint8_t *buf, size_t size, const page_hashes_t *hashes) {
+    cursor_t c = begin_frame(buf, size);
+    int count = hashes->count > PAGE_BATCH_PAGES ? PAGE_BATCH_PAGES : hashes->count;
+
+    put_uint(&c, hashes->batch, 4);
+    put_uint(&c, count, 1);
+    for (int i = 0; i < count; i++)
+        put_bytes(&c, hashes->hash[i], PAGE_HASH_SIZE);
+    return finish_frame(&c, MSG_PAGE_HASHES);
+}
+
+size_t protocol_encode_page_want(uint8_t *buf, size_t size, const page_want_t *want) {
+    cursor_t c = begin_frame(buf, size);
+
+    put_uint(&c, want->batch, 4);
+    put_uint(&c, want->want, 1);
+    return finish_frame(&c, MSG_PAGE_WANT);
+}
+
+size_t protocol_encode_page_batch(uint8_t *buf, size_t size, const page_batch_t *batch) {
+    cursor_t c = begin_frame(buf, size);
+    int count = batch->count > PAGE_BATCH_PAGES ? PAGE_BATCH_PAGES : batch->count;
+
+    put_uint(&c, batch->batch, 4);
+    put_uint(&c, count, 1);
+    for (int i = 0; i < count; i++) {
+        put_uint(&c, batch->pages[i].codec, 1);
+        put_uint(&c, batch->pages[i].length, 2);
+        put_bytes(&c, batch->pages[i].data, batch->pages[i].length);
+    }
+    return finish_frame(&c, MSG_PAGE_BATCH);
+}
+
+int protocol_decode_header(const uint8_t *buf, size_t len, frame_header_t *header) {
+    if (len < PROTOCOL_HEADER_SIZE)
+        return 0;
+
+    cursor_t c = {.in = buf, .size = PROTOCOL_HEADER_SIZE};
+    header->magic = get_uint(&c, 2);
+    header->version = get_uint(&c, 1);
+    header->type = get_uint(&c, 1);
+    header->length = get_uint(&c, 4);
+
+    if (header->magic != PROTOCOL_MAGIC || header->length > PROTOCOL_MAX_PAYLOAD)
+        return -1;
+
+    return len - PROTOCOL_HEADER_SIZE >= header->length ? 1 : 0;
+}
+
+int protocol_decode_hello(const uint8_t *payload, size_t len, hello_t *hello) {
+    cursor_t c = {.in = payload, .size = len};
+
+    memset(hello, 0, sizeof(*hello));
+    hello->role = get_uint(&c, 1);
+    hello->port = get_uint(&c, 2);
+    get_string(&c, hello->node_id, MAX_NODE_ID);
+    return c.failed ? -1 : 0;
+}
+
+int protocol_decode_report(const uint8_t *payload, size_t len, node_report_t *report) {
+    cursor_t c = {.in = payload, .size = len};
+
+    report->timestamp_ms = get_uint(&c, 8);
+    report->cpu_usage = get_fraction(&c, 2);
+    report->memory_usage = get_fraction(&c, 2);
+    report->mem_total_kb = get_uint(&c, 8);
+    report->mem_available_kb = get_uint(&c, 8);
+    for (int i = 0; i < 3; i++)
+        report->load_avg[i] = get_fraction(&c, 4);
+    for (int i = 0; i < PSI_COUNT; i++)
+        report->psi[i] = get_fraction(&c, 2);
+
+    report->num_cores = get_uint(&c, 2);
+    if (report->num_cores > MAX_REPORT_CORES)
+        return -1;
+    for (int i = 0; i < report->num_cores; i++)
+        report->core_load[i] = get_fraction(&c, 2);
+
+    report->num_procs = get_uint(&c, 1);
+    if (report->num_procs > MAX_REPORT_PROCS)
+        return -1;
+    for (int i = 0; i < report->num_procs; i++) {
+        proc_report_t *p = &report->procs[i];
+        p->pid = get_uint(&c, 4);
+        p->cpu_usage = get_fraction(&c, 4);
+        p->rss_kb = get_uint(&c, 8);
+        p->dirty_kb_per_sec = get_uint(&c, 4);
+        get_string(&c, p->name, MAX_PROC_NAME);
+    }
+
+    return c.failed ? -1 : 0;
+}
+
+int protocol_decode_migrate(const uint8_t *payload, size_t len, migrate_order_t *order) {
+    cursor_t c = {.in = payload, .size = len};
+
+    memset(order, 0, sizeof(*order));
+    order->order_id = get_uint(&c, 4);
+    order->pid = get_uint(&c, 4);
+    order->target_port = get_uint(&c, 2);
+    get_string(&c, order->target_address, MAX_ADDRESS);
+    get_string(&c, order->target_node, MAX_NODE_ID);
+    return c.failed ? -1 : 0;
+}
+
+int protocol_decode_result(const uint8_t *payload, size_t len, migrate_result_t *result) {
+    cursor_t c = {.in = payload, .size = len};
+
+    result->order_id = get_uint(&c, 4);
+    result->pid = get_uint(&c, 4);
+    result->status = get_uint(&c, 1);
+    result->freeze_us = get_uint(&c, 8);
+    result->dump_us = get_uint(&c, 8);
+    result->transfer_us = get_uint(&c, 8);
+    result->restore_us = get_uint(&c, 8);
+    result->bytes = get_uint(&c, 8);
+    result->downtime_us = get_uint(&c, 8);
+
+    result->num_rounds = get_uint(&c, 1);
+    if (result->num_rounds > MAX_PRECOPY_ROUNDS)
+        return -1;
+    for (int i = 0; i < result->num_rounds; i++) {
+        result->rounds[i].bytes = get_uint(&c, 8);
+        result->rounds[i].duration_us = get_uint(&c, 8);
+        result->rounds[i].downtime_us = get_uint(&c, 8);
+    }
+    for (int i = 0; i < result->num_rounds; i++) {
+        result->rounds[i].pages = get_uint(&c, 8);
+        result->rounds[i].pages_known = get_uint(&c, 8);
+    }
+    return c.failed ? -1 : 0;
+}
+
+int protocol_decode_image_file(const uint8_t *payload, size_t len, image_file_t *file) {
+    cursor_t c = {.in = payload, .size = len};
+
+    get_string(&c, file->name, MAX_IMAGE_NAME);
+    file->size = get_uint(&c, 8);
+    return c.failed ? -1 : 0;
+}
+
+int protocol_decode_image_end(const uint8_t *payload, size_t len, image_end_t *end) {
+    cursor_t c = {.in = payload, .size = len};
+
+    end->order_id = get_uint(&c, 4);
+    end->pid = get_uint(&c, 4);
+    return c.failed ? -1 : 0;
+}
+
+int protocol_decode_page_stream(const uint8_t *payload, size_t len, page_stream_t *stream) {
+    cursor_t c = {.in = payload, .size = len};
+
+    stream->round = get_uint(&c, 4);
+    stream->final = get_uint(&c, 1);
+    stream->encoded = get_uint(&c, 1);
+    return c.failed ? -1 : 0;
+}
+
+int protocol_decode_page_hashes(const uint8_t *payload, size_t len, page_hashes_t *hashes) {
+    cursor_t c = {.in = payload, .size = len};
+
+    hashes->batch = get_uint(&c, 4);
+    hashes->count = get_uint(&c, 1);
+    if (hashes->count > PAGE_BATCH_PAGES)
+        return -1;
+    for (int i = 0; i < hashes->count; i++) {
+        const uint8_t *hash = get_bytes(&c, PAGE_HASH_SIZE);
+        if (hash)
+            memcpy(hashes->hash[i], hash, PAGE_HASH_SIZE);
+    }
+    return c.failed ? -1 : 0;
+}
+
+int protocol_decode_page_want(const uint8_t *payload, size_t len, page_want_t *want) {
+    cursor_t c = {.in = payload, .size = len};
+
+    want->batch = get_uint(&c, 4);
+    want->want = get_uint(&c, 1);
+    return c.failed ? -1 : 0;
+}
+
+int protocol_decode_page_batch(const uint8_t *payload, size_t len, page_batch_t *batch) {
+    cursor_t c = {.in = payload, .size = len};
+
+    batch->batch = get_uint(&c, 4);
+    batch->count = get_uint(&c, 1);
+    if (batch->count > PAGE_BATCH_PAGES)
+        return -1;
+    for (int i = 0; i < batch->count; i++) {
+        batch->pages[i].codec = get_uint(&c, 1);
+        batch->pages[i].length = get_uint(&c, 2);
+        batch->pages[i].data = get_bytes(&c, batch->pages[i].length);
+        if (batch->pages[i].length > PAGE_BYTES)
+            return -1;
+    }
+    return c.failed ? -1 : 0;
+}
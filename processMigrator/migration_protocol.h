@@ -0,0 +1,234 @@
+#ifndef MIGRATION_PROTOCOL_H
+#define MIGRATION_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Wire protocol between the node agents and migration_manager.
+//
+// Every message is a frame: an 8-byte header followed by the payload.
+//
+//   u16 magic    PROTOCOL_MAGIC
+//   u8  version  PROTOCOL_VERSION of the sender
+//   u8  type     message_type_t
+//   u32 length   payload bytes that follow
+//
+// All integers are big-endian. Fractions travel as hundredths in an integer.
+// Fields are only ever appended to a payload, so a reader decodes the prefix
+// it knows and skips the rest of the frame. A sender that has several frames
+// queued writes them back to back in one go.
+//
+// Executors stream checkpoint images to each other on the same framing. An
+// IMAGE_FILE frame is the exception to frames being self-contained: the file's
+// bytes follow it raw on the stream, so they can be sent straight from the
+// page cache. Memory pages go ahead of the files, while the dump is still
+// running: PAGE_STREAM opens a CRIU page-server conversation, PAGE_DATA frames
+// carry it in both directions, and PAGE_END closes it.
+//
+// In an encoded stream the source takes the pages out of that conversation.
+// It names each batch of pages by their hashes in PAGE_HASHES, the target
+// answers with PAGE_WANT for those its page store does not hold, and
+// PAGE_BATCH then carries only those, compressed. PAGE_BATCH takes the place
+// of the page data in the conversation; PAGE_HASHES and PAGE_WANT run ahead
+// of it, so the source keeps several batches in flight.
+
+#define PROTOCOL_MAGIC 0x504d // "PM"
+#define PROTOCOL_VERSION 1
+#define PROTOCOL_HEADER_SIZE 8
+#define PROTOCOL_MAX_PAYLOAD 65536
+
+#define MAX_NODE_ID 64
+#define MAX_REPORT_CORES 1024
+#define MAX_REPORT_PROCS 24
+#define MAX_PROC_NAME 16
+#define MAX_ADDRESS 64
+#define MAX_IMAGE_NAME 128
+#define MAX_PRECOPY_ROUNDS 16 // Pre-dump rounds and the final dump
+#define PAGE_BATCH_PAGES 8 // A batch at its largest still fits a frame uncompressed
+#define PAGE_HASH_SIZE 16
+#define PAGE_BYTES 4096
+
+#define PROTOCOL_UNKNOWN -1.0f // Value of a metric the node could not measure
+
+typedef enum {
+    MSG_HELLO = 1,  // First frame on a connection: who is talking
+    MSG_REPORT = 2, // One resource sample
+    MSG_MIGRATE = 3, // Manager to the source node's executor: move a process
+    MSG_RESULT = 4,  // Executor to the manager: how a migration went
+    MSG_IMAGE_FILE = 5, // Source executor to target: one image file, its bytes follow
+    MSG_IMAGE_END = 6,  // Source executor to target: all files sent, restore now
+    MSG_RESTORED = 7,   // Target executor to source: outcome of the restore
+    MSG_PAGE_STREAM = 8, // Source executor to target: pages of one round follow, start a page server
+    MSG_PAGE_DATA = 9,   // Page-server traffic; the payload is passed on unchanged
+    MSG_PAGE_END = 10,   // Source executor to target: the dump is done with the page server
+    MSG_PAGE_HASHES = 11, // Source executor to target: the pages of the next batch, by content
+    MSG_PAGE_WANT = 12,   // Target executor to source: the pages of a batch it does not hold
+    MSG_PAGE_BATCH = 13,  // Source executor to target: a batch's wanted pages, in stream order
+} message_type_t;
+
+typedef enum {
+    ROLE_MONITOR = 1,
+    ROLE_EXECUTOR = 2, // Carries out migration orders; HELLO gives the port peers reach it on
+} node_role_t;
+
+typedef enum {
+    MIGRATE_OK = 0,
+    MIGRATE_DUMP_FAILED = 1,
+    MIGRATE_TRANSFER_FAILED = 2,
+    MIGRATE_RESTORE_FAILED = 3,
+} migrate_status_t;
+
+typedef enum {
+    PSI_CPU_SOME,
+    PSI_MEMORY_SOME,
+    PSI_MEMORY_FULL,
+    PSI_IO_SOME,
+    PSI_IO_FULL,
+    PSI_COUNT
+} psi_metric_t;
+
+typedef enum {
+    PAGE_RAW = 0,     // Did not compress
+    PAGE_DEFLATE = 1, // Raw deflate stream
+} page_codec_t;
+
+typedef struct {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t type;
+    uint32_t length;
+} frame_header_t;
+
+typedef struct {
+    uint8_t role;
+    uint16_t port; // Where the node accepts connections from other nodes; 0 if it does not
+    char node_id[MAX_NODE_ID];
+} hello_t;
+
+// A process the node considers worth moving
+typedef struct {
+    uint32_t pid;
+    float cpu_usage;          // % of one core
+    uint64_t rss_kb;
+    uint32_t dirty_kb_per_sec; // Rate at which it dirties memory
+    char name[MAX_PROC_NAME];
+} proc_report_t;
+
+typedef struct {
+    uint64_t timestamp_ms; // Wall-clock time the sample was taken
+    float cpu_usage;       // % of all online cores
+    float memory_usage;    // % of RAM not available
+    uint64_t mem_total_kb;
+    uint64_t mem_available_kb;
+    float load_avg[3];
+    float psi[PSI_COUNT]; // % of the sample interval stalled, PROTOCOL_UNKNOWN without PSI
+    uint16_t num_cores;
+    uint16_t num_procs;
+    float core_load[MAX_REPORT_CORES]; // Indexed by CPU id; PROTOCOL_UNKNOWN while offline
+    proc_report_t procs[MAX_REPORT_PROCS];
+} node_report_t;
+
+// Order to checkpoint a process and restore it on another node's executor
+typedef struct {
+    uint32_t order_id;
+    uint32_t pid;
+    uint16_t target_port;
+    char target_address[MAX_ADDRESS];
+    char target_node[MAX_NODE_ID];
+} migrate_order_t;
+
+// One copy of the process's memory: a pre-dump while it runs, or the final dump
+typedef struct {
+    uint64_t bytes;       // Sent to the target in this round
+    uint64_t duration_us;
+    uint64_t downtime_us; // Time the process was stopped for it
+    uint64_t pages;       // Pages CRIU sent; 0 if the stream was not encoded
+    uint64_t pages_known; // Of those, pages the target already held
+} precopy_round_t;
+
+// Outcome of a migration with the time spent in each phase. The target fills
+// in status and restore_us for its RESTORED reply; the source completes the
+// rest and reports it to the manager.
+typedef struct {
+    uint32_t order_id;
+    uint32_t pid;
+    uint8_t status; // migrate_status_t
+    uint64_t freeze_us;   // Stopping the process tree, as measured by CRIU
+    uint64_t dump_us;     // The whole dump, freezing included
+    uint64_t transfer_us;
+    uint64_t restore_us;
+    uint64_t bytes; // Image bytes sent to the target
+    uint64_t downtime_us; // From the final freeze until the target had restored it
+    uint8_t num_rounds;
+    precopy_round_t rounds[MAX_PRECOPY_ROUNDS];
+} migrate_result_t;
+
+typedef struct {
+    char name[MAX_IMAGE_NAME];
+    uint64_t size; // Bytes that follow the frame
+} image_file_t;
+
+typedef struct {
+    uint32_t order_id;
+    uint32_t pid;
+} image_end_t;
+
+typedef struct {
+    uint32_t round; // From 1; each round's images build on the previous one's
+    uint8_t final;  // The dump proper; its image files follow the pages
+    uint8_t encoded; // Pages go as PAGE_HASHES and PAGE_BATCH instead of in PAGE_DATA
+} page_stream_t;
+
+typedef struct {
+    uint32_t batch; // Numbered from 0 in each stream
+    uint8_t count;
+    uint8_t hash[PAGE_BATCH_PAGES][PAGE_HASH_SIZE];
+} page_hashes_t;
+
+typedef struct {
+    uint32_t batch;
+    uint8_t want; // Bit i set: send page i
+} page_want_t;
+
+typedef struct {
+    uint8_t codec; // page_codec_t
+    uint16_t length;
+    const uint8_t *data; // Points into the caller's buffer
+} page_blob_t;
+
+typedef struct {
+    uint32_t batch;
+    uint8_t count; // The wanted pages only
+    page_blob_t pages[PAGE_BATCH_PAGES];
+} page_batch_t;
+
+// Encoders write one complete frame into buf and return its size, or 0 if it does not fit
+size_t protocol_encode_header(uint8_t *buf, size_t size, message_type_t type, uint32_t length);
+size_t protocol_encode_hello(uint8_t *buf, size_t size, const hello_t *hello);
+size_t protocol_encode_report(uint8_t *buf, size_t size, const node_report_t *report);
+size_t protocol_encode_migrate(uint8_t *buf, size_t size, const migrate_order_t *order);
+size_t protocol_encode_result(uint8_t *buf, size_t size, message_type_t type, const migrate_result_t *result);
+size_t protocol_encode_image_file(uint8_t *buf, size_t size, const image_file_t *file);
+size_t protocol_encode_image_end(uint8_t *buf, size_t size, const image_end_t *end);
+size_t protocol_encode_page_stream(uint8_t *buf, size_t size, const page_stream_t *stream);
+size_t protocol_encode_page_hashes(uint8_t *buf, size_t size, const page_hashes_t *hashes);
+size_t protocol_encode_page_want(uint8_t *buf, size_t size, const page_want_t *want);
+size_t protocol_encode_page_batch(uint8_t *buf, size_t size, const page_batch_t *batch);
+
+// Parse the header at the front of buf. Returns 1 once a whole frame is
+// buffered, 0 if more bytes are needed, and -1 if the stream is not ours.
+int protocol_decode_header(const uint8_t *buf, size_t len, frame_header_t *header);
+
+// Decoders take the payload of a frame. Return 0 on success, -1 if it is malformed.
+int protocol_decode_hello(const uint8_t *payload, size_t len, hello_t *hello);
+int protocol_decode_report(const uint8_t *payload, size_t len, node_report_t *report);
+int protocol_decode_migrate(const uint8_t *payload, size_t len, migrate_order_t *order);
+int protocol_decode_result(const uint8_t *payload, size_t len, migrate_result_t *result);
+int protocol_decode_image_file(const uint8_t *payload, size_t len, image_file_t *file);
+int protocol_decode_image_end(const uint8_t *payload, size_t len, image_end_t *end);
+int protocol_decode_page_stream(const uint8_t *payload, size_t len, page_stream_t *stream);
+int protocol_decode_page_hashes(const uint8_t *payload, size_t len, page_hashes_t *hashes);
+int protocol_decode_page_want(const uint8_t *payload, size_t len, page_want_t *want);
+int protocol_decode_page_batch(const uint8_t *payload, size_t len, page_batch_t *batch);
+
+#endif // MIGRATION_PROTOCOL_H
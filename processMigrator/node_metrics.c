@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+#include "node_metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+static const char *psi_files[3] = {"/proc/pressure/cpu", "/proc/pressure/memory", "/proc/pressure/io"};
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// Re-read a /proc file from the start into buf. Returns the length, or -1.
+static ssize_t read_proc(int fd, char *buf, size_t size) {
+    if (fd < 0)
+        return -1;
+
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+// Value of a "Key:   123 kB" line in /proc/meminfo
+static unsigned long long meminfo_value(const char *buf, const char *key) {
+    const char *line = strstr(buf, key);
+    return line ? strtoull(line + strlen(key), NULL, 10) : 0;
+}
+
+// Busy and total ticks of one "cpu" line; iowait counts as idle
+static const char *parse_cpu_line(const char *p, cpu_ticks_t *ticks) {
+    unsigned long long value[10] = {0};
+    char *end;
+
+    for (int i = 0; i < 10; i++) {
+        value[i] = strtoull(p, &end, 10);
+        if (end == p)
+            break;
+        p = end;
+    }
+
+    // guest and guest_nice (8, 9) are already included in user and nice
+    ticks->total = 0;
+    for (int i = 0; i < 8; i++)
+        ticks->total += value[i];
+    ticks->busy = ticks->total - value[3] - value[4];
+    return p;
+}
+
+static float ticks_usage(const cpu_ticks_t *prev, const cpu_ticks_t *cur) {
+    unsigned long long total = cur->total - prev->total;
+
+    if (cur->total < prev->total || cur->busy < prev->busy || total == 0)
+        return 0.0f;
+    return (cur->busy - prev->busy) * 100.0f / total;
+}
+
+static void sample_cpu(node_metrics_t *m, node_report_t *report) {
+    int seen[MAX_REPORT_CORES] = {0};
+    cpu_ticks_t ticks;
+
+    report->cpu_usage = PROTOCOL_UNKNOWN;
+    report->num_cores = 0;
+    if (read_proc(m->stat_fd, m->buffer, sizeof(m->buffer)) <= 0)
+        return;
+
+    const char *p = m->buffer;
+    while (strncmp(p, "cpu", 3) == 0) {
+        if (p[3] == ' ') {
+            p = parse_cpu_line(p + 3, &ticks);
+            if (m->primed)
+                report->cpu_usage = ticks_usage(&m->prev_total, &ticks);
+            m->prev_total = ticks;
+        } else {
+            // Offline CPUs have no line, so the id says where the numbers go
+            char *end;
+            long id = strtol(p + 3, &end, 10);
+            p = parse_cpu_line(end, &ticks);
+            if (id >= 0 && id < MAX_REPORT_CORES) {
+                report->core_load[id] = m->primed && m->prev_seen[id] ? ticks_usage(&m->prev_core[id], &ticks)
+                                                                      : PROTOCOL_UNKNOWN;
+                if (id + 1 > report->num_cores)
+                    report->num_cores = id + 1;
+                m->prev_core[id] = ticks;
+                seen[id] = 1;
+            }
+        }
+
+        p = strchr(p, '\n');
+        if (!p)
+            break;
+        p++;
+    }
+
+    for (int i = 0; i < report->num_cores; i++) {
+        if (!seen[i])
+            report->core_load[i] = PROTOCOL_UNKNOWN;
+    }
+    memcpy(m->prev_seen, seen, sizeof(seen));
+}
+
+static void sample_memory(node_metrics_t *m, node_report_t *report) {
+    char buf[2048];
+
+    report->memory_usage = PROTOCOL_UNKNOWN;
+    if (read_proc(m->meminfo_fd, buf, sizeof(buf)) <= 0)
+        return;
+
+    report->mem_total_kb = meminfo_value(buf, "MemTotal:");
+    report->mem_available_kb = meminfo_value(buf, "MemAvailable:");
+    if (report->mem_total_kb > 0 && report->mem_available_kb <= report->mem_total_kb)
+        report->memory_usage = (report->mem_total_kb - report->mem_available_kb) * 100.0f / report->mem_total_kb;
+}
+
+static void sample_loadavg(node_metrics_t *m, node_report_t *report) {
+    char buf[128];
+
+    for (int i = 0; i < 3; i++)
+        report->load_avg[i] = PROTOCOL_UNKNOWN;
+    if (read_proc(m->loadavg_fd, buf, sizeof(buf)) > 0)
+        sscanf(buf, "%f %f %f", &report->load_avg[0], &report->load_avg[1], &report->load_avg[2]);
+}
+
+// Stall time as a share of the interval, from the cumulative totals. The
+// kernel's avg10 would lag by seconds at sub-second sampling.
+static void sample_pressure(node_metrics_t *m, node_report_t *report, long long elapsed_us) {
+    static const psi_metric_t some[3] = {PSI_CPU_SOME, PSI_MEMORY_SOME, PSI_IO_SOME};
+    static const psi_metric_t full[3] = {PSI_COUNT, PSI_MEMORY_FULL, PSI_IO_FULL};
+    char buf[256];
+
+    for (int i = 0; i < PSI_COUNT; i++)
+        report->psi[i] = PROTOCOL_UNKNOWN;
+
+    for (int f = 0; f < 3; f++) {
+        if (read_proc(m->psi_fd[f], buf, sizeof(buf)) <= 0)
+            continue;
+
+        // "some avg10=.. avg60=.. avg300=.. total=N\nfull ... total=N"
+        const char *line = buf;
+        for (int row = 0; row < 2 && line; row++) {
+            psi_metric_t metric = row == 0 ? some[f] : full[f];
+            const char *total = strstr(line, "total=");
+            line = strchr(line, '\n');
+            if (!total || metric == PSI_COUNT)
+                continue;
+
+            unsigned long long stall = strtoull(total + 6, NULL, 10);
+            if (m->primed && elapsed_us > 0 && stall >= m->prev_stall[metric]) {
+                float share = (stall - m->prev_stall[metric]) * 100.0f / elapsed_us;
+                report->psi[metric] = share > 100.0f ? 100.0f : share;
+            }
+            m->prev_stall[metric] = stall;
+            if (line)
+                line++;
+        }
+    }
+}
+
+int node_metrics_open(node_metrics_t *m) {
+    static node_report_t baseline;
+
+    memset(m, 0, sizeof(*m));
+    m->stat_fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    m->meminfo_fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    m->loadavg_fd = open("/proc/loadavg", O_RDONLY | O_CLOEXEC);
+    for (int i = 0; i < 3; i++)
+        m->psi_fd[i] = open(psi_files[i], O_RDONLY | O_CLOEXEC);
+
+    if (m->stat_fd < 0) {
+        perror("Failed to open /proc/stat");
+        return -1;
+    }
+
+    node_metrics_sample(m, &baseline);
+    return 0;
+}
+
+void node_metrics_sample(node_metrics_t *m, node_report_t *report) {
+    long long now = now_us();
+    long long elapsed = now - m->prev_time_us;
+
+    sample_cpu(m, report);
+    sample_memory(m, report);
+    sample_loadavg(m, report);
+    sample_pressure(m, report, elapsed);
+
+    m->prev_time_us = now;
+    m->primed = 1;
+}
+
+void node_metrics_close(node_metrics_t *m) {
+    int *fds[] = {&m->stat_fd, &m->meminfo_fd, &m->loadavg_fd, &m->psi_fd[0], &m->psi_fd[1], &m->psi_fd[2]};
+
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] >= 0)
+            close(*fds[i]);
+        *fds[i] = -1;
+    }
+}
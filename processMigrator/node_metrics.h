@@ -0,0 +1,38 @@
+#ifndef NODE_METRICS_H
+#define NODE_METRICS_H
+
+#include "migration_protocol.h"
+
+#define STAT_BUFFER_SIZE (128 * 1024) // The per-CPU lines come first; the rest is not needed
+
+typedef struct {
+    unsigned long long busy;
+    unsigned long long total;
+} cpu_ticks_t;
+
+// Node-wide metrics read straight from /proc. Every file is opened once and
+// re-read with pread into fixed buffers, so a sample costs a handful of
+// syscalls and no process or allocation.
+typedef struct {
+    int stat_fd;
+    int meminfo_fd;
+    int loadavg_fd;
+    int psi_fd[3]; // cpu, memory, io; -1 on kernels without PSI
+    int primed;
+    long long prev_time_us;
+    cpu_ticks_t prev_total;
+    cpu_ticks_t prev_core[MAX_REPORT_CORES];
+    int prev_seen[MAX_REPORT_CORES];
+    unsigned long long prev_stall[PSI_COUNT];
+    char buffer[STAT_BUFFER_SIZE];
+} node_metrics_t;
+
+// Open the /proc files and take the baseline. Returns -1 if /proc/stat is unreadable.
+int node_metrics_open(node_metrics_t *m);
+
+// Fill the node-wide fields of a report with the usage since the previous call
+void node_metrics_sample(node_metrics_t *m, node_report_t *report);
+
+void node_metrics_close(node_metrics_t *m);
+
+#endif // NODE_METRICS_H
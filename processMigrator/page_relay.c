@@ -0,0 +1,590 @@
+#include "page_relay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "transfer.h"
+
+// CRIU's page-server protocol (criu/page-xfer.c): each command is this header
+// in host order, and the ones adding present pages are followed by them.
+// Anything else passes through as it is; an unknown command passes the rest
+// of the conversation through, since where its pages end cannot be known.
+#define PS_IOV_ADD 1
+#define PS_IOV_HOLE 2
+#define PS_IOV_OPEN 3
+#define PS_IOV_OPEN2 4
+#define PS_IOV_PARENT 5
+#define PS_IOV_ADD_F 6
+#define PS_IOV_GET 7
+#define PS_IOV_FLUSH 0x1023
+#define PS_IOV_FLUSH_N_CLOSE 0x1024
+#define PS_CMD_BITS 16
+#define PE_PRESENT (1 << 2)
+
+typedef struct {
+    uint32_t cmd;
+    uint32_t nr_pages;
+    uint64_t vaddr;
+    uint64_t dst_id;
+} page_server_iov_t;
+
+#define BATCH_FRAME_SIZE (PROTOCOL_HEADER_SIZE + 5 + PAGE_BATCH_PAGES * (3 + PAGE_BYTES))
+#define RAW_SIZE (PAGE_BATCH_PAGES * PAGE_BYTES)
+
+typedef enum {
+    SLOT_RAW,     // Conversation bytes to pass on as they are
+    SLOT_FILLING, // Pages of a batch still arriving from CRIU
+    SLOT_HASHED,  // Asked the target about; waiting for PAGE_WANT
+    SLOT_WANTED,  // Queued for compression
+    SLOT_READY,   // frame holds the PAGE_BATCH
+} slot_state_t;
+
+// One entry of the dump side's queue, which keeps the conversation in order
+typedef struct {
+    int state; // slot_state_t; the workers hand back READY
+    uint32_t batch;
+    int count;   // Pages in data
+    size_t len;  // Bytes in data, for RAW
+    uint8_t want;
+    uint8_t hash[PAGE_BATCH_PAGES][PAGE_HASH_SIZE];
+    uint8_t data[RAW_SIZE];
+    uint8_t packed[PAGE_BATCH_PAGES][PAGE_BYTES];
+    size_t frame_len;
+    uint8_t frame[BATCH_FRAME_SIZE];
+} slot_t;
+
+typedef struct {
+    int local, link;
+    page_store_t *store;
+    page_relay_stats_t *stats;
+
+    slot_t *slots; // Ring of PAGE_RELAY_WINDOW
+    unsigned head, used;
+    uint32_t next_batch;
+
+    // Where the parse of CRIU's side is
+    uint8_t header[sizeof(page_server_iov_t)];
+    size_t header_len;
+    uint32_t pages_left; // Of the command being read
+    size_t page_fill;    // Bytes of the page being read
+    int passthrough;
+
+    // Compression workers take WANTED slots and signal done_fd for each one made READY
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    unsigned queue[PAGE_RELAY_WINDOW];
+    unsigned queue_head, queue_len;
+    int stop;
+    int done_fd;
+} sender_t;
+
+// Deflate one page into out. Returns its codec and stores its length.
+static int compress_page(z_stream *z, const uint8_t *page, uint8_t *out, uint16_t *len) {
+    if (z && deflateReset(z) == Z_OK) {
+        z->next_in = (uint8_t *)page;
+        z->avail_in = PAGE_BYTES;
+        z->next_out = out;
+        z->avail_out = PAGE_BYTES - 1;
+        if (deflate(z, Z_FINISH) == Z_STREAM_END) {
+            *len = z->total_out;
+            return PAGE_DEFLATE;
+        }
+    }
+
+    memcpy(out, page, PAGE_BYTES);
+    *len = PAGE_BYTES;
+    return PAGE_RAW;
+}
+
+static void encode_batch(slot_t *slot, z_stream *z) {
+    page_batch_t batch = {.batch = slot->batch};
+
+    for (int i = 0; i < slot->count; i++) {
+        if (!(slot->want & 1 << i))
+            continue;
+        page_blob_t *blob = &batch.pages[batch.count++];
+        blob->codec = compress_page(z, slot->data + i * PAGE_BYTES, slot->packed[i], &blob->length);
+        blob->data = slot->packed[i];
+    }
+    slot->frame_len = protocol_encode_page_batch(slot->frame, sizeof(slot->frame), &batch);
+}
+
+static void *compress_worker(void *arg) {
+    sender_t *s = arg;
+    z_stream z = {0};
+    uint64_t one = 1;
+
+    // Level 1: the link, not the ratio, is what this has to keep up with
+    int have_z = deflateInit2(&z, 1, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        while (s->queue_len == 0 && !s->stop)
+            pthread_cond_wait(&s->work, &s->lock);
+        if (s->queue_len == 0) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        slot_t *slot = &s->slots[s->queue[s->queue_head]];
+        s->queue_head = (s->queue_head + 1) % PAGE_RELAY_WINDOW;
+        s->queue_len--;
+        pthread_mutex_unlock(&s->lock);
+
+        encode_batch(slot, have_z ? &z : NULL);
+        __atomic_store_n(&slot->state, SLOT_READY, __ATOMIC_RELEASE);
+        if (write(s->done_fd, &one, sizeof(one)) < 0)
+            perror("Failed to signal a compressed batch");
+    }
+
+    if (have_z)
+        deflateEnd(&z);
+    return NULL;
+}
+
+static int send_frame(sender_t *s, const uint8_t *frame, size_t len) {
+    if (len == 0 || transfer_send_all(s->link, frame, len) < 0)
+        return -1;
+    s->stats->bytes += len;
+    return 0;
+}
+
+static slot_t *tail_slot(sender_t *s) {
+    return s->used ? &s->slots[(s->head + s->used - 1) % PAGE_RELAY_WINDOW] : NULL;
+}
+
+static slot_t *new_slot(sender_t *s, slot_state_t state) {
+    if (s->used == PAGE_RELAY_WINDOW)
+        return NULL;
+    slot_t *slot = &s->slots[(s->head + s->used++) % PAGE_RELAY_WINDOW];
+    slot->state = state;
+    slot->count = 0;
+    slot->len = 0;
+    slot->want = 0;
+    return slot;
+}
+
+// Name the batch's pages to the target, keeping them here for later moves
+static int send_hashes(sender_t *s, slot_t *slot) {
+    uint8_t frame[PROTOCOL_HEADER_SIZE + 5 + PAGE_BATCH_PAGES * PAGE_HASH_SIZE];
+    page_hashes_t hashes = {.batch = slot->batch, .count = slot->count};
+
+    for (int i = 0; i < slot->count; i++) {
+        page_store_hash(slot->data + i * PAGE_BYTES, slot->hash[i]);
+        memcpy(hashes.hash[i], slot->hash[i], PAGE_HASH_SIZE);
+    }
+    if (s->store)
+        page_store_put(s->store, (const uint8_t (*)[PAGE_HASH_SIZE])slot->hash, slot->data, slot->count);
+
+    slot->state = SLOT_HASHED;
+    s->stats->pages += slot->count;
+    return send_frame(s, frame, protocol_encode_page_hashes(frame, sizeof(frame), &hashes));
+}
+
+// Queue bytes to pass on unchanged. Returns how many fit.
+static size_t append_raw(sender_t *s, const uint8_t *data, size_t len) {
+    slot_t *slot = tail_slot(s);
+
+    if (!slot || slot->state != SLOT_RAW || slot->len == RAW_SIZE)
+        slot = new_slot(s, SLOT_RAW);
+    if (!slot)
+        return 0;
+    if (len > RAW_SIZE - slot->len)
+        len = RAW_SIZE - slot->len;
+    memcpy(slot->data + slot->len, data, len);
+    slot->len += len;
+    return len;
+}
+
+// A command header is complete: see whether pages follow it
+static void parse_command(sender_t *s) {
+    page_server_iov_t iov;
+    memcpy(&iov, s->header, sizeof(iov));
+    uint32_t cmd = iov.cmd & ((1 << PS_CMD_BITS) - 1);
+    uint32_t flags = iov.cmd >> PS_CMD_BITS;
+
+    switch (cmd) {
+    case PS_IOV_ADD:
+        s->pages_left = iov.nr_pages;
+        break;
+    case PS_IOV_ADD_F:
+        s->pages_left = flags & PE_PRESENT ? iov.nr_pages : 0;
+        break;
+    case PS_IOV_HOLE:
+    case PS_IOV_OPEN:
+    case PS_IOV_OPEN2:
+    case PS_IOV_PARENT:
+    case PS_IOV_GET:
+    case PS_IOV_FLUSH:
+    case PS_IOV_FLUSH_N_CLOSE:
+        break;
+    default:
+        fprintf(stderr, "Unknown page-server command %#x; passing the rest of the stream unencoded\n", iov.cmd);
+        s->passthrough = 1;
+    }
+}
+
+// Take in what CRIU sent. Returns the bytes consumed, which is short of len
+// once the window is full, or -1 on failure.
+static ssize_t consume(sender_t *s, const uint8_t *data, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+        size_t n = len - done;
+
+        if (s->pages_left > 0) {
+            slot_t *slot = tail_slot(s);
+            if (!slot || slot->state != SLOT_FILLING) {
+                if (!(slot = new_slot(s, SLOT_FILLING)))
+                    break;
+                slot->batch = s->next_batch++;
+            }
+
+            if (n > PAGE_BYTES - s->page_fill)
+                n = PAGE_BYTES - s->page_fill;
+            memcpy(slot->data + slot->count * PAGE_BYTES + s->page_fill, data + done, n);
+            s->page_fill += n;
+            if (s->page_fill == PAGE_BYTES) {
+                s->page_fill = 0;
+                slot->count++;
+                s->pages_left--;
+                if ((slot->count == PAGE_BATCH_PAGES || s->pages_left == 0) && send_hashes(s, slot) < 0)
+                    return -1;
+            }
+        } else {
+            if (!s->passthrough && n > sizeof(s->header) - s->header_len)
+                n = sizeof(s->header) - s->header_len;
+            if ((n = append_raw(s, data + done, n)) == 0)
+                break;
+
+            if (!s->passthrough) {
+                memcpy(s->header + s->header_len, data + done, n);
+                s->header_len += n;
+                if (s->header_len == sizeof(s->header)) {
+                    s->header_len = 0;
+                    parse_command(s);
+                }
+            }
+        }
+        done += n;
+    }
+    return done;
+}
+
+// Send what is at the front of the queue and ready to go
+static int flush(sender_t *s) {
+    uint8_t header[PROTOCOL_HEADER_SIZE];
+
+    while (s->used > 0) {
+        slot_t *slot = &s->slots[s->head];
+        int state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+
+        if (state == SLOT_RAW) {
+            protocol_encode_header(header, sizeof(header), MSG_PAGE_DATA, slot->len);
+            if (send_frame(s, header, sizeof(header)) < 0 || send_frame(s, slot->data, slot->len) < 0)
+                return -1;
+        } else if (state == SLOT_READY) {
+            if (send_frame(s, slot->frame, slot->frame_len) < 0)
+                return -1;
+        } else {
+            break;
+        }
+        s->head = (s->head + 1) % PAGE_RELAY_WINDOW;
+        s->used--;
+    }
+    return 0;
+}
+
+static int take_want(sender_t *s, const uint8_t *payload, size_t len) {
+    page_want_t want;
+
+    if (protocol_decode_page_want(payload, len, &want) < 0)
+        return -1;
+
+    for (unsigned i = 0; i < s->used; i++) {
+        unsigned index = (s->head + i) % PAGE_RELAY_WINDOW;
+        slot_t *slot = &s->slots[index];
+        if (slot->state != SLOT_HASHED || slot->batch != want.batch)
+            continue;
+
+        slot->want = want.want & ((1 << slot->count) - 1);
+        s->stats->pages_known += slot->count - __builtin_popcount(slot->want);
+        if (slot->want == 0) {
+            encode_batch(slot, NULL);
+            slot->state = SLOT_READY;
+            return 0;
+        }
+
+        slot->state = SLOT_WANTED;
+        pthread_mutex_lock(&s->lock);
+        s->queue[(s->queue_head + s->queue_len++) % PAGE_RELAY_WINDOW] = index;
+        pthread_cond_signal(&s->work);
+        pthread_mutex_unlock(&s->lock);
+        return 0;
+    }
+    return -1; // Not a batch we asked about
+}
+
+static int run_sender(sender_t *s) {
+    static const size_t in_size = PROTOCOL_MAX_PAYLOAD;
+    uint8_t *in = malloc(in_size), *payload = malloc(PROTOCOL_MAX_PAYLOAD);
+    uint8_t buf[PROTOCOL_HEADER_SIZE];
+    frame_header_t header;
+    size_t in_pos = 0, in_len = 0;
+    int status = -1, local_open = 1;
+
+    while (in && payload) {
+        // Input held back while the window was full goes first
+        if (in_pos < in_len) {
+            ssize_t n = consume(s, in + in_pos, in_len - in_pos);
+            if (n < 0)
+                break;
+            in_pos += n;
+        }
+        if (flush(s) < 0)
+            break;
+        if (in_pos < in_len && s->used < PAGE_RELAY_WINDOW)
+            continue;
+
+        if (!local_open && s->used == 0) {
+            if (s->pages_left > 0 || s->page_fill > 0 || s->header_len > 0) {
+                fprintf(stderr, "CRIU hung up in the middle of a command\n");
+                break;
+            }
+            status = send_frame(s, buf, protocol_encode_header(buf, sizeof(buf), MSG_PAGE_END, 0));
+            break;
+        }
+
+        struct pollfd pfd[3] = {
+            {.fd = local_open && in_pos == in_len ? s->local : -1, .events = POLLIN},
+            {.fd = s->link, .events = POLLIN},
+            {.fd = s->done_fd, .events = POLLIN},
+        };
+        if (poll(pfd, 3, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (pfd[0].revents) {
+            ssize_t n = recv(s->local, in, in_size, 0);
+            if (n < 0 && errno != EINTR)
+                break;
+            in_pos = 0;
+            in_len = n > 0 ? n : 0;
+            if (n == 0)
+                local_open = 0; // CRIU has had its last reply and hung up
+        }
+
+        if (pfd[1].revents) {
+            if (transfer_read_frame(s->link, &header, payload) < 0)
+                break;
+            if (header.type == MSG_PAGE_WANT) {
+                if (take_want(s, payload, header.length) < 0)
+                    break;
+            } else if (header.type != MSG_PAGE_DATA || !local_open ||
+                       transfer_send_all(s->local, payload, header.length) < 0) {
+                break;
+            }
+        }
+
+        if (pfd[2].revents) {
+            uint64_t done;
+            if (read(s->done_fd, &done, sizeof(done)) < 0 && errno != EAGAIN)
+                break;
+        }
+    }
+
+    free(in);
+    free(payload);
+    return status;
+}
+
+int page_relay_send(int local, int link, page_store_t *store, int threads, page_relay_stats_t *stats) {
+    sender_t s = {.local = local, .link = link, .store = store, .stats = stats};
+    pthread_t workers[threads > 0 ? threads : 1];
+    int started = 0, status = -1;
+
+    s.slots = malloc(PAGE_RELAY_WINDOW * sizeof(slot_t));
+    s.done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.work, NULL);
+
+    if (s.slots && s.done_fd >= 0) {
+        while (started < threads && pthread_create(&workers[started], NULL, compress_worker, &s) == 0)
+            started++;
+        if (started > 0)
+            status = run_sender(&s);
+        else
+            fprintf(stderr, "Failed to start compression threads\n");
+    }
+
+    pthread_mutex_lock(&s.lock);
+    s.stop = 1;
+    s.queue_len = 0;
+    pthread_cond_broadcast(&s.work);
+    pthread_mutex_unlock(&s.lock);
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    pthread_cond_destroy(&s.work);
+    pthread_mutex_destroy(&s.lock);
+    if (s.done_fd >= 0)
+        close(s.done_fd);
+    free(s.slots);
+    return status;
+}
+
+typedef struct {
+    page_hashes_t hashes;
+    uint8_t want;
+} asked_t;
+
+static int inflate_page(z_stream *z, const page_blob_t *blob, uint8_t *page) {
+    if (blob->codec == PAGE_RAW) {
+        if (blob->length != PAGE_BYTES)
+            return -1;
+        memcpy(page, blob->data, PAGE_BYTES);
+        return 0;
+    }
+    if (blob->codec != PAGE_DEFLATE || inflateReset(z) != Z_OK)
+        return -1;
+
+    z->next_in = (uint8_t *)blob->data;
+    z->avail_in = blob->length;
+    z->next_out = page;
+    z->avail_out = PAGE_BYTES;
+    return inflate(z, Z_FINISH) == Z_STREAM_END && z->total_out == PAGE_BYTES ? 0 : -1;
+}
+
+// Answer which pages of a batch we lack, remembering the question for its PAGE_BATCH
+static int answer_hashes(int link, page_store_t *store, asked_t *asked, const uint8_t *payload, size_t len,
+                         page_relay_stats_t *stats) {
+    uint8_t frame[PROTOCOL_HEADER_SIZE + 8];
+    page_hashes_t hashes;
+
+    if (protocol_decode_page_hashes(payload, len, &hashes) < 0)
+        return -1;
+
+    page_want_t want = {.batch = hashes.batch};
+    for (int i = 0; i < hashes.count; i++) {
+        if (!store || !page_store_has(store, hashes.hash[i]))
+            want.want |= 1 << i;
+    }
+
+    asked_t *a = &asked[hashes.batch % PAGE_RELAY_WINDOW];
+    a->hashes = hashes;
+    a->want = want.want;
+    stats->pages += hashes.count;
+    stats->pages_known += hashes.count - __builtin_popcount(want.want);
+
+    size_t n = protocol_encode_page_want(frame, sizeof(frame), &want);
+    if (transfer_send_all(link, frame, n) < 0)
+        return -1;
+    stats->bytes += n;
+    return 0;
+}
+
+// Rebuild a batch's pages from the ones sent and the store, and pass them on
+static int take_batch(int local, page_store_t *store, z_stream *z, asked_t *asked, uint8_t *pages,
+                      const uint8_t *payload, size_t len) {
+    page_batch_t batch;
+    int sent = 0;
+
+    if (protocol_decode_page_batch(payload, len, &batch) < 0)
+        return -1;
+    asked_t *a = &asked[batch.batch % PAGE_RELAY_WINDOW];
+    if (a->hashes.batch != batch.batch || batch.count != __builtin_popcount(a->want))
+        return -1;
+
+    for (int i = 0; i < a->hashes.count; i++) {
+        uint8_t *page = pages + i * PAGE_BYTES;
+        if (a->want & 1 << i) {
+            if (inflate_page(z, &batch.pages[sent++], page) < 0)
+                return -1;
+        } else if (!store || page_store_get(store, a->hashes.hash[i], page) < 0) {
+            return -1;
+        }
+    }
+
+    if (store && sent > 0)
+        page_store_put(store, (const uint8_t (*)[PAGE_HASH_SIZE])a->hashes.hash, pages, a->hashes.count);
+    a->hashes.batch = UINT32_MAX;
+    return transfer_send_all(local, pages, (size_t)a->hashes.count * PAGE_BYTES);
+}
+
+int page_relay_receive(int link, int local, page_store_t *store, page_relay_stats_t *stats) {
+    asked_t *asked = calloc(PAGE_RELAY_WINDOW, sizeof(asked_t));
+    uint8_t *payload = malloc(PROTOCOL_MAX_PAYLOAD), *pages = malloc(RAW_SIZE);
+    uint8_t header_buf[PROTOCOL_HEADER_SIZE];
+    frame_header_t header;
+    z_stream z = {0};
+    int status = -1, local_open = 1;
+
+    int have_z = inflateInit2(&z, -15) == Z_OK;
+    for (int i = 0; asked && i < PAGE_RELAY_WINDOW; i++)
+        asked[i].hashes.batch = UINT32_MAX;
+
+    while (asked && payload && pages && have_z) {
+        struct pollfd pfd[2] = {{.fd = local_open ? local : -1, .events = POLLIN}, {.fd = link, .events = POLLIN}};
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        // The page server's replies go back as they are
+        if (pfd[0].revents) {
+            ssize_t n = recv(local, payload, PROTOCOL_MAX_PAYLOAD, 0);
+            if (n < 0 && errno != EINTR)
+                break;
+            if (n == 0)
+                local_open = 0;
+            if (n > 0) {
+                protocol_encode_header(header_buf, sizeof(header_buf), MSG_PAGE_DATA, n);
+                if (transfer_send_all(link, header_buf, sizeof(header_buf)) < 0 || transfer_send_all(link, payload, n) < 0)
+                    break;
+                stats->bytes += sizeof(header_buf) + n;
+            }
+        }
+
+        if (pfd[1].revents) {
+            if (transfer_read_frame(link, &header, payload) < 0)
+                break;
+
+            if (header.type == MSG_PAGE_END) {
+                shutdown(local, SHUT_WR);
+                status = 0;
+                break;
+            }
+            if (header.type == MSG_PAGE_HASHES) {
+                if (answer_hashes(link, store, asked, payload, header.length, stats) < 0)
+                    break;
+                continue;
+            }
+            if (!local_open)
+                break;
+            if (header.type == MSG_PAGE_BATCH) {
+                if (take_batch(local, store, &z, asked, pages, payload, header.length) < 0) {
+                    fprintf(stderr, "Page batch could not be rebuilt\n");
+                    break;
+                }
+            } else if (header.type != MSG_PAGE_DATA || transfer_send_all(local, payload, header.length) < 0) {
+                break;
+            }
+        }
+    }
+
+    if (have_z)
+        inflateEnd(&z);
+    free(asked);
+    free(payload);
+    free(pages);
+    return status;
+}
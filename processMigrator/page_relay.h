@@ -0,0 +1,25 @@
+#ifndef PAGE_RELAY_H
+#define PAGE_RELAY_H
+
+#include <stdint.h>
+#include "page_store.h"
+
+#define PAGE_RELAY_WINDOW 64 // Batches the dump side has asked about but not yet sent
+
+typedef struct {
+    uint64_t bytes;       // Sent on the link
+    uint64_t pages;       // Pages CRIU sent through the relay
+    uint64_t pages_known; // Of those, pages the target had and were not sent
+} page_relay_stats_t;
+
+// Encoded counterparts of transfer_relay_pages. The dump side reads CRIU's
+// page-server conversation on local, asks the target which pages it lacks
+// and sends only those, compressed on threads worker threads. The
+// page-server side puts the pages back together from the batches and its
+// store and feeds them to its page server. Both add the pages they see to
+// store, which may be NULL. Return 0 once PAGE_END went through, -1 on
+// failure; stats are added to.
+int page_relay_send(int local, int link, page_store_t *store, int threads, page_relay_stats_t *stats);
+int page_relay_receive(int link, int local, page_store_t *store, page_relay_stats_t *stats);
+
+#endif // PAGE_RELAY_H
@@ -0,0 +1,168 @@
+#include "page_store.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define STORE_MAGIC 0x50535431 // "PST1"
+#define FULL_PERCENT 90       // Emptied at the next chance once this full
+
+typedef struct {
+    uint32_t page; // In the pack, counted from 1; 0 while the slot is free
+    uint8_t hash[PAGE_HASH_SIZE];
+} store_slot_t;
+
+struct page_store_index {
+    uint32_t magic;
+    uint32_t capacity; // Pages the pack may hold
+    uint32_t count;    // Pages it holds
+    uint32_t mask;     // Slots - 1; there are at least twice as many as pages
+    store_slot_t slots[];
+};
+
+static size_t index_size(uint32_t slots) {
+    return sizeof(struct page_store_index) + (size_t)slots * sizeof(store_slot_t);
+}
+
+// Start over if the store is missing, built for another size or nearly full.
+// Only called with the store locked exclusively.
+static int reset_if_needed(int index_fd, int pack_fd, uint32_t capacity) {
+    struct page_store_index header;
+    uint32_t slots = 1;
+
+    while (slots < 2 * capacity)
+        slots <<= 1;
+
+    if (pread(index_fd, &header, sizeof(header), 0) == sizeof(header) && header.magic == STORE_MAGIC &&
+        header.capacity == capacity && header.count < (uint64_t)capacity * FULL_PERCENT / 100)
+        return 0;
+
+    header = (struct page_store_index){.magic = STORE_MAGIC, .capacity = capacity, .mask = slots - 1};
+    if (ftruncate(index_fd, 0) < 0 || ftruncate(index_fd, index_size(slots)) < 0 || ftruncate(pack_fd, 0) < 0 ||
+        pwrite(index_fd, &header, sizeof(header), 0) != sizeof(header))
+        return -1;
+    return 0;
+}
+
+static int open_in(const char *dir, const char *name) {
+    char path[4200];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+}
+
+int page_store_open(page_store_t *s, const char *dir, uint32_t capacity) {
+    struct stat st;
+    int index_fd = -1;
+
+    memset(s, 0, sizeof(*s));
+    s->lock_fd = s->pack_fd = -1;
+    if (capacity == 0 || (mkdir(dir, 0700) == -1 && errno != EEXIST) || (s->lock_fd = open_in(dir, "lock")) < 0)
+        return -1;
+    if ((s->pack_fd = open_in(dir, "pages")) < 0 || (index_fd = open_in(dir, "index")) < 0)
+        goto fail;
+
+    // Another migration using the store keeps it as it is
+    if (flock(s->lock_fd, LOCK_EX | LOCK_NB) == 0 && reset_if_needed(index_fd, s->pack_fd, capacity) < 0)
+        goto fail;
+    if (flock(s->lock_fd, LOCK_SH) < 0 || fstat(index_fd, &st) < 0 || (size_t)st.st_size < index_size(0))
+        goto fail;
+
+    s->index_size = st.st_size;
+    s->index = mmap(NULL, s->index_size, PROT_READ | PROT_WRITE, MAP_SHARED, index_fd, 0);
+    if (s->index == MAP_FAILED) {
+        s->index = NULL;
+        goto fail;
+    }
+    close(index_fd);
+    index_fd = -1;
+
+    uint32_t slots = s->index->mask + 1;
+    if (s->index->magic != STORE_MAGIC || (slots & s->index->mask) != 0 || index_size(slots) > s->index_size ||
+        s->index->capacity > slots / 2)
+        goto fail;
+    return 0;
+
+fail:
+    if (index_fd >= 0)
+        close(index_fd);
+    page_store_close(s);
+    return -1;
+}
+
+void page_store_close(page_store_t *s) {
+    if (s->index)
+        munmap(s->index, s->index_size);
+    if (s->pack_fd >= 0)
+        close(s->pack_fd);
+    if (s->lock_fd >= 0)
+        close(s->lock_fd);
+    memset(s, 0, sizeof(*s));
+    s->lock_fd = s->pack_fd = -1;
+}
+
+// SHA-256 cut to 128 bits: collisions stay out of reach across any number of pages a node sees
+void page_store_hash(const uint8_t *page, uint8_t hash[PAGE_HASH_SIZE]) {
+    uint8_t digest[EVP_MAX_MD_SIZE];
+    unsigned int len;
+
+    EVP_Digest(page, PAGE_BYTES, digest, &len, EVP_sha256(), NULL);
+    memcpy(hash, digest, PAGE_HASH_SIZE);
+}
+
+// The slot holding hash, or the free slot where it would go. Slots are
+// published by setting page last, so a slot seen in use has its hash written.
+static store_slot_t *find(page_store_t *s, const uint8_t hash[PAGE_HASH_SIZE]) {
+    struct page_store_index *index = s->index;
+    uint64_t start;
+
+    memcpy(&start, hash, sizeof(start));
+    for (uint32_t i = 0; i <= index->mask; i++) {
+        store_slot_t *slot = &index->slots[(start + i) & index->mask];
+        if (__atomic_load_n(&slot->page, __ATOMIC_ACQUIRE) == 0 || memcmp(slot->hash, hash, PAGE_HASH_SIZE) == 0)
+            return slot;
+    }
+    return NULL;
+}
+
+int page_store_has(page_store_t *s, const uint8_t hash[PAGE_HASH_SIZE]) {
+    store_slot_t *slot = find(s, hash);
+    return slot && slot->page != 0;
+}
+
+int page_store_get(page_store_t *s, const uint8_t hash[PAGE_HASH_SIZE], uint8_t *page) {
+    store_slot_t *slot = find(s, hash);
+
+    if (!slot || slot->page == 0)
+        return -1;
+    off_t offset = (off_t)(slot->page - 1) * PAGE_BYTES;
+    return pread(s->pack_fd, page, PAGE_BYTES, offset) == PAGE_BYTES ? 0 : -1;
+}
+
+void page_store_put(page_store_t *s, const uint8_t (*hashes)[PAGE_HASH_SIZE], const uint8_t *pages, int count) {
+    struct page_store_index *index = s->index;
+
+    // One writer at a time; readers go on meanwhile
+    if (flock(s->pack_fd, LOCK_EX) < 0)
+        return;
+
+    for (int i = 0; i < count && index->count < index->capacity; i++) {
+        store_slot_t *slot = find(s, hashes[i]);
+        if (!slot || slot->page != 0)
+            continue;
+
+        off_t offset = (off_t)index->count * PAGE_BYTES;
+        if (pwrite(s->pack_fd, pages + (size_t)i * PAGE_BYTES, PAGE_BYTES, offset) != PAGE_BYTES)
+            break;
+        memcpy(slot->hash, hashes[i], PAGE_HASH_SIZE);
+        __atomic_store_n(&slot->page, ++index->count, __ATOMIC_RELEASE);
+    }
+
+    flock(s->pack_fd, LOCK_UN);
+}
@@ -0,0 +1,41 @@
+#ifndef PAGE_STORE_H
+#define PAGE_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "migration_protocol.h"
+
+#define PAGE_STORE_MB 256 // Default size of a node's store
+
+// Pages this node has sent or received, found by a hash of their contents.
+// The store is a directory of two files: the pages back to back, and an
+// open-addressing index over them mapped shared. Every job opens the store
+// for itself, so migrations running at once on the agent's worker threads
+// see each other's additions. It only grows; once nearly full it is emptied
+// by the next migration that finds no other one using it.
+typedef struct {
+    int lock_fd;  // Held shared while open
+    int pack_fd;  // The pages; also locked while adding to it
+    struct page_store_index *index;
+    size_t index_size;
+} page_store_t;
+
+// Open the store in dir, creating it for capacity pages if needed.
+// Returns 0 on success, -1 on failure.
+int page_store_open(page_store_t *s, const char *dir, uint32_t capacity);
+void page_store_close(page_store_t *s);
+
+void page_store_hash(const uint8_t *page, uint8_t hash[PAGE_HASH_SIZE]);
+
+// Returns 1 if the page with this hash is stored. A page found is kept until
+// the store is closed.
+int page_store_has(page_store_t *s, const uint8_t hash[PAGE_HASH_SIZE]);
+
+// Copy the page with this hash into page. Returns -1 if it is not stored.
+int page_store_get(page_store_t *s, const uint8_t hash[PAGE_HASH_SIZE], uint8_t *page);
+
+// Add count pages, PAGE_BYTES each, skipping those already stored. Pages that
+// do not fit any more are dropped.
+void page_store_put(page_store_t *s, const uint8_t (*hashes)[PAGE_HASH_SIZE], const uint8_t *pages, int count);
+
+#endif // PAGE_STORE_H
@@ -0,0 +1,335 @@
+#define _GNU_SOURCE
+#include "proc_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#define SLOT_MASK (PROC_TABLE_SLOTS - 1)
+#define MAX_TRACKED (PROC_TABLE_SLOTS / 4 * 3)
+#define PF_KTHREAD 0x00200000 // Kernel threads cannot be checkpointed
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static unsigned int slot_of(pid_t pid) {
+    return ((unsigned int)pid * 2654435761u) & SLOT_MASK;
+}
+
+static proc_entry_t *lookup(proc_table_t *t, pid_t pid) {
+    for (unsigned int i = slot_of(pid);; i = (i + 1) & SLOT_MASK) {
+        if (t->slots[i].pid == pid)
+            return &t->slots[i];
+        if (t->slots[i].pid == 0)
+            return NULL;
+    }
+}
+
+static proc_entry_t *insert(proc_table_t *t, pid_t pid) {
+    if (t->count >= MAX_TRACKED) {
+        if (!t->warned_full)
+            fprintf(stderr, "More than %d processes; the rest are not tracked\n", MAX_TRACKED);
+        t->warned_full = 1;
+        return NULL;
+    }
+
+    unsigned int i = slot_of(pid);
+    while (t->slots[i].pid != 0)
+        i = (i + 1) & SLOT_MASK;
+
+    proc_entry_t *e = &t->slots[i];
+    memset(e, 0, sizeof(*e));
+    e->pid = pid;
+    e->stat_fd = -1;
+    t->count++;
+    return e;
+}
+
+// Free slot i and shift later members of its probe run back, so lookups never
+// stop early at the hole
+static void remove_slot(proc_table_t *t, unsigned int i) {
+    if (t->slots[i].stat_fd >= 0) {
+        close(t->slots[i].stat_fd);
+        t->open_fds--;
+    }
+    t->slots[i].pid = 0;
+    t->count--;
+
+    for (unsigned int j = (i + 1) & SLOT_MASK; t->slots[j].pid != 0; j = (j + 1) & SLOT_MASK) {
+        unsigned int home = slot_of(t->slots[j].pid);
+
+        // Move j into the hole unless its home lies cyclically in (i, j]
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            t->slots[i] = t->slots[j];
+            t->slots[j].pid = 0;
+            i = j;
+        }
+    }
+}
+
+static ssize_t read_file(const char *path, char *buf, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+static ssize_t read_stat(proc_entry_t *e, char *buf, size_t size) {
+    char path[64];
+
+    if (e->stat_fd >= 0) {
+        ssize_t n = pread(e->stat_fd, buf, size - 1, 0);
+        if (n < 0)
+            return -1;
+        buf[n] = '\0';
+        return n;
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", e->pid);
+    return read_file(path, buf, size);
+}
+
+typedef struct {
+    char name[MAX_PROC_NAME];
+    unsigned long flags;
+    unsigned long long minflt;
+    unsigned long long cpu_ticks;
+    unsigned long long starttime;
+} stat_fields_t;
+
+// "pid (comm) state ppid ..." where comm may itself contain spaces and parentheses
+static int parse_stat(const char *buf, stat_fields_t *f) {
+    const char *open_paren = strchr(buf, '(');
+    const char *close_paren = strrchr(buf, ')');
+    unsigned long long utime, stime;
+
+    if (!open_paren || !close_paren || close_paren < open_paren)
+        return -1;
+
+    size_t len = close_paren - open_paren - 1;
+    if (len >= sizeof(f->name))
+        len = sizeof(f->name) - 1;
+    memcpy(f->name, open_paren + 1, len);
+    f->name[len] = '\0';
+
+    // Fields 3 onwards: state ppid pgrp session tty_nr tpgid flags minflt cminflt
+    // majflt cmajflt utime stime cutime cstime priority nice num_threads itrealvalue starttime
+    if (sscanf(close_paren + 2, "%*c %*d %*d %*d %*d %*d %lu %llu %*u %*u %*u %llu %llu %*d %*d %*d %*d %*d %*d %llu",
+               &f->flags, &f->minflt, &utime, &stime, &f->starttime) != 5)
+        return -1;
+
+    f->cpu_ticks = utime + stime;
+    return 0;
+}
+
+// The expensive part: resident size and bytes written through the page cache
+static void refresh_memory(proc_table_t *t, proc_entry_t *e, unsigned long long *write_bytes) {
+    char path[64];
+    char buf[1024];
+    unsigned long long size, resident;
+
+    snprintf(path, sizeof(path), "/proc/%d/statm", e->pid);
+    if (read_file(path, buf, sizeof(buf)) > 0 && sscanf(buf, "%llu %llu", &size, &resident) == 2)
+        e->rss_kb = resident * t->page_kb;
+
+    // io needs ptrace access to the process; without it the fault count has to do
+    snprintf(path, sizeof(path), "/proc/%d/io", e->pid);
+    if (read_file(path, buf, sizeof(buf)) > 0) {
+        const char *line = strstr(buf, "\nwrite_bytes:");
+        if (line)
+            *write_bytes = strtoull(line + 13, NULL, 10);
+    }
+}
+
+static void update_entry(proc_table_t *t, proc_entry_t *e, const stat_fields_t *f, double elapsed) {
+    unsigned long long write_bytes = e->write_bytes;
+
+    if (e->primed && e->starttime != f->starttime) {
+        // Same pid, different process
+        e->primed = 0;
+        e->rss_kb = 0;
+        e->write_bytes = write_bytes = 0;
+    }
+
+    int changed = !e->primed || f->cpu_ticks != e->cpu_ticks || f->minflt != e->minflt;
+    if (changed)
+        refresh_memory(t, e, &write_bytes);
+
+    if (e->primed && elapsed > 0) {
+        e->cpu_usage = (f->cpu_ticks - e->cpu_ticks) * 100.0 / t->ticks_per_sec / elapsed;
+
+        // New anonymous pages show up as minor faults, page cache writes in write_bytes
+        double dirty_kb = (f->minflt - e->minflt) * t->page_kb +
+                          (write_bytes >= e->write_bytes ? (write_bytes - e->write_bytes) / 1024.0 : 0.0);
+        e->dirty_kb_per_sec = (uint32_t)(dirty_kb / elapsed);
+    }
+
+    memcpy(e->name, f->name, sizeof(e->name));
+    e->starttime = f->starttime;
+    e->cpu_ticks = f->cpu_ticks;
+    e->minflt = f->minflt;
+    e->write_bytes = write_bytes;
+    e->primed = 1;
+}
+
+static void scan_process(proc_table_t *t, pid_t pid, double elapsed) {
+    char path[64];
+    char buf[1024];
+    stat_fields_t f;
+
+    proc_entry_t *e = lookup(t, pid);
+    if (!e) {
+        e = insert(t, pid);
+        if (!e)
+            return;
+
+        // Past the table's share of descriptors the file is opened per read
+        // instead, so sockets and the metrics files can still get one
+        if (t->open_fds < t->max_fds) {
+            snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+            e->stat_fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (e->stat_fd >= 0)
+                t->open_fds++;
+        }
+    }
+
+    if (read_stat(e, buf, sizeof(buf)) <= 0 || parse_stat(buf, &f) < 0)
+        return; // Exited mid-scan; the sweep drops it
+
+    e->seen = t->generation;
+    if (f.flags & PF_KTHREAD)
+        return;
+
+    update_entry(t, e, &f, elapsed);
+}
+
+// Keep the k largest entries of top[] sorted in descending order of key
+static void rank(proc_entry_t **top, int *count, proc_entry_t *e, double (*key)(const proc_entry_t *)) {
+    double value = key(e);
+    int pos = *count;
+
+    if (value <= 0.0 || (pos == PROC_TOP_K && value <= key(top[PROC_TOP_K - 1])))
+        return;
+
+    if (pos == PROC_TOP_K)
+        pos--;
+    while (pos > 0 && key(top[pos - 1]) < value) {
+        top[pos] = top[pos - 1];
+        pos--;
+    }
+    top[pos] = e;
+    if (*count < PROC_TOP_K)
+        (*count)++;
+}
+
+static double cpu_key(const proc_entry_t *e) { return e->cpu_usage; }
+static double rss_key(const proc_entry_t *e) { return (double)e->rss_kb; }
+static double dirty_key(const proc_entry_t *e) { return e->dirty_kb_per_sec; }
+
+static void add_to_report(node_report_t *report, const proc_entry_t *e) {
+    for (int i = 0; i < report->num_procs; i++) {
+        if (report->procs[i].pid == (uint32_t)e->pid)
+            return;
+    }
+
+    proc_report_t *p = &report->procs[report->num_procs++];
+    p->pid = e->pid;
+    p->cpu_usage = e->cpu_usage;
+    p->rss_kb = e->rss_kb;
+    p->dirty_kb_per_sec = e->dirty_kb_per_sec;
+    memcpy(p->name, e->name, sizeof(p->name));
+}
+
+int proc_table_open(proc_table_t *t) {
+    struct rlimit limit;
+
+    memset(t, 0, sizeof(*t));
+    t->ticks_per_sec = sysconf(_SC_CLK_TCK);
+    t->page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+        t->max_fds = limit.rlim_cur > PROC_FD_RESERVE + MAX_TRACKED ? MAX_TRACKED
+                                                                   : (int)limit.rlim_cur - PROC_FD_RESERVE;
+    else
+        t->max_fds = MAX_TRACKED;
+    if (t->max_fds < 0)
+        t->max_fds = 0;
+
+    t->proc_dir = opendir("/proc");
+    if (!t->proc_dir) {
+        perror("Failed to open /proc");
+        return -1;
+    }
+    return 0;
+}
+
+void proc_table_scan(proc_table_t *t, node_report_t *report) {
+    long long now = now_us();
+    double elapsed = t->last_scan_us ? (now - t->last_scan_us) / 1e6 : 0.0;
+    pid_t self = getpid();
+    struct dirent *entry;
+
+    t->generation++;
+    t->last_scan_us = now;
+
+    rewinddir(t->proc_dir);
+    while ((entry = readdir(t->proc_dir)) != NULL) {
+        char *end;
+        long pid = strtol(entry->d_name, &end, 10);
+        if (*end != '\0' || pid <= 0 || pid == self)
+            continue;
+        scan_process(t, (pid_t)pid, elapsed);
+    }
+
+    // Drop processes that have exited; a removal may shift the next entry into slot i
+    for (unsigned int i = 0; i < PROC_TABLE_SLOTS; i++) {
+        while (t->slots[i].pid != 0 && t->slots[i].seen != t->generation)
+            remove_slot(t, i);
+    }
+
+    proc_entry_t *by_cpu[PROC_TOP_K], *by_rss[PROC_TOP_K], *by_dirty[PROC_TOP_K];
+    int cpu_count = 0, rss_count = 0, dirty_count = 0;
+
+    for (unsigned int i = 0; i < PROC_TABLE_SLOTS; i++) {
+        proc_entry_t *e = &t->slots[i];
+        if (e->pid == 0 || !e->primed)
+            continue;
+
+        rank(by_cpu, &cpu_count, e, cpu_key);
+        rank(by_rss, &rss_count, e, rss_key);
+        rank(by_dirty, &dirty_count, e, dirty_key);
+    }
+
+    report->num_procs = 0;
+    for (int i = 0; i < cpu_count; i++)
+        add_to_report(report, by_cpu[i]);
+    for (int i = 0; i < dirty_count; i++)
+        add_to_report(report, by_dirty[i]);
+    for (int i = 0; i < rss_count; i++)
+        add_to_report(report, by_rss[i]);
+}
+
+void proc_table_close(proc_table_t *t) {
+    for (unsigned int i = 0; i < PROC_TABLE_SLOTS; i++) {
+        if (t->slots[i].pid != 0 && t->slots[i].stat_fd >= 0)
+            close(t->slots[i].stat_fd);
+        t->slots[i].pid = 0;
+    }
+    if (t->proc_dir)
+        closedir(t->proc_dir);
+    t->proc_dir = NULL;
+    t->count = 0;
+    t->open_fds = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef PROC_TABLE_H
+#define PROC_TABLE_H
+
+#include <dirent.h>
+#include <sys/types.h>
+#include "migration_protocol.h"
+
+#define PROC_TABLE_SLOTS 32768 // Power of two; the table tracks at most 3/4 of this
+#define PROC_TOP_K 8           // Processes ranked per metric
+#define PROC_FD_RESERVE 64     // Descriptors the table leaves for everything else
+
+typedef struct {
+    pid_t pid;                    // 0 marks a free slot
+    unsigned long long starttime; // Tells a reused pid from the process we knew
+    int stat_fd;                  // Kept open between scans; -1 past the table's share of descriptors
+    unsigned int seen;            // Scan generation the process was last found in
+    int primed;
+    char name[MAX_PROC_NAME];
+    unsigned long long cpu_ticks; // utime + stime
+    unsigned long long minflt;
+    unsigned long long write_bytes;
+    float cpu_usage;
+    uint64_t rss_kb;
+    uint32_t dirty_kb_per_sec;
+} proc_entry_t;
+
+// Cache of every process on the node. A scan re-reads each process's stat
+// through a descriptor that stays open; statm and io are only re-read for
+// processes whose CPU time or fault count moved, so idle processes cost one
+// pread. Processes that are gone are dropped at the end of the scan.
+typedef struct {
+    DIR *proc_dir;
+    unsigned int generation;
+    long long last_scan_us;
+    long ticks_per_sec;
+    long page_kb;
+    int count;
+    int open_fds; // stat_fd descriptors held
+    int max_fds;  // RLIMIT_NOFILE less PROC_FD_RESERVE, read at open
+    int warned_full;
+    proc_entry_t slots[PROC_TABLE_SLOTS];
+} proc_table_t;
+
+// Raise the descriptor limit first: it caps how many stat files stay open
+int proc_table_open(proc_table_t *t);
+
+// Refresh every process and rank them: the union of the top PROC_TOP_K by CPU,
+// by RSS and by dirty rate goes into report->procs, busiest first
+void proc_table_scan(proc_table_t *t, node_report_t *report);
+
+void proc_table_close(proc_table_t *t);
+
+#endif // PROC_TABLE_H
@@ -1,56 +1,765 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include "criu.h"
+#include "job_pool.h"
+#include "migration_protocol.h"
+#include "page_relay.h"
+#include "page_store.h"
+#include "transfer.h"
+
+#define CHECKPOINT_DIR "/tmp/checkpoint" // One directory per checkpointed pid
+#define IMAGE_DIR "/dev/shm/process_migrator" // tmpfs: migration images never touch the disk
+#define SERVER_IP "192.168.1.100" // Replace with the central node's IP
+#define SERVER_PORT 5000
+#define AGENT_PORT 5001 // Where executors take images from their peers
+#define CONNECT_TIMEOUT_S 10
+#define RESTORE_TIMEOUT_S 300
+#define PEER_TIMEOUT_S 120 // A source silent this long mid-migration is taken for gone
+#define KEEPALIVE_IDLE_S 30 // Then probed every KEEPALIVE_INTERVAL_S, given up after KEEPALIVE_PROBES
+#define KEEPALIVE_INTERVAL_S 10
+#define KEEPALIVE_PROBES 3
+#define RECONNECT_MIN_MS 1000
+#define RECONNECT_MAX_MS 30000
+#define EXIT_WAIT_MS 5000 // For a killed tree to be reaped and give up its pids
+#define PRECOPY_ROUNDS 5    // Pre-dumps at most before the final dump
+#define PRECOPY_STOP_PAGES 4096 // A round dirtying fewer pages than this is close enough to stop
+#define COMPRESS_THREADS 4 // At most, and no more than there are CPUs
+#define MIGRATION_WORKERS 4 // Outgoing migrations run at once
+#define INCOMING_WORKERS 8  // Incoming ones; kept apart, so two nodes sending to each other cannot starve both
+
+static criu_t criu;
+static const char *image_root = IMAGE_DIR;
+static int precopy_rounds = PRECOPY_ROUNDS;
+static uint64_t precopy_stop_pages = PRECOPY_STOP_PAGES;
+static uint32_t store_pages = PAGE_STORE_MB * (1024 * 1024 / PAGE_BYTES); // 0 sends pages as CRIU does
+static int compress_threads;
+static int migration_workers = MIGRATION_WORKERS;
+static char jobs_root[4096];
+static job_pool_t outgoing, incoming;
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
 
 void checkpoint_process(pid_t pid) {
-    char command[256];
-    const char *checkpoint_dir = "/tmp/checkpoint";
+    criu_dump_stats_t stats;
+    criu_session_t session;
+    char dir[64];
 
-    // Create the checkpoint directory if it doesn't exist
-    if (mkdir(checkpoint_dir, 0755) == -1 && access(checkpoint_dir, F_OK) != 0) {
+    // Checkpoints of different processes do not overwrite each other
+    snprintf(dir, sizeof(dir), "%s/%d", CHECKPOINT_DIR, pid);
+    if (mkdir(CHECKPOINT_DIR, 0755) == -1 && errno != EEXIST) {
         perror("Failed to create checkpoint directory");
         return;
     }
+    if (job_prepare_dir(dir) < 0)
+        return;
+
+    criu_session_init(&session, &criu);
+    if (criu_dump(&session, pid, dir, &stats) == 0)
+        printf("Checkpointed %d into %s (frozen for %.1f ms)\n", pid, dir, stats.frozen_us / 1000.0);
+    criu_session_close(&session);
+}
+
+void restore_process(pid_t pid) {
+    criu_session_t session;
+    char dir[64];
+
+    snprintf(dir, sizeof(dir), "%s/%d", CHECKPOINT_DIR, pid);
+    criu_session_init(&session, &criu);
+    if (criu_restore(&session, dir, &pid) == 0)
+        printf("Restored process %d\n", pid);
+    criu_session_close(&session);
+}
+
+// Have the kernel notice a peer that vanished, host and all, within about a
+// minute: the relays wait in poll() without a timeout of their own
+static void keep_alive(int sock) {
+    int on = 1, idle = KEEPALIVE_IDLE_S, interval = KEEPALIVE_INTERVAL_S, probes = KEEPALIVE_PROBES;
+
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+}
+
+static int connect_to(const char *address, int port) {
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port)};
+
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Invalid address '%s'\n", address);
+        return -1;
+    }
+
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+
+    // Bounds the connect; a dead peer is not waited on for minutes
+    struct timeval timeout = {.tv_sec = CONNECT_TIMEOUT_S};
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    keep_alive(sock);
+
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static void print_result(const migrate_result_t *r) {
+    static const char *outcome[] = {"migrated", "dump failed", "transfer failed", "restore failed"};
+
+    printf("Order #%u, pid %u: %s; downtime %.1f ms (freeze %.1f ms, dump %.1f ms, transfer %.1f ms, restore %.1f ms), %llu bytes\n",
+           r->order_id, r->pid, r->status <= MIGRATE_RESTORE_FAILED ? outcome[r->status] : "failed",
+           r->downtime_us / 1000.0, r->freeze_us / 1000.0, r->dump_us / 1000.0, r->transfer_us / 1000.0,
+           r->restore_us / 1000.0, (unsigned long long)r->bytes);
+    for (int i = 0; i < r->num_rounds; i++) {
+        printf("  %s %d: %llu bytes in %.1f ms, stopped for %.1f ms", i + 1 < r->num_rounds ? "Pre-dump" : "Dump",
+               i + 1, (unsigned long long)r->rounds[i].bytes, r->rounds[i].duration_us / 1000.0,
+               r->rounds[i].downtime_us / 1000.0);
+        if (r->rounds[i].pages > 0)
+            printf("; %llu of %llu pages already there", (unsigned long long)r->rounds[i].pages_known,
+                   (unsigned long long)r->rounds[i].pages);
+        printf("\n");
+    }
+}
+
+// Send sig to pid and all its descendants. The tree is stopped, so it cannot
+// change while it is walked.
+static void signal_tree(pid_t pid, int sig) {
+    char path[320];
+    DIR *tasks;
+    struct dirent *task;
+
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    if ((tasks = opendir(path)) != NULL) {
+        while ((task = readdir(tasks)) != NULL) {
+            if (task->d_name[0] == '.')
+                continue;
+
+            snprintf(path, sizeof(path), "/proc/%d/task/%s/children", pid, task->d_name);
+            FILE *f = fopen(path, "r");
+            if (!f)
+                continue;
+            int child;
+            while (fscanf(f, "%d", &child) == 1)
+                signal_tree(child, sig);
+            fclose(f);
+        }
+        closedir(tasks);
+    }
+    kill(pid, sig);
+}
+
+// Wait until pid is reaped, which frees it for a restore; its descendants,
+// orphaned, are reaped by init meanwhile. Returns -1 if it is still there.
+static int await_exit(pid_t pid) {
+    for (int waited = 0; waited < EXIT_WAIT_MS; waited += 10) {
+        if (kill(pid, 0) < 0 && errno == ESRCH)
+            return 0;
+        usleep(10000);
+    }
+    return -1;
+}
+
+// Whether sock leads back to this host, where the target restores into the
+// pid namespace the source tree still holds its pids in
+static int same_host(int sock) {
+    struct sockaddr_in local, peer;
+    socklen_t local_len = sizeof(local), peer_len = sizeof(peer);
 
-    snprintf(command, sizeof(command), "criu dump -t %d -D %s --shell-job --unprivileged", pid, checkpoint_dir);
-    int ret = system(command);
-    if (ret != 0) {
-        printf("Checkpointing failed. Ensure CRIU is configured correctly and the process is checkpointable.\n");
+    if (getsockname(sock, (struct sockaddr *)&local, &local_len) < 0 ||
+        getpeername(sock, (struct sockaddr *)&peer, &peer_len) < 0)
+        return 0;
+    return local.sin_addr.s_addr == peer.sin_addr.s_addr;
+}
+
+// Wait for the target to report on its restore. Fills in restore_us and status.
+static void await_restore(int sock, const migrate_order_t *order, migrate_result_t *result) {
+    uint8_t *frame = malloc(PROTOCOL_MAX_PAYLOAD);
+    frame_header_t header;
+    migrate_result_t reply;
+
+    struct timeval timeout = {.tv_sec = RESTORE_TIMEOUT_S};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (!frame || transfer_read_frame(sock, &header, frame) < 0 || header.type != MSG_RESTORED ||
+        protocol_decode_result(frame, header.length, &reply) < 0) {
+        fprintf(stderr, "No restore result from %s\n", order->target_address);
+        result->status = MIGRATE_RESTORE_FAILED;
+    } else {
+        result->status = reply.status;
+        result->restore_us = reply.restore_us;
     }
+    free(frame);
 }
 
-void restore_process() {
-    char command[256];
-    const char *checkpoint_dir = "/tmp/checkpoint";
+// Open the node's page store, which all migrations through it share, into
+// store. Returns NULL if there is none to use.
+static page_store_t *open_store(page_store_t *store) {
+    char dir[4096];
 
-    snprintf(command, sizeof(command), "criu restore -D %s --shell-job --unprivileged", checkpoint_dir);
-    int ret = system(command);
-    if (ret != 0) {
-        printf("Restoring failed. Ensure CRIU is configured correctly and the checkpoint exists.\n");
+    snprintf(dir, sizeof(dir), "%s/store", image_root);
+    if (store_pages == 0)
+        return NULL;
+    if (page_store_open(store, dir, store_pages) < 0) {
+        fprintf(stderr, "Page store in %s unusable; pages are compressed but not deduplicated\n", dir);
+        return NULL;
     }
+    return store;
+}
+
+// One round of copying the process's memory to the target's page server: a
+// pre-dump while it runs, or the final dump, which leaves it stopped so a
+// migration that fails later can still resume it here. Unless the store is
+// turned off, only pages the target lacks are sent. The round is added to
+// result; returns -1 if CRIU failed.
+static int dump_round(criu_session_t *session, int sock, const migrate_order_t *order, const char *dump_root, int round,
+                      int final, page_store_t *store, migrate_result_t *result, criu_dump_stats_t *stats) {
+    uint8_t frame[PROTOCOL_HEADER_SIZE + 16];
+    char dir[4096], prev[32];
+    precopy_round_t *r = &result->rounds[result->num_rounds];
+
+    snprintf(dir, sizeof(dir), "%s/%d", dump_root, round);
+    snprintf(prev, sizeof(prev), "../%d", round - 1);
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+        perror("Failed to create checkpoint directory");
+        return -1;
+    }
+
+    page_stream_t stream = {.round = round, .final = final, .encoded = store_pages > 0};
+    size_t len = protocol_encode_page_stream(frame, sizeof(frame), &stream);
+    if (transfer_send_all(sock, frame, len) < 0)
+        return -1;
+
+    // Later rounds only copy the pages written since the one before
+    criu_dump_opts_t opts = {
+        .page_server = 1,
+        .leave_stopped = final,
+        .pre_dump = !final,
+        .track_mem = precopy_rounds > 0,
+        .prev_images_dir = round > 1 ? prev : NULL,
+    };
+    long long start = now_us();
+    int ps = criu_dump_start(session, order->pid, dir, &opts);
+
+    // CRIU hangs up once the page server acknowledged the last page, or on failure
+    page_relay_stats_t relay = {0};
+    if (ps >= 0 && (stream.encoded ? page_relay_send(ps, sock, store, compress_threads, &relay)
+                                   : transfer_relay_pages(ps, sock, 1, &relay.bytes)) < 0)
+        fprintf(stderr, "Page stream to %s broken\n", order->target_address);
+    if (ps >= 0)
+        close(ps);
+    r->bytes = relay.bytes;
+    r->pages = relay.pages;
+    r->pages_known = relay.pages_known;
+
+    if (criu_dump_finish(session, dir, stats) < 0)
+        return -1;
+    r->duration_us = now_us() - start;
+    r->downtime_us = stats->frozen_us;
+    result->bytes += r->bytes;
+    result->num_rounds++;
+    return 0;
+}
+
+// Pages a round took from the process. A stream that was not encoded is not
+// counted page by page, but is nearly all page data.
+static uint64_t round_pages(const precopy_round_t *r) {
+    return r->pages ? r->pages : r->bytes / PAGE_BYTES;
+}
+
+// Pre-dump while the process keeps running, until the pages dirtied between
+// rounds are few enough or stop shrinking. Returns the last round, or -1.
+static int precopy(criu_session_t *session, int sock, const migrate_order_t *order, const char *dump_root,
+                   page_store_t *store, migrate_result_t *result) {
+    criu_dump_stats_t stats;
+    int round = 0;
+
+    while (round < precopy_rounds && round + 1 < MAX_PRECOPY_ROUNDS) {
+        round++;
+        if (dump_round(session, sock, order, dump_root, round, 0, store, result, &stats) < 0)
+            return -1;
+
+        uint64_t pages = round_pages(&result->rounds[round - 1]);
+        printf("Order #%u pre-dump %d: %llu pages, %llu bytes in %.1f ms\n", order->order_id, round,
+               (unsigned long long)pages, (unsigned long long)result->rounds[round - 1].bytes,
+               result->rounds[round - 1].duration_us / 1000.0);
+
+        // Judged by what the process dirtied, not by what crossed the link,
+        // which dedup and compression shrink. Not converging: the process
+        // dirties memory about as fast as it is copied.
+        if (pages <= precopy_stop_pages || (round > 1 && pages * 10 > round_pages(&result->rounds[round - 2]) * 9))
+            break;
+    }
+    return round;
+}
+
+// Source side of a migration, run by a worker: copy memory while the process
+// runs, then stop it for a final dump that only carries what changed since.
+// The remaining image files follow, and the process is resumed here if the
+// target could not restore it.
+static void migrate_process(job_t *job) {
+    uint8_t frame[PROTOCOL_HEADER_SIZE + 16];
+    char dir[4200];
+    criu_dump_stats_t stats;
+    criu_session_t session;
+    page_store_t store_buf;
+    const migrate_order_t *order = &job->order;
+    migrate_result_t *result = &job->result;
+    const char *dump_root = job->dir;
+
+    memset(result, 0, sizeof(*result));
+    result->order_id = order->order_id;
+    result->pid = order->pid;
+    result->status = MIGRATE_TRANSFER_FAILED;
+
+    job_set_state(job, JOB_DUMPING);
+    int sock = connect_to(order->target_address, order->target_port);
+    if (sock < 0) {
+        fprintf(stderr, "Failed to reach %s:%d: %s\n", order->target_address, order->target_port, strerror(errno));
+        return;
+    }
+
+    // CRIU resumes the tree itself when a dump fails. All rounds go to one
+    // worker, which exits after the final dump.
+    page_store_t *store = open_store(&store_buf);
+    criu_session_init(&session, &criu);
+    int round = precopy(&session, sock, order, dump_root, store, result);
+    int dumped = round >= 0 && dump_round(&session, sock, order, dump_root, round + 1, 1, store, result, &stats) == 0;
+    criu_session_close(&session);
+    if (store)
+        page_store_close(store);
+    if (!dumped) {
+        result->status = MIGRATE_DUMP_FAILED;
+        close(sock);
+        return;
+    }
+    result->dump_us = result->rounds[round].duration_us;
+    result->freeze_us = stats.freezing_us;
+
+    job_set_state(job, JOB_TRANSFERRING);
+    long long start = now_us();
+    image_end_t end = {.order_id = order->order_id, .pid = order->pid};
+    size_t len = protocol_encode_image_end(frame, sizeof(frame), &end);
+    snprintf(dir, sizeof(dir), "%s/%d", dump_root, round + 1);
+    int sent = transfer_send_dir(sock, dir, &result->bytes) == 0;
+
+    // CRIU restores the tree under its old pids, which on this host are
+    // still taken: it has to go before the target may restore it, and can no
+    // longer be resumed if that fails
+    int killed = sent && same_host(sock);
+    if (killed) {
+        signal_tree(order->pid, SIGKILL);
+        if (await_exit(order->pid) < 0)
+            fprintf(stderr, "Process %u not reaped yet; its restore will fail\n", order->pid);
+    }
+
+    if (!sent || transfer_send_all(sock, frame, len) < 0) {
+        fprintf(stderr, "Failed to send images to %s\n", order->target_address);
+    } else {
+        result->transfer_us = now_us() - start;
+        job_set_state(job, JOB_RESTORING);
+        await_restore(sock, order, result);
+    }
+    close(sock);
+
+    // Stopped from the final dump until the target had it running again
+    result->downtime_us = result->dump_us + result->transfer_us + result->restore_us;
+    result->rounds[round].downtime_us = result->downtime_us;
+
+    if (result->status == MIGRATE_OK) {
+        // On this host, the pid is the restored process's now
+        if (!killed)
+            signal_tree(order->pid, SIGKILL);
+        job_set_state(job, JOB_DONE);
+    } else if (killed) {
+        fprintf(stderr, "Migration of %u failed after it was killed for a restore on this host; it is lost\n", order->pid);
+    } else {
+        fprintf(stderr, "Migration of %u failed; resuming it here\n", order->pid);
+        signal_tree(order->pid, SIGCONT);
+    }
+}
+
+// Run a page server for one round of the source's dump, fed from the link
+static int receive_pages(criu_session_t *session, int sock, const char *dir, const page_stream_t *stream,
+                         page_store_t *store) {
+    page_relay_stats_t relay = {0};
+
+    int ps = criu_page_server(session, dir);
+    if (ps < 0)
+        return -1;
+    int status = stream->encoded ? page_relay_receive(sock, ps, store, &relay)
+                                 : transfer_relay_pages(ps, sock, 0, &relay.bytes);
+    criu_page_server_close(ps);
+    return status;
+}
+
+// Take the page streams of all rounds, each into a directory linked to the
+// previous one as its parent. Leaves the final round's directory in dir.
+static int receive_rounds(criu_session_t *session, int sock, const char *restore_root, page_store_t *store, char *dir,
+                          size_t size) {
+    uint8_t payload[PROTOCOL_HEADER_SIZE + 16];
+    frame_header_t header;
+    page_stream_t stream = {0};
+    char parent[32], link[4300];
+
+    for (uint32_t round = 1; !stream.final; round++) {
+        // Read by hand: anything but a small PAGE_STREAM is out of place here
+        if (transfer_recv_all(sock, payload, PROTOCOL_HEADER_SIZE) < 0 ||
+            protocol_decode_header(payload, PROTOCOL_HEADER_SIZE, &header) < 0 || header.type != MSG_PAGE_STREAM ||
+            header.length > sizeof(payload) || transfer_recv_all(sock, payload, header.length) < 0 ||
+            protocol_decode_page_stream(payload, header.length, &stream) < 0 || stream.round != round)
+            return -1;
+
+        snprintf(dir, size, "%s/%u", restore_root, round);
+        snprintf(parent, sizeof(parent), "../%u", round - 1);
+        if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+            return -1;
+        snprintf(link, sizeof(link), "%s/parent", dir);
+        if (round > 1 && symlink(parent, link) < 0)
+            return -1;
+        if (receive_pages(session, sock, dir, &stream, store) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Target side, run by a worker: take the images and restore them
+static void serve_peer(job_t *job) {
+    uint8_t frame[PROTOCOL_HEADER_SIZE + sizeof(migrate_result_t) + 16];
+    char dir[4200];
+    image_end_t end;
+    uint64_t bytes = 0;
+    migrate_result_t *reply = &job->result;
+    criu_session_t session;
+    page_store_t store_buf;
+
+    reply->status = MIGRATE_TRANSFER_FAILED;
+    job_set_state(job, JOB_TRANSFERRING);
+
+    // The page servers of all rounds and the restore go to one worker
+    page_store_t *store = open_store(&store_buf);
+    criu_session_init(&session, &criu);
+    int status = receive_rounds(&session, job->sock, job->dir, store, dir, sizeof(dir));
+    if (store)
+        page_store_close(store);
+    if (status < 0 || transfer_receive_dir(job->sock, dir, &end, &bytes) < 0) {
+        fprintf(stderr, "Job %u: image transfer failed\n", job->id);
+        criu_session_close(&session);
+        return;
+    }
+
+    printf("Job %u: received images for order #%u (pid %u)\n", job->id, end.order_id, end.pid);
+    reply->order_id = end.order_id;
+    reply->pid = end.pid;
+
+    job_set_state(job, JOB_RESTORING);
+    long long start = now_us();
+    reply->status = criu_restore(&session, dir, NULL) == 0 ? MIGRATE_OK : MIGRATE_RESTORE_FAILED;
+    reply->restore_us = now_us() - start;
+    criu_session_close(&session);
+
+    size_t len = protocol_encode_result(frame, sizeof(frame), MSG_RESTORED, reply);
+    if (transfer_send_all(job->sock, frame, len) == 0 && reply->status == MIGRATE_OK)
+        job_set_state(job, JOB_DONE);
+}
+
+static int listen_on(int port) {
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = INADDR_ANY};
+    int on = 1;
+
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 16) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// A restore can take a while; the agent keeps serving orders meanwhile
+static void accept_peer(int listen_sock) {
+    int sock = accept4(listen_sock, NULL, NULL, SOCK_CLOEXEC);
+    if (sock < 0)
+        return;
+
+    // A source that is gone must not hold an incoming worker for good
+    struct timeval timeout = {.tv_sec = PEER_TIMEOUT_S};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    keep_alive(sock);
+
+    job_t *job = job_create(jobs_root);
+    if (!job) {
+        close(sock);
+        return;
+    }
+    job->sock = sock;
+    job_pool_submit(&incoming, job);
+}
+
+static int send_result(int sock, const migrate_result_t *result) {
+    uint8_t frame[PROTOCOL_HEADER_SIZE + sizeof(migrate_result_t) + 16];
+
+    size_t len = protocol_encode_result(frame, sizeof(frame), MSG_RESULT, result);
+    return transfer_send_all(sock, frame, len);
+}
+
+// One frame from the manager. Returns -1 once the connection is unusable.
+static int handle_manager(int sock) {
+    static uint8_t frame[PROTOCOL_MAX_PAYLOAD];
+    frame_header_t header;
+    migrate_order_t order;
+
+    if (transfer_read_frame(sock, &header, frame) < 0)
+        return -1;
+    if (header.type != MSG_MIGRATE)
+        return 0;
+    if (protocol_decode_migrate(frame, header.length, &order) < 0)
+        return -1;
+
+    job_t *job = job_create(jobs_root);
+    if (!job) {
+        migrate_result_t result = {.order_id = order.order_id, .pid = order.pid, .status = MIGRATE_DUMP_FAILED};
+        return send_result(sock, &result);
+    }
+
+    printf("Order #%u: migrate pid %u to %s (%s:%u) as job %u\n", order.order_id, order.pid, order.target_node,
+           order.target_address, order.target_port, job->id);
+    job->order = order;
+    job_pool_submit(&outgoing, job);
+    return 0;
+}
+
+// Report finished migrations to the manager, if it is there to hear of them.
+// Returns -1 once the connection is unusable.
+static int reap_jobs(int manager_sock) {
+    int status = 0;
+    job_t *job;
+
+    while ((job = job_pool_reap(&outgoing)) != NULL) {
+        print_result(&job->result);
+        if (manager_sock < 0)
+            fprintf(stderr, "Job %u: no server connection to report order #%u to\n", job->id, job->order.order_id);
+        else if (status == 0 && send_result(manager_sock, &job->result) < 0)
+            status = -1;
+        job_destroy(job);
+    }
+    while ((job = job_pool_reap(&incoming)) != NULL)
+        job_destroy(job);
+    return status;
+}
+
+// Executor: carry out the manager's orders and take in processes from peers,
+// each migration a job of its own on one of the worker pools
+static int run_agent(const char *server_ip, int port, int listen_port, const hello_t *hello) {
+    uint8_t frame[PROTOCOL_HEADER_SIZE + sizeof(hello_t) + 8];
+    int manager_sock = -1;
+    int backoff_ms = RECONNECT_MIN_MS;
+    long long retry_at = 0;
+
+    int listen_sock = listen_on(listen_port);
+    if (listen_sock < 0) {
+        fprintf(stderr, "Failed to listen on port %d: %s\n", listen_port, strerror(errno));
+        return 1;
+    }
+    if (job_pool_start(&outgoing, migration_workers, migrate_process) < 0 ||
+        job_pool_start(&incoming, INCOMING_WORKERS, serve_peer) < 0) {
+        fprintf(stderr, "Failed to start migration workers\n");
+        return 1;
+    }
+    printf("Executor %s accepting migrations on port %d, running up to %d at once\n", hello->node_id, listen_port,
+           migration_workers);
+
+    while (1) {
+        long long now = now_us() / 1000;
+        if (manager_sock < 0 && now >= retry_at) {
+            manager_sock = connect_to(server_ip, port);
+            size_t len = protocol_encode_hello(frame, sizeof(frame), hello);
+            if (manager_sock >= 0 && transfer_send_all(manager_sock, frame, len) == 0) {
+                printf("Connected to server %s:%d\n", server_ip, port);
+                backoff_ms = RECONNECT_MIN_MS;
+            } else {
+                if (manager_sock >= 0)
+                    close(manager_sock);
+                manager_sock = -1;
+                retry_at = now + backoff_ms / 2 + rand() % (backoff_ms / 2 + 1);
+                backoff_ms = backoff_ms * 2 > RECONNECT_MAX_MS ? RECONNECT_MAX_MS : backoff_ms * 2;
+            }
+        }
+
+        struct pollfd pfd[4] = {
+            {.fd = listen_sock, .events = POLLIN},
+            {.fd = manager_sock, .events = POLLIN},
+            {.fd = outgoing.done_fd, .events = POLLIN},
+            {.fd = incoming.done_fd, .events = POLLIN},
+        };
+        int timeout = manager_sock < 0 ? (int)(retry_at > now ? retry_at - now : 0) : 1000;
+        if (poll(pfd, 4, timeout) <= 0)
+            continue;
+
+        if (pfd[0].revents & POLLIN)
+            accept_peer(listen_sock);
+
+        int lost = manager_sock >= 0 && pfd[1].revents & (POLLIN | POLLHUP | POLLERR) && handle_manager(manager_sock) < 0;
+        if ((pfd[2].revents | pfd[3].revents) & POLLIN && reap_jobs(lost ? -1 : manager_sock) < 0)
+            lost = 1;
+
+        if (lost) {
+            fprintf(stderr, "Connection to server lost\n");
+            close(manager_sock);
+            manager_sock = -1;
+            retry_at = now_us() / 1000 + backoff_ms;
+        }
+    }
+
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s checkpoint <pid> | restore <pid> | migrate <pid> <address> <port> | agent [options]\n", prog);
+    printf("Options: [-c criu] [-d image_dir] [-r precopy_rounds] [-t precopy_stop_pages] [-S store_mb] [-j compress_threads]\n");
+    printf("         and, for agent, [-s server_ip] [-p port] [-n node_id] [-l listen_port] [-w workers]\n");
 }
 
 int main(int argc, char *argv[]) {
+    const char *server_ip = SERVER_IP;
+    const char *criu_binary = NULL;
+    int port = SERVER_PORT;
+    int listen_port = AGENT_PORT;
+    hello_t hello = {.role = ROLE_EXECUTOR};
+    int opt;
+
     if (argc < 2) {
-        printf("Usage: %s <checkpoint|restore> [pid]\n", argv[0]);
+        usage(argv[0]);
         return 1;
     }
+    const char *command = argv[1];
+
+    gethostname(hello.node_id, sizeof(hello.node_id) - 1);
+
+    // Options follow the command; what is left are its arguments
+    while ((opt = getopt(argc - 1, argv + 1, "c:d:r:t:S:j:s:p:n:l:w:")) != -1) {
+        switch (opt) {
+        case 'c':
+            criu_binary = optarg;
+            break;
+        case 'd':
+            image_root = optarg;
+            break;
+        case 'r':
+            precopy_rounds = atoi(optarg);
+            break;
+        case 't':
+            precopy_stop_pages = strtoull(optarg, NULL, 10);
+            break;
+        case 'S':
+            store_pages = strtoul(optarg, NULL, 10) * (1024 * 1024 / PAGE_BYTES);
+            break;
+        case 'j':
+            compress_threads = atoi(optarg);
+            break;
+        case 's':
+            server_ip = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            snprintf(hello.node_id, sizeof(hello.node_id), "%s", optarg);
+            break;
+        case 'l':
+            listen_port = atoi(optarg);
+            break;
+        case 'w':
+            migration_workers = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    char **args = argv + 1 + optind;
+    int num_args = argc - 1 - optind;
+
+    criu_init(&criu, criu_binary);
+    snprintf(jobs_root, sizeof(jobs_root), "%s/jobs", image_root);
+    if (compress_threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        compress_threads = cpus < 1 ? 1 : cpus > COMPRESS_THREADS ? COMPRESS_THREADS : cpus;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0); // Keep the log current when redirected to a file
 
-    if (strcmp(argv[1], "checkpoint") == 0) {
-        if (argc < 3) {
+    if (strcmp(command, "checkpoint") == 0) {
+        if (num_args < 1) {
             printf("Please provide a PID to checkpoint.\n");
             return 1;
         }
-        pid_t pid = atoi(argv[2]);
+        pid_t pid = atoi(args[0]);
         checkpoint_process(pid);
-    } else if (strcmp(argv[1], "restore") == 0) {
-        restore_process();
+    } else if (strcmp(command, "restore") == 0) {
+        if (num_args < 1) {
+            printf("Please provide the PID of the checkpoint to restore.\n");
+            return 1;
+        }
+        restore_process(atoi(args[0]));
+    } else if (strcmp(command, "migrate") == 0) {
+        if (num_args < 3) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        // An agent may be using the same directory, so nothing is cleared
+        mkdir(image_root, 0700);
+        mkdir(jobs_root, 0700);
+        job_t *job = job_create(jobs_root);
+        if (!job)
+            return 1;
+        job->order.pid = atoi(args[0]);
+        job->order.target_port = atoi(args[2]);
+        snprintf(job->order.target_address, sizeof(job->order.target_address), "%s", args[1]);
+
+        migrate_process(job);
+        print_result(&job->result);
+        int status = job->result.status == MIGRATE_OK ? 0 : 1;
+        job_set_state(job, status == 0 ? JOB_DONE : JOB_FAILED);
+        job_destroy(job);
+        return status;
+    } else if (strcmp(command, "agent") == 0) {
+        hello.port = listen_port;
+        if (migration_workers < 1)
+            migration_workers = 1;
+        if (mkdir(image_root, 0700) == -1 && errno != EEXIST) {
+            perror("Failed to create checkpoint directory");
+            return 1;
+        }
+        // Jobs of an earlier run are gone with it
+        if (job_prepare_dir(jobs_root) < 0)
+            return 1;
+        srand(getpid() ^ (unsigned int)now_us());
+        return run_agent(server_ip, port, listen_port, &hello);
     } else {
-        printf("Invalid command. Use 'checkpoint' or 'restore'.\n");
+        printf("Invalid command. Use 'checkpoint', 'restore', 'migrate' or 'agent'.\n");
     }
 
     return 0;
-}
\ No newline at end of file
+}
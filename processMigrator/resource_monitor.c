@@ -2,68 +2,313 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
 #include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "migration_protocol.h"
+#include "node_metrics.h"
+#include "proc_table.h"
 
 #define SERVER_IP "192.168.1.100" // Replace with the central node's IP
 #define SERVER_PORT 5000
+#define SAMPLE_INTERVAL_MS 5000
+#define RECONNECT_MIN_MS 1000
+#define RECONNECT_MAX_MS 30000
+#define QUEUE_SIZE (256 * 1024) // Reports kept while the manager is slow or away
 
-void get_resource_usage(float *cpu_usage, float *memory_usage) {
-    FILE *fp;
-    char buffer[128];
-
-    // Get CPU usage
-    fp = popen("top -bn1 | grep 'Cpu(s)' | awk '{print $2 + $4}'", "r");
-    fgets(buffer, sizeof(buffer), fp);
-    *cpu_usage = atof(buffer);
-    pclose(fp);
-
-    // Get memory usage
-    fp = popen("free | grep Mem | awk '{print $3/$2 * 100.0}'", "r");
-    fgets(buffer, sizeof(buffer), fp);
-    *memory_usage = atof(buffer);
-    pclose(fp);
+// Long-lived connection to the manager. Encoded frames wait in the queue until
+// the socket takes them, so a slow manager gets several reports per write and
+// an absent one gets the backlog once it is back.
+typedef struct uplink {
+    struct sockaddr_in addr;
+    hello_t hello;
+    int sock;        // -1 while disconnected
+    int connecting;  // Non-blocking connect in flight
+    int backoff_ms;
+    long long retry_at; // Monotonic time of the next connection attempt
+    uint8_t queue[QUEUE_SIZE];
+    size_t queued;
+    size_t sent; // Bytes at the front of the queue already written
+} uplink_t;
+
+static uplink_t uplink;
+static node_metrics_t metrics;
+static proc_table_t processes;
+static node_report_t report;
+
+// The process table keeps a descriptor per process, up to the limit less a
+// reserve, so allow as many as the hard limit does
+static void raise_fd_limit(void) {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static long long now_ms(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static size_t frame_length(const uint8_t *frame) {
+    frame_header_t header;
+    protocol_decode_header(frame, PROTOCOL_HEADER_SIZE, &header);
+    return PROTOCOL_HEADER_SIZE + header.length;
+}
+
+static int front_is_hello(const uplink_t *u) {
+    frame_header_t header;
+    return u->queued > 0 && protocol_decode_header(u->queue, PROTOCOL_HEADER_SIZE, &header) >= 0 &&
+           header.type == MSG_HELLO;
+}
+
+static void queue_remove(uplink_t *u, size_t offset, size_t len) {
+    memmove(u->queue + offset, u->queue + offset + len, u->queued - offset - len);
+    u->queued -= len;
+}
+
+// Make room by dropping the oldest reports that have not started going out
+static int queue_reserve(uplink_t *u, size_t len) {
+    if (len > sizeof(u->queue))
+        return -1;
+
+    while (sizeof(u->queue) - u->queued < len) {
+        size_t offset = u->sent > 0 || front_is_hello(u) ? frame_length(u->queue) : 0;
+        if (offset >= u->queued)
+            return -1;
+        queue_remove(u, offset, frame_length(u->queue + offset));
+    }
+    return 0;
+}
+
+static void queue_report(uplink_t *u, const node_report_t *report) {
+    uint8_t frame[PROTOCOL_HEADER_SIZE + PROTOCOL_MAX_PAYLOAD];
+    size_t len = protocol_encode_report(frame, sizeof(frame), report);
+
+    if (len == 0 || queue_reserve(u, len) < 0) {
+        fprintf(stderr, "Report does not fit the send queue; dropped\n");
+        return;
+    }
+    memcpy(u->queue + u->queued, frame, len);
+    u->queued += len;
 }
 
-void send_data_to_server(float cpu_usage, float memory_usage) {
-    int sock;
-    struct sockaddr_in server_addr;
-    char message[128];
+static void disconnect(uplink_t *u, const char *reason) {
+    if (reason)
+        fprintf(stderr, "Connection to server lost: %s\n", reason);
+
+    close(u->sock);
+    u->sock = -1;
+    u->connecting = 0;
+
+    // The rest of a half-written frame would desynchronise the next connection,
+    // and the next connection opens with its own HELLO
+    if (u->sent > 0 || front_is_hello(u))
+        queue_remove(u, 0, frame_length(u->queue));
+    u->sent = 0;
+
+    // Jitter spreads a cluster's reconnects after a manager restart
+    u->retry_at = now_ms(CLOCK_MONOTONIC) + u->backoff_ms / 2 + rand() % (u->backoff_ms / 2 + 1);
+    u->backoff_ms = u->backoff_ms * 2 > RECONNECT_MAX_MS ? RECONNECT_MAX_MS : u->backoff_ms * 2;
+}
 
-    // Create socket
-    sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
+static void start_connect(uplink_t *u) {
+    u->sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (u->sock < 0) {
         perror("Socket creation failed");
-        exit(1);
+        u->retry_at = now_ms(CLOCK_MONOTONIC) + u->backoff_ms;
+        return;
     }
 
-    // Configure server address
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(SERVER_PORT);
-    inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr);
-
-    // Connect to server
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Connection to server failed");
-        close(sock);
-        exit(1);
+    int on = 1;
+    setsockopt(u->sock, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+
+    if (connect(u->sock, (struct sockaddr *)&u->addr, sizeof(u->addr)) < 0 && errno != EINPROGRESS) {
+        disconnect(u, strerror(errno));
+        return;
+    }
+    u->connecting = 1;
+}
+
+// The connect finished one way or the other; a good connection opens with HELLO
+static void finish_connect(uplink_t *u) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    uint8_t frame[PROTOCOL_HEADER_SIZE + sizeof(hello_t) + 8];
+
+    getsockopt(u->sock, SOL_SOCKET, SO_ERROR, &error, &len);
+    if (error) {
+        disconnect(u, strerror(error));
+        return;
     }
 
-    // Send resource usage data
-    snprintf(message, sizeof(message), "CPU: %.2f, Memory: %.2f", cpu_usage, memory_usage);
-    send(sock, message, strlen(message), 0);
+    size_t hello_len = protocol_encode_hello(frame, sizeof(frame), &u->hello);
+    if (queue_reserve(u, hello_len) < 0) {
+        disconnect(u, "send queue full");
+        return;
+    }
+    memmove(u->queue + hello_len, u->queue, u->queued);
+    memcpy(u->queue, frame, hello_len);
+    u->queued += hello_len;
 
-    close(sock);
+    u->connecting = 0;
+    u->backoff_ms = RECONNECT_MIN_MS;
+    printf("Connected to server %s:%d\n", inet_ntoa(u->addr.sin_addr), ntohs(u->addr.sin_port));
 }
 
-int main() {
-    float cpu_usage, memory_usage;
+// Write as much of the queue as the socket takes, then drop the frames that are fully out
+static void flush_queue(uplink_t *u) {
+    int error = 0;
 
+    while (u->sent < u->queued) {
+        ssize_t n = send(u->sock, u->queue + u->sent, u->queued - u->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                error = errno;
+            break;
+        }
+        u->sent += n;
+    }
+
+    size_t done = 0;
+    while (done < u->sent && done + frame_length(u->queue + done) <= u->sent)
+        done += frame_length(u->queue + done);
+    if (done > 0) {
+        queue_remove(u, 0, done);
+        u->sent -= done;
+    }
+
+    if (error)
+        disconnect(u, strerror(error));
+}
+
+static void read_server(uplink_t *u) {
+    uint8_t buffer[4096];
+    ssize_t n = recv(u->sock, buffer, sizeof(buffer), 0);
+
+    if (n == 0)
+        disconnect(u, "closed by server");
+    else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        disconnect(u, strerror(errno));
+}
+
+static void take_sample(uplink_t *u) {
+    report.timestamp_ms = now_ms(CLOCK_REALTIME);
+    node_metrics_sample(&metrics, &report);
+    proc_table_scan(&processes, &report);
+
+    printf("CPU: %.2f%%, Memory: %.2f%%, CPU pressure: %.2f%%\n",
+           report.cpu_usage, report.memory_usage, report.psi[PSI_CPU_SOME]);
+    if (report.num_procs > 0)
+        printf("Top process: %s (%u) CPU %.1f%%, RSS %llu kB, dirtying %u kB/s\n",
+               report.procs[0].name, report.procs[0].pid, report.procs[0].cpu_usage,
+               (unsigned long long)report.procs[0].rss_kb, report.procs[0].dirty_kb_per_sec);
+    queue_report(u, &report);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-s server_ip] [-p port] [-n node_id] [-i interval_ms]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *server_ip = SERVER_IP;
+    int port = SERVER_PORT;
+    int interval_ms = SAMPLE_INTERVAL_MS;
+    uplink_t *u = &uplink;
+    int opt;
+
+    memset(u, 0, sizeof(*u));
+    u->hello.role = ROLE_MONITOR;
+    gethostname(u->hello.node_id, sizeof(u->hello.node_id) - 1);
+
+    while ((opt = getopt(argc, argv, "s:p:n:i:")) != -1) {
+        switch (opt) {
+        case 's':
+            server_ip = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            snprintf(u->hello.node_id, sizeof(u->hello.node_id), "%s", optarg);
+            break;
+        case 'i':
+            interval_ms = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (interval_ms <= 0)
+        interval_ms = SAMPLE_INTERVAL_MS;
+
+    // Configure server address
+    u->addr.sin_family = AF_INET;
+    u->addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, server_ip, &u->addr.sin_addr) != 1) {
+        fprintf(stderr, "Invalid server address '%s'\n", server_ip);
+        return 1;
+    }
+
+    raise_fd_limit();
+    if (node_metrics_open(&metrics) < 0 || proc_table_open(&processes) < 0)
+        return 1;
+    proc_table_scan(&processes, &report); // Baseline for the first CPU and dirty rates
+
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0); // Keep the log current when redirected to a file
+    srand(getpid() ^ (unsigned int)now_ms(CLOCK_REALTIME));
+    u->sock = -1;
+    u->backoff_ms = RECONNECT_MIN_MS;
+
+    long long next_sample = now_ms(CLOCK_MONOTONIC);
     while (1) {
-        get_resource_usage(&cpu_usage, &memory_usage);
-        printf("CPU: %.2f%%, Memory: %.2f%%\n", cpu_usage, memory_usage);
-        send_data_to_server(cpu_usage, memory_usage);
-        sleep(5);
+        long long now = now_ms(CLOCK_MONOTONIC);
+
+        if (now >= next_sample) {
+            take_sample(u);
+            next_sample += interval_ms;
+            if (next_sample <= now)
+                next_sample = now + interval_ms; // Sampling overran; don't try to catch up
+        }
+
+        if (u->sock < 0 && now >= u->retry_at)
+            start_connect(u);
+
+        // Sleep until the next sample, reconnect attempt or socket event
+        long long wake = next_sample;
+        if (u->sock < 0 && u->retry_at < wake)
+            wake = u->retry_at;
+        int timeout = wake > now ? (int)(wake - now) : 0;
+
+        struct pollfd pfd = {.fd = u->sock, .events = POLLIN};
+        if (u->connecting || u->sent < u->queued)
+            pfd.events |= POLLOUT;
+
+        if (poll(&pfd, 1, timeout) <= 0 || u->sock < 0)
+            continue;
+
+        if (u->connecting) {
+            if (pfd.revents & (POLLOUT | POLLERR | POLLHUP))
+                finish_connect(u);
+            continue;
+        }
+
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+            read_server(u);
+        if (u->sock >= 0 && pfd.revents & POLLOUT)
+            flush_queue(u);
     }
 
     return 0;
-}
\ No newline at end of file
+}
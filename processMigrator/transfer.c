@@ -0,0 +1,280 @@
+#define _GNU_SOURCE
+#include "transfer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#define CHUNK_SIZE (256 * 1024)
+
+int transfer_send_all(int sock, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+
+    while (len > 0) {
+        ssize_t n = send(sock, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int transfer_recv_all(int sock, void *buf, size_t len) {
+    uint8_t *p = buf;
+
+    while (len > 0) {
+        ssize_t n = recv(sock, p, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int transfer_read_frame(int sock, frame_header_t *header, uint8_t *payload) {
+    uint8_t buf[PROTOCOL_HEADER_SIZE];
+
+    if (transfer_recv_all(sock, buf, sizeof(buf)) < 0 || protocol_decode_header(buf, sizeof(buf), header) < 0)
+        return -1;
+    return transfer_recv_all(sock, payload, header->length);
+}
+
+// CRIU's logs stay with the node that wrote them
+static int is_image(const struct dirent *entry) {
+    size_t len = strlen(entry->d_name);
+
+    if (entry->d_name[0] == '.')
+        return 0;
+    return len < 4 || strcmp(entry->d_name + len - 4, ".log") != 0;
+}
+
+static int send_file(int sock, int dir_fd, const char *name, uint64_t *bytes) {
+    uint8_t frame[PROTOCOL_HEADER_SIZE + MAX_IMAGE_NAME + 16];
+    image_file_t file;
+    struct stat st;
+
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        return 0;
+    }
+
+    snprintf(file.name, sizeof(file.name), "%s", name);
+    file.size = st.st_size;
+    size_t len = protocol_encode_image_file(frame, sizeof(frame), &file);
+    if (len == 0 || transfer_send_all(sock, frame, len) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    off_t offset = 0;
+    while (offset < st.st_size) {
+        ssize_t n = sendfile(sock, fd, &offset, st.st_size - offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            close(fd);
+            return -1; // The file shrank under us or the peer left
+        }
+    }
+
+    close(fd);
+    *bytes += st.st_size;
+    return 0;
+}
+
+int transfer_send_dir(int sock, const char *dir, uint64_t *bytes) {
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    int status = 0;
+
+    if (!d)
+        return -1;
+
+    while (status == 0 && (entry = readdir(d)) != NULL) {
+        if (is_image(entry))
+            status = send_file(sock, dirfd(d), entry->d_name, bytes);
+    }
+
+    closedir(d);
+    return status;
+}
+
+// Names come from the peer, so they must stay inside the image directory
+static int valid_name(const char *name) {
+    return name[0] != '\0' && name[0] != '.' && !strchr(name, '/');
+}
+
+static int receive_file(int sock, int dir_fd, const image_file_t *file, uint8_t *chunk, uint64_t *bytes) {
+    if (!valid_name(file->name)) {
+        fprintf(stderr, "Refusing image file '%s'\n", file->name);
+        return -1;
+    }
+
+    int fd = openat(dir_fd, file->name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        perror("Failed to create image file");
+        return -1;
+    }
+
+    uint64_t left = file->size;
+    while (left > 0) {
+        size_t want = left < CHUNK_SIZE ? left : CHUNK_SIZE;
+        ssize_t n = recv(sock, chunk, want, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0 || write(fd, chunk, n) != n) {
+            close(fd);
+            return -1;
+        }
+        left -= n;
+    }
+
+    close(fd);
+    *bytes += file->size;
+    return 0;
+}
+
+int transfer_receive_dir(int sock, const char *dir, image_end_t *end, uint64_t *bytes) {
+    frame_header_t header;
+    image_file_t file;
+    int status = -1;
+
+    // Several migrations may be coming in at once
+    uint8_t *payload = malloc(PROTOCOL_MAX_PAYLOAD), *chunk = malloc(CHUNK_SIZE);
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    while (payload && chunk && dir_fd >= 0 && transfer_read_frame(sock, &header, payload) == 0) {
+        if (header.type == MSG_IMAGE_END) {
+            status = protocol_decode_image_end(payload, header.length, end);
+            break;
+        }
+        if (header.type != MSG_IMAGE_FILE || protocol_decode_image_file(payload, header.length, &file) < 0 ||
+            receive_file(sock, dir_fd, &file, chunk, bytes) < 0)
+            break;
+    }
+
+    if (dir_fd >= 0)
+        close(dir_fd);
+    free(payload);
+    free(chunk);
+    return status;
+}
+
+// Move exactly len bytes from the pipe to out
+static int drain_pipe(int pipe_out, int out, size_t len) {
+    while (len > 0) {
+        ssize_t n = splice(pipe_out, NULL, out, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+// Whatever local has ready becomes one PAGE_DATA frame on the link. Returns
+// the bytes passed on, 0 at end of stream and -1 on failure.
+static ssize_t forward_to_link(int local, int link, int pipe_fds[2]) {
+    uint8_t header[PROTOCOL_HEADER_SIZE];
+
+    ssize_t n;
+    while ((n = splice(local, NULL, pipe_fds[1], NULL, PROTOCOL_MAX_PAYLOAD, SPLICE_F_MOVE)) < 0 && errno == EINTR)
+        ;
+    if (n <= 0)
+        return n;
+
+    protocol_encode_header(header, sizeof(header), MSG_PAGE_DATA, n);
+    if (transfer_send_all(link, header, sizeof(header)) < 0 || drain_pipe(pipe_fds[0], link, n) < 0)
+        return -1;
+    return n;
+}
+
+// Pass the payload of a PAGE_DATA frame from the link to local
+static int deliver_to_local(int link, int local, int pipe_fds[2], size_t len) {
+    while (len > 0) {
+        ssize_t n = splice(link, NULL, pipe_fds[1], NULL, len, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0 || drain_pipe(pipe_fds[0], local, n) < 0)
+            return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+int transfer_relay_pages(int local, int link, int dump_side, uint64_t *bytes) {
+    int pipe_fds[2];
+    frame_header_t header;
+    uint8_t buf[PROTOCOL_HEADER_SIZE];
+    int status = -1, local_open = 1;
+
+    if (pipe2(pipe_fds, O_CLOEXEC) < 0)
+        return -1;
+
+    for (;;) {
+        struct pollfd pfd[2] = {{.fd = local_open ? local : -1, .events = POLLIN}, {.fd = link, .events = POLLIN}};
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (pfd[0].revents) {
+            ssize_t n = forward_to_link(local, link, pipe_fds);
+            if (n < 0)
+                break;
+            *bytes += n;
+
+            if (n == 0) {
+                // CRIU has had its last reply and hung up
+                local_open = 0;
+                if (dump_side) {
+                    size_t len = protocol_encode_header(buf, sizeof(buf), MSG_PAGE_END, 0);
+                    status = transfer_send_all(link, buf, len);
+                    break;
+                }
+            }
+        }
+
+        if (pfd[1].revents) {
+            if (transfer_recv_all(link, buf, sizeof(buf)) < 0 || protocol_decode_header(buf, sizeof(buf), &header) < 0)
+                break;
+
+            if (header.type == MSG_PAGE_END && !dump_side) {
+                shutdown(local, SHUT_WR);
+                status = 0;
+                break;
+            }
+            if (header.type != MSG_PAGE_DATA || !local_open ||
+                deliver_to_local(link, local, pipe_fds, header.length) < 0)
+                break;
+        }
+    }
+
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return status;
+}
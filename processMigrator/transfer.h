@@ -0,0 +1,31 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "migration_protocol.h"
+
+// Blocking helpers for executor connections. All return 0 on success and -1
+// on failure or when the peer goes away.
+int transfer_send_all(int sock, const void *buf, size_t len);
+int transfer_recv_all(int sock, void *buf, size_t len);
+
+// Read one whole frame; payload must hold PROTOCOL_MAX_PAYLOAD bytes
+int transfer_read_frame(int sock, frame_header_t *header, uint8_t *payload);
+
+// Send every image file in dir as IMAGE_FILE frames, the contents going
+// straight from the page cache to the socket. Adds the bytes sent to *bytes.
+int transfer_send_dir(int sock, const char *dir, uint64_t *bytes);
+
+// Counterpart of transfer_send_dir: write the files into dir until the
+// IMAGE_END frame, which is returned in *end.
+int transfer_receive_dir(int sock, const char *dir, image_end_t *end, uint64_t *bytes);
+
+// Carry a CRIU page-server conversation between local, a socket CRIU holds
+// the other end of, and the peer link, splicing the data through a pipe so
+// it is never copied to user space. The dump side ends with PAGE_END once
+// CRIU hangs up; the page-server side stops when PAGE_END arrives. Adds the
+// bytes sent on the link to *bytes.
+int transfer_relay_pages(int local, int link, int dump_side, uint64_t *bytes);
+
+#endif // TRANSFER_H